@@ -78,6 +78,10 @@
 #include "IccTag.h"
 #include "IccIO.h"
 #include "IccApplyBPC.h"
+#include <math.h>
+#include <map>
+#include <mutex>
+#include <vector>
 
 #ifdef USESAMPLEICCNAMESPACE
 namespace sampleICC {
@@ -132,56 +136,75 @@ void CIccPCS::Reset(icColorSpaceSignature StartSpace, bool bUseLegacyPCS)
 
 /**
  **************************************************************************
-  * Name: CIccPCS::Check
+  * Name: icLab4ToLab2
   *
   * Purpose:
-  *  This is called before the apply of each profile's xform to adjust the PCS
-  *  to the xform's needed PCS.
+  *  CIccPCS::Lab4ToLab2 with the signature of the other PCS conversions
+  **************************************************************************
+  */
+static void icLab4ToLab2(icFloatNumber* Dst, const icFloatNumber* Src, bool /*bNoClip*/)
+{
+  CIccPCS::Lab4ToLab2(Dst, Src);
+}
+
+static void icLab4ToLab2N(icFloatNumber* Dst, const icFloatNumber* Src, icUInt32Number nPixels, bool /*bNoClip*/)
+{
+  CIccPCS::Lab4ToLab2N(Dst, Src, nPixels);
+}
+
+static CIccPCSStep icPCSStep(void (*Convert)(icFloatNumber*, const icFloatNumber*, bool),
+                             void (*ConvertN)(icFloatNumber*, const icFloatNumber*, icUInt32Number, bool),
+                             bool bNoClip)
+{
+  CIccPCSStep step;
+
+  step.Convert = Convert;
+  step.ConvertN = ConvertN;
+  step.bNoClip = bNoClip;
+
+  return step;
+}
+
+/**
+ **************************************************************************
+  * Name: CIccPCS::Step
+  *
+  * Purpose:
+  *  Decides how the PCS must be adjusted before the apply of the xform and
+  *  moves to the xform's destination space.
   *
   * Args:
-  *   SrcPixel = source pixel data (this may need adjusting),
-  *   pXform = the xform that who's Apply function will shortly be called
+  *   pXform = the xform that who's Apply function will be called next
   *
   * Return:
-  *  SrcPixel or ptr to adjusted pixel data (we dont want to modify the source data).
+  *  The adjustment, empty if none is needed.
   **************************************************************************
   */
-const icFloatNumber* CIccPCS::Check(const icFloatNumber* SrcPixel, const CIccXform* pXform)
+CIccPCSStep CIccPCS::Step(const CIccXform* pXform)
 {
   icColorSpaceSignature NextSpace = pXform->GetSrcSpace();
   bool bIsV2 = pXform->UseLegacyPCS();
   bool bIsNextV2Lab = bIsV2 && (NextSpace == icSigLabData);
-  const icFloatNumber* rv;
   bool bNoClip = pXform->NoClipPCS();
+  CIccPCSStep rv = icPCSStep(NULL, NULL, bNoClip);
 
   if (m_bIsV2Lab && !bIsNextV2Lab) {
-    Lab2ToLab4(m_Convert, SrcPixel, bNoClip);
-    if (NextSpace == icSigXYZData) {
-      LabToXyz(m_Convert, m_Convert, bNoClip);
-    }
-    rv = m_Convert;
+    if (NextSpace == icSigXYZData)
+      rv = icPCSStep(Lab2ToXyz, Lab2ToXyzN, bNoClip);
+    else
+      rv = icPCSStep(Lab2ToLab4, Lab2ToLab4N, bNoClip);
   }
   else if (!m_bIsV2Lab && bIsNextV2Lab) {
-    if (m_Space == icSigXYZData) {
-      XyzToLab(m_Convert, SrcPixel, bNoClip);
-      SrcPixel = m_Convert;
-    }
-    Lab4ToLab2(m_Convert, SrcPixel);
-    rv = m_Convert;
-  }
-  else if (m_Space == NextSpace) {
-    rv = SrcPixel;
+    if (m_Space == icSigXYZData)
+      rv = icPCSStep(XyzToLab2, XyzToLab2N, bNoClip);
+    else
+      rv = icPCSStep(icLab4ToLab2, icLab4ToLab2N, bNoClip);
   }
   else if (m_Space == icSigXYZData && NextSpace == icSigLabData) {
-    XyzToLab(m_Convert, SrcPixel, bNoClip);
-    rv = m_Convert;
+    rv = icPCSStep(XyzToLab, XyzToLabN, bNoClip);
   }
   else if (m_Space == icSigLabData && NextSpace == icSigXYZData) {
-    LabToXyz(m_Convert, SrcPixel, bNoClip);
-    rv = m_Convert;
-  }
-  else {
-    rv = SrcPixel;
+    rv = icPCSStep(LabToXyz, LabToXyzN, bNoClip);
   }
 
   m_Space = pXform->GetDstSpace();
@@ -190,6 +213,68 @@ const icFloatNumber* CIccPCS::Check(const icFloatNumber* SrcPixel, const CIccXfo
   return rv;
 }
 
+/**
+ **************************************************************************
+  * Name: CIccPCS::LastStep
+  *
+  * Purpose:
+  *  Decides how the PCS must be adjusted after all xforms are applied.
+  *  Note: space will always be V4.
+  *
+  * Args:
+  *  DestSpace = destination color space
+  *  bNoClip = indicates whether PCS should be clipped
+  *
+  * Return:
+  *  The adjustment, empty if none is needed.
+  **************************************************************************
+  */
+CIccPCSStep CIccPCS::LastStep(icColorSpaceSignature DestSpace, bool bNoClip) const
+{
+  if (m_bIsV2Lab) {
+    if (DestSpace == icSigXYZData)
+      return icPCSStep(Lab2ToXyz, Lab2ToXyzN, bNoClip);
+    return icPCSStep(Lab2ToLab4, Lab2ToLab4N, bNoClip);
+  }
+
+  if (m_Space != DestSpace) {
+    if (m_Space == icSigXYZData)
+      return icPCSStep(XyzToLab, XyzToLabN, bNoClip);
+    if (m_Space == icSigLabData)
+      return icPCSStep(LabToXyz, LabToXyzN, bNoClip);
+  }
+
+  return icPCSStep(NULL, NULL, bNoClip);
+}
+
+/**
+ **************************************************************************
+  * Name: CIccPCS::Check
+  *
+  * Purpose:
+  *  This is called before the apply of each profile's xform to adjust the PCS
+  *  to the xform's needed PCS.
+  *
+  * Args:
+  *   SrcPixel = source pixel data (this may need adjusting),
+  *   pXform = the xform that who's Apply function will shortly be called
+  *
+  * Return:
+  *  SrcPixel or ptr to adjusted pixel data (we dont want to modify the source data).
+  **************************************************************************
+  */
+const icFloatNumber* CIccPCS::Check(const icFloatNumber* SrcPixel, const CIccXform* pXform)
+{
+  CIccPCSStep step = Step(pXform);
+
+  if (!step.Convert)
+    return SrcPixel;
+
+  step.Convert(m_Convert, SrcPixel, step.bNoClip);
+
+  return m_Convert;
+}
+
 /**
  **************************************************************************
   * Name: CIccPCS::CheckLast
@@ -206,21 +291,10 @@ const icFloatNumber* CIccPCS::Check(const icFloatNumber* SrcPixel, const CIccXfo
   */
 void CIccPCS::CheckLast(icFloatNumber* Pixel, icColorSpaceSignature DestSpace, bool bNoClip)
 {
-  if (m_bIsV2Lab) {
-    Lab2ToLab4(Pixel, Pixel, bNoClip);
-    if (DestSpace == icSigXYZData) {
-      LabToXyz(Pixel, Pixel, bNoClip);
-    }
-  }
-  else if (m_Space == DestSpace) {
-    return;
-  }
-  else if (m_Space == icSigXYZData) {
-    XyzToLab(Pixel, Pixel, bNoClip);
-  }
-  else if (m_Space == icSigLabData) {
-    LabToXyz(Pixel, Pixel, bNoClip);
-  }
+  CIccPCSStep step = LastStep(DestSpace, bNoClip);
+
+  if (step.Convert)
+    step.Convert(Pixel, Pixel, step.bNoClip);
 }
 
 /**
@@ -400,6 +474,120 @@ void CIccPCS::Lab4ToLab2(icFloatNumber* Dst, const icFloatNumber* Src)
   Dst[2] = (icFloatNumber)(Src[2] * 65280.0f / 65535.0f);
 }
 
+/**
+ **************************************************************************
+  * Name: CIccPCS::LabToXyzN
+  *
+  * Purpose:
+  *  Convert nPixels packed Lab pixels to XYZ (Dst may be Src)
+  **************************************************************************
+  */
+void CIccPCS::LabToXyzN(icFloatNumber* Dst, const icFloatNumber* Src, icUInt32Number nPixels, bool bNoClip)
+{
+  icUInt32Number i;
+
+  if (Dst != Src)
+    memcpy(Dst, Src, 3 * nPixels * sizeof(icFloatNumber));
+
+  icLabFromPcsN(Dst, nPixels);
+
+  icLabtoXYZN(Dst, Dst, nPixels);
+
+  icXyzToPcsN(Dst, nPixels);
+
+  if (!bNoClip) {
+    for (i = 0; i < 3 * nPixels; i++)
+      Dst[i] = UnitClip(Dst[i]);
+  }
+}
+
+/**
+ **************************************************************************
+  * Name: CIccPCS::XyzToLabN
+  *
+  * Purpose:
+  *  Convert nPixels packed XYZ pixels to Lab (Dst may be Src)
+  **************************************************************************
+  */
+void CIccPCS::XyzToLabN(icFloatNumber* Dst, const icFloatNumber* Src, icUInt32Number nPixels, bool bNoClip)
+{
+  icUInt32Number i;
+
+  if (!bNoClip) {
+    for (i = 0; i < 3 * nPixels; i++)
+      Dst[i] = UnitClip(Src[i]);
+  }
+  else if (Dst != Src)
+    memcpy(Dst, Src, 3 * nPixels * sizeof(icFloatNumber));
+
+  icXyzFromPcsN(Dst, nPixels);
+
+  icXYZtoLabN(Dst, Dst, nPixels);
+
+  icLabToPcsN(Dst, nPixels);
+
+  if (!bNoClip) {
+    for (i = 0; i < 3 * nPixels; i++)
+      Dst[i] = UnitClip(Dst[i]);
+  }
+}
+
+/**
+ **************************************************************************
+  * Name: CIccPCS::Lab2ToXyzN
+  *
+  * Purpose:
+  *  Convert nPixels packed version 2 Lab pixels to XYZ (Dst may be Src)
+  **************************************************************************
+  */
+void CIccPCS::Lab2ToXyzN(icFloatNumber* Dst, const icFloatNumber* Src, icUInt32Number nPixels, bool bNoClip)
+{
+  Lab2ToLab4N(Dst, Src, nPixels, bNoClip);
+  LabToXyzN(Dst, Dst, nPixels, bNoClip);
+}
+
+/**
+ **************************************************************************
+  * Name: CIccPCS::XyzToLab2N
+  *
+  * Purpose:
+  *  Convert nPixels packed XYZ pixels to version 2 Lab (Dst may be Src)
+  **************************************************************************
+  */
+void CIccPCS::XyzToLab2N(icFloatNumber* Dst, const icFloatNumber* Src, icUInt32Number nPixels, bool bNoClip)
+{
+  XyzToLabN(Dst, Src, nPixels, bNoClip);
+  Lab4ToLab2N(Dst, Dst, nPixels);
+}
+
+/**
+ **************************************************************************
+  * Name: CIccPCS::Lab2ToLab4N
+  *
+  * Purpose:
+  *  Convert nPixels packed version 2 Lab pixels to version 4 Lab
+  **************************************************************************
+  */
+void CIccPCS::Lab2ToLab4N(icFloatNumber* Dst, const icFloatNumber* Src, icUInt32Number nPixels, bool bNoClip)
+{
+  for (; nPixels; nPixels--, Dst += 3, Src += 3)
+    Lab2ToLab4(Dst, Src, bNoClip);
+}
+
+/**
+ **************************************************************************
+  * Name: CIccPCS::Lab4ToLab2N
+  *
+  * Purpose:
+  *  Convert nPixels packed version 4 Lab pixels to version 2 Lab
+  **************************************************************************
+  */
+void CIccPCS::Lab4ToLab2N(icFloatNumber* Dst, const icFloatNumber* Src, icUInt32Number nPixels)
+{
+  for (; nPixels; nPixels--, Dst += 3, Src += 3)
+    Lab4ToLab2(Dst, Src);
+}
+
 /**
 **************************************************************************
 * Name: CIccCreateXformHintManager::CIccCreateXformHintManager
@@ -525,6 +713,311 @@ IIccCreateXformHint* CIccCreateXformHintManager::GetHint(const char* hintName)
   return pHint;
 }
 
+/**
+**************************************************************************
+* Name: icRefineInv
+*
+* Purpose:
+*  Refines the inverse of a smooth curve for value v inside the bracket
+*  [p0, p1] (with curve values v0 < v <= v1) using the Illinois variant of
+*  false position.
+**************************************************************************
+*/
+static icFloatNumber icRefineInv(CIccCurve* pCurve, double v,
+  double p0, double v0, double p1, double v1)
+{
+  int nSide = 0;
+
+  for (int n = 0; n < 24 && fabs(p1 - p0) > 1.0e-7 && v1 > v0; n++) {
+    double p = p0 + (v - v0) * (p1 - p0) / (v1 - v0);
+    double nv = pCurve->Apply((icFloatNumber)p);
+
+    if (nv == v)
+      return (icFloatNumber)p;
+
+    if (nv < v) {
+      p0 = p;
+      v0 = nv;
+      if (nSide < 0)
+        v1 = v + (v1 - v) / 2.0;
+      nSide = -1;
+    }
+    else {
+      p1 = p;
+      v1 = nv;
+      if (nSide > 0)
+        v0 = v - (v - v0) / 2.0;
+      nSide = 1;
+    }
+  }
+
+  if (v1 <= v0)
+    return (icFloatNumber)p0;
+
+  return (icFloatNumber)(p0 + (v - v0) * (p1 - p0) / (v1 - v0));
+}
+
+/**
+**************************************************************************
+* Name: CIccInvCurveCache::BuildInvCurve
+*
+* Purpose:
+*  Builds an inverse curve table.  The forward curve is sampled once (at
+*  its own nodes for curveType tables, where linear interpolation of the
+*  inverse is exact), made monotone and then swept in a single pass over
+*  the increasing output values.  Smooth curves are refined within the
+*  sampled bracket.  Values outside the curve range map to the end points
+*  as CIccCurve::Find() does; decreasing curves are supported.
+*
+* Args:
+*  pCurve = forward curve (Begin() must have been called),
+*  Lut = location for the nSize inverse values,
+*  nSize = number of entries to build
+**************************************************************************
+*/
+void CIccInvCurveCache::BuildInvCurve(CIccCurve* pCurve, icFloatNumber* Lut, icUInt32Number nSize)
+{
+  std::vector<double> X, Y;
+  icUInt32Number i, j, n;
+  bool bExact = false;
+
+  if (nSize < 2) {
+    if (nSize)
+      Lut[0] = 0;
+    return;
+  }
+
+  if (pCurve->GetType() == icSigCurveType && ((CIccTagCurve*)pCurve)->GetSize() > 1) {
+    CIccTagCurve* pTable = (CIccTagCurve*)pCurve;
+    n = pTable->GetSize();
+    X.resize(n);
+    Y.resize(n);
+
+    for (j = 0; j < n; j++) {
+      X[j] = (double)j / (n - 1);
+      Y[j] = (*pTable)[j] > 1.0 ? 1.0 : (*pTable)[j];
+    }
+    bExact = true;
+  }
+  else {
+    n = 2 * nSize - 1;
+    X.resize(n);
+    Y.resize(n);
+
+    for (j = 0; j < n; j++) {
+      X[j] = (double)j / (n - 1);
+      Y[j] = pCurve->Apply((icFloatNumber)X[j]);
+    }
+  }
+
+  //Sweep in order of increasing curve value
+  if (Y[n - 1] < Y[0]) {
+    for (j = 0; j < n / 2; j++) {
+      std::swap(X[j], X[n - 1 - j]);
+      std::swap(Y[j], Y[n - 1 - j]);
+    }
+  }
+
+  //Force monotonicity so that noisy tables still give a usable inverse
+  for (j = 1; j < n; j++) {
+    if (Y[j] < Y[j - 1])
+      Y[j] = Y[j - 1];
+  }
+
+  double vMin = Y[0], vMax = Y[n - 1];
+
+  for (i = 0, j = 0; i < nSize; i++) {
+    double v = (double)i / (nSize - 1);
+
+    if (v <= vMin) {
+      Lut[i] = (icFloatNumber)X[0];
+    }
+    else if (v >= vMax) {
+      Lut[i] = (icFloatNumber)X[n - 1];
+    }
+    else {
+      while (Y[j + 1] < v)
+        j++;
+
+      if (bExact)
+        Lut[i] = (icFloatNumber)(X[j] + (v - Y[j]) * (X[j + 1] - X[j]) / (Y[j + 1] - Y[j]));
+      else
+        Lut[i] = icRefineInv(pCurve, v, X[j], Y[j], X[j + 1], Y[j + 1]);
+    }
+  }
+}
+
+/**
+**************************************************************************
+* Name: CIccInvCurveCacheData
+*
+* Purpose:
+*  Storage for CIccInvCurveCache.  Entries are kept in most recently used
+*  order.
+**************************************************************************
+*/
+typedef std::pair<std::string, std::vector<icFloatNumber> > CIccInvCurveEntry;
+typedef std::list<CIccInvCurveEntry> CIccInvCurveList;
+
+struct CIccInvCurveCacheData
+{
+  CIccInvCurveCacheData() : nMaxEntries(64) {}
+
+  std::mutex lock;
+  CIccInvCurveList entries;
+  std::map<std::string, CIccInvCurveList::iterator> index;
+  icUInt32Number nMaxEntries;
+};
+
+static CIccInvCurveCacheData& icInvCurveCache()
+{
+  static CIccInvCurveCacheData cache;
+  return cache;
+}
+
+/**
+**************************************************************************
+* Name: icInvCurveKey
+*
+* Purpose:
+*  Builds the cache key for a curve from its type, data and the table size.
+*
+* Return:
+*  false if the curve type can't be keyed (and shouldn't be cached)
+**************************************************************************
+*/
+static bool icInvCurveKey(CIccCurve* pCurve, icUInt32Number nSize, std::string& sKey)
+{
+  icTagTypeSignature sig = pCurve->GetType();
+
+  sKey.assign((const char*)&nSize, sizeof(nSize));
+  sKey.append((const char*)&sig, sizeof(sig));
+
+  if (sig == icSigCurveType) {
+    CIccTagCurve* pTable = (CIccTagCurve*)pCurve;
+    icUInt32Number n = pTable->GetSize();
+
+    sKey.append((const char*)&n, sizeof(n));
+    if (n)
+      sKey.append((const char*)pTable->GetData(0), n * sizeof(icFloatNumber));
+  }
+  else if (sig == icSigParametricCurveType) {
+    CIccTagParametricCurve* pParam = (CIccTagParametricCurve*)pCurve;
+    icUInt16Number nType = pParam->GetFunctionType();
+
+    sKey.append((const char*)&nType, sizeof(nType));
+    if (pParam->GetNumParam())
+      sKey.append((const char*)pParam->GetParams(), pParam->GetNumParam() * sizeof(icFloatNumber));
+  }
+  else {
+    return false;
+  }
+
+  return true;
+}
+
+/**
+**************************************************************************
+* Name: CIccInvCurveCache::NewInvCurve
+*
+* Purpose:
+*  Returns a new inverse curve for pCurve, reusing a cached table if one
+*  was built for the same curve and size.
+*
+* Args:
+*  pCurve = forward curve (Begin() must have been called),
+*  nSize = number of entries in the inverse (clipped to 2..65536)
+*
+* Return:
+*  New CIccTagCurve owned by the caller
+**************************************************************************
+*/
+CIccTagCurve* CIccInvCurveCache::NewInvCurve(CIccCurve* pCurve, icUInt32Number nSize)
+{
+  if (nSize < 2)
+    nSize = 2;
+  else if (nSize > 65536)
+    nSize = 65536;
+
+  CIccTagCurve* pInvCurve = new CIccTagCurve(nSize);
+  icFloatNumber* Lut = &(*pInvCurve)[0];
+
+  CIccInvCurveCacheData& cache = icInvCurveCache();
+  std::string sKey;
+
+  if (!icInvCurveKey(pCurve, nSize, sKey)) {
+    BuildInvCurve(pCurve, Lut, nSize);
+    return pInvCurve;
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(cache.lock);
+    std::map<std::string, CIccInvCurveList::iterator>::iterator found = cache.index.find(sKey);
+
+    if (found != cache.index.end()) {
+      cache.entries.splice(cache.entries.begin(), cache.entries, found->second);
+      memcpy(Lut, &found->second->second[0], nSize * sizeof(icFloatNumber));
+      return pInvCurve;
+    }
+  }
+
+  //Build outside the lock; a concurrent build of the same table is harmless
+  BuildInvCurve(pCurve, Lut, nSize);
+
+  std::lock_guard<std::mutex> guard(cache.lock);
+
+  if (cache.nMaxEntries && cache.index.find(sKey) == cache.index.end()) {
+    cache.entries.push_front(CIccInvCurveEntry(sKey, std::vector<icFloatNumber>(Lut, Lut + nSize)));
+    cache.index[sKey] = cache.entries.begin();
+
+    while (cache.entries.size() > cache.nMaxEntries) {
+      cache.index.erase(cache.entries.back().first);
+      cache.entries.pop_back();
+    }
+  }
+
+  return pInvCurve;
+}
+
+/**
+**************************************************************************
+* Name: CIccInvCurveCache::SetMaxEntries
+*
+* Purpose:
+*  Sets the maximum number of cached inverse tables (default 64).  Least
+*  recently used tables are dropped first.
+**************************************************************************
+*/
+void CIccInvCurveCache::SetMaxEntries(icUInt32Number nMaxEntries)
+{
+  CIccInvCurveCacheData& cache = icInvCurveCache();
+  std::lock_guard<std::mutex> guard(cache.lock);
+
+  cache.nMaxEntries = nMaxEntries;
+
+  while (cache.entries.size() > cache.nMaxEntries) {
+    cache.index.erase(cache.entries.back().first);
+    cache.entries.pop_back();
+  }
+}
+
+/**
+**************************************************************************
+* Name: CIccInvCurveCache::Clear
+*
+* Purpose:
+*  Removes all cached inverse tables.
+**************************************************************************
+*/
+void CIccInvCurveCache::Clear()
+{
+  CIccInvCurveCacheData& cache = icInvCurveCache();
+  std::lock_guard<std::mutex> guard(cache.lock);
+
+  cache.index.clear();
+  cache.entries.clear();
+}
+
 /**
  **************************************************************************
   * Name: CIccXform::CIccXform
@@ -540,6 +1033,7 @@ CIccXform::CIccXform()
   m_nIntent = icUnknownIntent;
   m_pAdjustPCS = NULL;
   m_bAdjustPCS = false;
+  m_nInvCurveSize = 2048;
 }
 
 
@@ -831,6 +1325,11 @@ void CIccXform::SetParams(CIccProfile* pProfile, bool bInput, icRenderingIntent
     CIccCreateAdjustPCSXformHint* pAdjustPCSHint = (CIccCreateAdjustPCSXformHint*)pHint;
     m_pAdjustPCS = pAdjustPCSHint->GetNewAdjustPCSXform();
   }
+
+  if (pHintManager && (pHint = pHintManager->GetHint("CIccCreateInvCurveXformHint"))) {
+    CIccCreateInvCurveXformHint* pInvCurveHint = (CIccCreateInvCurveXformHint*)pHint;
+    m_nInvCurveSize = pInvCurveHint->m_nSize;
+  }
 }
 
 /**
@@ -992,6 +1491,31 @@ CIccApplyXform* CIccXform::GetNewApply(icStatusCMM& status)
   return rv;
 }
 
+/**
+**************************************************************************
+* Name: CIccXform::Apply
+*
+* Purpose:
+*  Applies the Xform to a run of packed pixels.  Xforms that can do better
+*  than applying one pixel at a time override this.
+*
+* Args:
+*  pApply = ApplyXform object containging temporary storage used during Apply
+*  DstPixel = nPixels destination pixels of GetNumDstSamples() samples,
+*  SrcPixel = nPixels source pixels of GetNumSrcSamples() samples (may be
+*   DstPixel if there are no more destination than source samples),
+*  nPixels = number of pixels to apply
+**************************************************************************
+*/
+void CIccXform::Apply(CIccApplyXform* pApply, icFloatNumber* DstPixel, const icFloatNumber* SrcPixel, icUInt32Number nPixels) const
+{
+  icUInt16Number nSrcSamples = GetNumSrcSamples();
+  icUInt16Number nDstSamples = GetNumDstSamples();
+
+  for (; nPixels; nPixels--, SrcPixel += nSrcSamples, DstPixel += nDstSamples)
+    Apply(pApply, DstPixel, SrcPixel);
+}
+
 /**
  **************************************************************************
 * Name: CIccXform::AdjustPCS
@@ -1045,6 +1569,36 @@ void CIccXform::AdjustPCS(icFloatNumber* DstPixel, const icFloatNumber* SrcPixel
 #endif
 }
 
+/**
+ **************************************************************************
+  * Name: CIccXform::GetPCSAdjustment
+  *
+  * Purpose:
+  *  Gets the scale and offset that AdjustPCS() applies to XYZ pixels on the
+  *  PCS side of the xform, e.g. to fold them into a matrix.
+  *
+  * Args:
+  *  pScale = receives 3 scale factors,
+  *  pOffset = receives 3 offsets
+  *
+  * Return:
+  *  true if the xform adjusts the PCS, false otherwise (pScale and pOffset
+  *  are left unchanged).
+  **************************************************************************
+  */
+bool CIccXform::GetPCSAdjustment(icFloatNumber* pScale, icFloatNumber* pOffset) const
+{
+  if (!m_bAdjustPCS)
+    return false;
+
+  for (int i = 0; i < 3; i++) {
+    pScale[i] = m_PCSScale[i];
+    pOffset[i] = m_PCSOffset[i];
+  }
+
+  return true;
+}
+
 /**
  **************************************************************************
   * Name: CIccXform::CheckSrcAbs
@@ -1378,25 +1932,22 @@ CIccCurve* CIccXformMonochrome::GetCurve(icSignature sig) const
 CIccCurve* CIccXformMonochrome::GetInvCurve(icSignature sig) const
 {
   CIccCurve* pCurve;
-  CIccTagCurve* pInvCurve;
+  CIccCurve* pInvCurve;
 
   if (!(pCurve = GetCurve(sig)))
     return NULL;
 
   pCurve->Begin();
 
-  pInvCurve = new CIccTagCurve(2048);
-
-  int i;
-  icFloatNumber x;
-  icFloatNumber* Lut = &(*pInvCurve)[0];
-
-  for (i = 0; i < 2048; i++) {
-    x = (icFloatNumber)i / 2047;
-
-    Lut[i] = pCurve->Find(x);
+  //parametric curves are inverted in closed form when they can be
+  if (pCurve->GetType() == icSigParametricCurveType) {
+    pInvCurve = CIccInvParametricCurve::Create((CIccTagParametricCurve*)pCurve);
+    if (pInvCurve)
+      return pInvCurve;
   }
 
+  pInvCurve = CIccInvCurveCache::NewInvCurve(pCurve, m_nInvCurveSize);
+
   return pInvCurve;
 }
 
@@ -1602,6 +2153,23 @@ static icFloatNumber RGBClip(icFloatNumber v, CIccCurve* pCurve)
   return pCurve->Apply(v);
 }
 
+/**
+ **************************************************************************
+  * Name: icApplyCurvesN
+  *
+  * Purpose:
+  *  Applies one curve per channel to nPixels packed pixels of nChannels
+  *  channels in place, a channel at a time.
+  **************************************************************************
+  */
+static void icApplyCurvesN(const LPIccCurve* pCurves, int nChannels, icFloatNumber* Pixels, icUInt32Number nPixels)
+{
+  int i;
+
+  for (i = 0; i < nChannels; i++)
+    pCurves[i]->ApplyN(Pixels + i, nPixels, nChannels);
+}
+
 /**
  **************************************************************************
   * Name: CIccXformMatrixTRC::Apply
@@ -1662,6 +2230,98 @@ void CIccXformMatrixTRC::Apply(CIccApplyXform* pApply, icFloatNumber* DstPixel,
   CheckDstAbs(DstPixel);
 }
 
+/**
+ **************************************************************************
+  * Name: CIccXformMatrixTRC::Apply
+  *
+  * Purpose:
+  *  Applies the Xform to a run of packed pixels.  Each curve and the matrix
+  *  are applied to a block of pixels at a time, the arithmetic is the same as
+  *  for a single pixel.
+  *
+  * Args:
+  *  pApply = ApplyXform object containging temporary storage used during Apply
+  *  DstPixel = nPixels destination pixels of 3 channels,
+  *  SrcPixel = nPixels source pixels of 3 channels (may be DstPixel),
+  *  nPixels = number of pixels to apply
+  **************************************************************************
+  */
+void CIccXformMatrixTRC::Apply(CIccApplyXform* pApply, icFloatNumber* DstPixel, const icFloatNumber* SrcPixel, icUInt32Number nPixels) const
+{
+  const icUInt32Number nBlockSize = 64;
+  icFloatNumber Pixels[nBlockSize * 3];
+  icUInt32Number n, k;
+
+  while (nPixels) {
+    n = nPixels < nBlockSize ? nPixels : nBlockSize;
+
+    if (m_bInput) {
+      for (k = 0; k < n; k++) {
+        const icFloatNumber* pSrc = CheckSrcAbs(pApply, SrcPixel + k * 3);
+
+        Pixels[k * 3] = pSrc[0];
+        Pixels[k * 3 + 1] = pSrc[1];
+        Pixels[k * 3 + 2] = pSrc[2];
+      }
+
+      if (m_ApplyCurvePtr) {
+        icApplyCurvesN(m_ApplyCurvePtr, 3, Pixels, n);
+      }
+
+      for (k = 0; k < n; k++) {
+        double LinR = Pixels[k * 3];
+        double LinG = Pixels[k * 3 + 1];
+        double LinB = Pixels[k * 3 + 2];
+        icFloatNumber* pDst = DstPixel + k * 3;
+
+        pDst[0] = XYZScale((icFloatNumber)(m_e[0] * LinR + m_e[1] * LinG + m_e[2] * LinB));
+        pDst[1] = XYZScale((icFloatNumber)(m_e[3] * LinR + m_e[4] * LinG + m_e[5] * LinB));
+        pDst[2] = XYZScale((icFloatNumber)(m_e[6] * LinR + m_e[7] * LinG + m_e[8] * LinB));
+
+        CheckDstAbs(pDst);
+      }
+    }
+    else {
+      for (k = 0; k < n; k++) {
+        const icFloatNumber* pSrc = CheckSrcAbs(pApply, SrcPixel + k * 3);
+        double X = XYZDescale(pSrc[0]);
+        double Y = XYZDescale(pSrc[1]);
+        double Z = XYZDescale(pSrc[2]);
+
+        Pixels[k * 3] = (icFloatNumber)(m_e[0] * X + m_e[1] * Y + m_e[2] * Z);
+        Pixels[k * 3 + 1] = (icFloatNumber)(m_e[3] * X + m_e[4] * Y + m_e[5] * Z);
+        Pixels[k * 3 + 2] = (icFloatNumber)(m_e[6] * X + m_e[7] * Y + m_e[8] * Z);
+      }
+
+      if (m_ApplyCurvePtr) {
+        //clipped as RGBClip() does before the curves are applied
+        for (k = 0; k < n * 3; k++) {
+          if (Pixels[k] <= 0)
+            Pixels[k] = 0;
+          else if (Pixels[k] >= 1.0)
+            Pixels[k] = 1.0;
+        }
+
+        icApplyCurvesN(m_ApplyCurvePtr, 3, Pixels, n);
+      }
+
+      for (k = 0; k < n; k++) {
+        icFloatNumber* pDst = DstPixel + k * 3;
+
+        pDst[0] = Pixels[k * 3];
+        pDst[1] = Pixels[k * 3 + 1];
+        pDst[2] = Pixels[k * 3 + 2];
+
+        CheckDstAbs(pDst);
+      }
+    }
+
+    SrcPixel += n * 3;
+    DstPixel += n * 3;
+    nPixels -= n;
+  }
+}
+
 /**
  **************************************************************************
   * Name: CIccXformMatrixTRC::GetCurve
@@ -1729,25 +2389,22 @@ CIccTagXYZ* CIccXformMatrixTRC::GetColumn(icSignature sig) const
 CIccCurve* CIccXformMatrixTRC::GetInvCurve(icSignature sig) const
 {
   CIccCurve* pCurve;
-  CIccTagCurve* pInvCurve;
+  CIccCurve* pInvCurve;
 
   if (!(pCurve = GetCurve(sig)))
     return NULL;
 
   pCurve->Begin();
 
-  pInvCurve = new CIccTagCurve(2048);
-
-  int i;
-  icFloatNumber x;
-  icFloatNumber* Lut = &(*pInvCurve)[0];
-
-  for (i = 0; i < 2048; i++) {
-    x = (icFloatNumber)i / 2047;
-
-    Lut[i] = pCurve->Find(x);
+  //parametric curves are inverted in closed form when they can be
+  if (pCurve->GetType() == icSigParametricCurveType) {
+    pInvCurve = CIccInvParametricCurve::Create((CIccTagParametricCurve*)pCurve);
+    if (pInvCurve)
+      return pInvCurve;
   }
 
+  pInvCurve = CIccInvCurveCache::NewInvCurve(pCurve, m_nInvCurveSize);
+
   return pInvCurve;
 }
 
@@ -2012,6 +2669,98 @@ void CIccXform3DLut::Apply(CIccApplyXform* pApply, icFloatNumber* DstPixel, cons
   Pixel[1] = SrcPixel[1];
   Pixel[2] = SrcPixel[2];
 
+  ApplyInputStages(Pixel);
+
+  if (m_pTag->m_CLUT) {
+    if (m_nInterp == icInterpLinear)
+      m_pTag->m_CLUT->Interp3d(Pixel, Pixel);
+    else
+      m_pTag->m_CLUT->Interp3dTetra(Pixel, Pixel);
+  }
+
+  ApplyOutputStages(Pixel);
+
+  for (i = 0; i < m_pTag->m_nOutput; i++) {
+    DstPixel[i] = Pixel[i];
+  }
+
+  CheckDstAbs(DstPixel);
+}
+
+/**
+ **************************************************************************
+  * Name: CIccXform3DLut::Apply
+  *
+  * Purpose:
+  *  Applies the Xform to a run of packed pixels.  Each curve set, matrix and
+  *  the tetrahedral CLUT interpolation (CIccCLUT::Interp3dTetraN) are applied
+  *  to a block of pixels at a time.
+  *
+  * Args:
+  *  pApply = ApplyXform object containging temporary storage used during Apply
+  *  DstPixel = nPixels destination pixels of the tag's output channels,
+  *  SrcPixel = nPixels source pixels of 3 channels,
+  *  nPixels = number of pixels to apply
+  **************************************************************************
+  */
+void CIccXform3DLut::Apply(CIccApplyXform* pApply, icFloatNumber* DstPixel, const icFloatNumber* SrcPixel, icUInt32Number nPixels) const
+{
+  icUInt8Number nOutput = m_pTag->m_nOutput;
+
+  if (!m_pTag->m_CLUT || m_nInterp == icInterpLinear) {
+    for (; nPixels; nPixels--, SrcPixel += 3, DstPixel += nOutput)
+      Apply(pApply, DstPixel, SrcPixel);
+    return;
+  }
+
+  const icUInt32Number nBlockSize = 64;
+  icFloatNumber In[nBlockSize * 3], Out[nBlockSize * 16];
+  icUInt32Number n, k;
+  int i;
+
+  while (nPixels) {
+    n = nPixels < nBlockSize ? nPixels : nBlockSize;
+
+    for (k = 0; k < n; k++) {
+      const icFloatNumber* pSrc = CheckSrcAbs(pApply, SrcPixel + k * 3);
+
+      In[k * 3] = pSrc[0];
+      In[k * 3 + 1] = pSrc[1];
+      In[k * 3 + 2] = pSrc[2];
+    }
+
+    ApplyInputStages(In, n);
+
+    m_pTag->m_CLUT->Interp3dTetraN(Out, In, n);
+
+    ApplyOutputStages(Out, n);
+
+    for (k = 0; k < n; k++) {
+      icFloatNumber* Pixel = &Out[k * nOutput];
+
+      for (i = 0; i < nOutput; i++) {
+        DstPixel[i] = Pixel[i];
+      }
+
+      CheckDstAbs(DstPixel);
+      DstPixel += nOutput;
+    }
+
+    SrcPixel += n * 3;
+    nPixels -= n;
+  }
+}
+
+/**
+ **************************************************************************
+  * Name: CIccXform3DLut::ApplyInputStages
+  *
+  * Purpose:
+  *  Applies the curves and matrix that precede the CLUT to a pixel in place.
+  **************************************************************************
+  */
+void CIccXform3DLut::ApplyInputStages(icFloatNumber* Pixel) const
+{
   if (m_pTag->m_bInputMatrix) {
     if (m_ApplyCurvePtrB) {
       Pixel[0] = m_ApplyCurvePtrB[0]->Apply(Pixel[0]);
@@ -2028,57 +2777,121 @@ void CIccXform3DLut::Apply(CIccApplyXform* pApply, icFloatNumber* DstPixel, cons
       Pixel[1] = m_ApplyCurvePtrM[1]->Apply(Pixel[1]);
       Pixel[2] = m_ApplyCurvePtrM[2]->Apply(Pixel[2]);
     }
-
-    if (m_pTag->m_CLUT) {
-      if (m_nInterp == icInterpLinear)
-        m_pTag->m_CLUT->Interp3d(Pixel, Pixel);
-      else
-        m_pTag->m_CLUT->Interp3dTetra(Pixel, Pixel);
+  }
+  else {
+    if (m_ApplyCurvePtrA) {
+      Pixel[0] = m_ApplyCurvePtrA[0]->Apply(Pixel[0]);
+      Pixel[1] = m_ApplyCurvePtrA[1]->Apply(Pixel[1]);
+      Pixel[2] = m_ApplyCurvePtrA[2]->Apply(Pixel[2]);
     }
+  }
+}
 
+/**
+ **************************************************************************
+  * Name: CIccXform3DLut::ApplyOutputStages
+  *
+  * Purpose:
+  *  Applies the curves and matrix that follow the CLUT to a pixel in place.
+  **************************************************************************
+  */
+void CIccXform3DLut::ApplyOutputStages(icFloatNumber* Pixel) const
+{
+  int i;
+
+  if (m_pTag->m_bInputMatrix) {
     if (m_ApplyCurvePtrA) {
       for (i = 0; i < m_pTag->m_nOutput; i++) {
         Pixel[i] = m_ApplyCurvePtrA[i]->Apply(Pixel[i]);
       }
     }
+  }
+  else {
+    if (m_ApplyCurvePtrM) {
+      for (i = 0; i < m_pTag->m_nOutput; i++) {
+        Pixel[i] = m_ApplyCurvePtrM[i]->Apply(Pixel[i]);
+      }
+    }
+
+    if (m_ApplyMatrixPtr) {
+      m_ApplyMatrixPtr->Apply(Pixel);
+    }
 
+    if (m_ApplyCurvePtrB) {
+      for (i = 0; i < m_pTag->m_nOutput; i++) {
+        Pixel[i] = m_ApplyCurvePtrB[i]->Apply(Pixel[i]);
+      }
+    }
+  }
+}
+
+/**
+ **************************************************************************
+  * Name: CIccXform3DLut::ApplyInputStages
+  *
+  * Purpose:
+  *  Applies the curves and matrix that precede the CLUT in place to nPixels
+  *  packed pixels of 3 channels, one stage at a time.
+  **************************************************************************
+  */
+void CIccXform3DLut::ApplyInputStages(icFloatNumber* Pixels, icUInt32Number nPixels) const
+{
+  icUInt32Number k;
+
+  if (m_pTag->m_bInputMatrix) {
+    if (m_ApplyCurvePtrB) {
+      icApplyCurvesN(m_ApplyCurvePtrB, 3, Pixels, nPixels);
+    }
+
+    if (m_ApplyMatrixPtr) {
+      for (k = 0; k < nPixels; k++)
+        m_ApplyMatrixPtr->Apply(Pixels + k * 3);
+    }
+
+    if (m_ApplyCurvePtrM) {
+      icApplyCurvesN(m_ApplyCurvePtrM, 3, Pixels, nPixels);
+    }
   }
   else {
     if (m_ApplyCurvePtrA) {
-      Pixel[0] = m_ApplyCurvePtrA[0]->Apply(Pixel[0]);
-      Pixel[1] = m_ApplyCurvePtrA[1]->Apply(Pixel[1]);
-      Pixel[2] = m_ApplyCurvePtrA[2]->Apply(Pixel[2]);
+      icApplyCurvesN(m_ApplyCurvePtrA, 3, Pixels, nPixels);
     }
+  }
+}
 
-    if (m_pTag->m_CLUT) {
-      if (m_nInterp == icInterpLinear)
-        m_pTag->m_CLUT->Interp3d(Pixel, Pixel);
-      else
-        m_pTag->m_CLUT->Interp3dTetra(Pixel, Pixel);
-    }
+/**
+ **************************************************************************
+  * Name: CIccXform3DLut::ApplyOutputStages
+  *
+  * Purpose:
+  *  Applies the curves and matrix that follow the CLUT in place to nPixels
+  *  packed pixels of the tag's output channels, one stage at a time.
+  **************************************************************************
+  */
+void CIccXform3DLut::ApplyOutputStages(icFloatNumber* Pixels, icUInt32Number nPixels) const
+{
+  int nOutput = m_pTag->m_nOutput;
+  icUInt32Number k;
 
+  if (m_pTag->m_bInputMatrix) {
+    if (m_ApplyCurvePtrA) {
+      icApplyCurvesN(m_ApplyCurvePtrA, nOutput, Pixels, nPixels);
+    }
+  }
+  else {
     if (m_ApplyCurvePtrM) {
-      for (i = 0; i < m_pTag->m_nOutput; i++) {
-        Pixel[i] = m_ApplyCurvePtrM[i]->Apply(Pixel[i]);
-      }
+      icApplyCurvesN(m_ApplyCurvePtrM, nOutput, Pixels, nPixels);
     }
 
     if (m_ApplyMatrixPtr) {
-      m_ApplyMatrixPtr->Apply(Pixel);
+      for (k = 0; k < nPixels; k++)
+        m_ApplyMatrixPtr->Apply(Pixels + k * nOutput);
     }
 
     if (m_ApplyCurvePtrB) {
-      for (i = 0; i < m_pTag->m_nOutput; i++) {
-        Pixel[i] = m_ApplyCurvePtrB[i]->Apply(Pixel[i]);
-      }
+      icApplyCurvesN(m_ApplyCurvePtrB, nOutput, Pixels, nPixels);
     }
   }
-
-  for (i = 0; i < m_pTag->m_nOutput; i++) {
-    DstPixel[i] = Pixel[i];
-  }
-
-  CheckDstAbs(DstPixel);
 }
 
 /**
@@ -2361,37 +3174,132 @@ void CIccXform4DLut::Apply(CIccApplyXform* pApply, icFloatNumber* DstPixel, cons
   Pixel[2] = SrcPixel[2];
   Pixel[3] = SrcPixel[3];
 
-  if (m_pTag->m_bInputMatrix) {
-    if (m_ApplyCurvePtrB) {
-      Pixel[0] = m_ApplyCurvePtrB[0]->Apply(Pixel[0]);
-      Pixel[1] = m_ApplyCurvePtrB[1]->Apply(Pixel[1]);
-      Pixel[2] = m_ApplyCurvePtrB[2]->Apply(Pixel[2]);
-      Pixel[3] = m_ApplyCurvePtrB[3]->Apply(Pixel[3]);
+  ApplyInputStages(Pixel);
+
+  if (m_pTag->m_CLUT) {
+    m_pTag->m_CLUT->Interp4d(Pixel, Pixel);
+  }
+
+  ApplyOutputStages(Pixel);
+
+  for (i = 0; i < m_pTag->m_nOutput; i++) {
+    DstPixel[i] = Pixel[i];
+  }
+
+  CheckDstAbs(DstPixel);
+}
+
+/**
+ **************************************************************************
+  * Name: CIccXform4DLut::Apply
+  *
+  * Purpose:
+  *  Applies the Xform to a run of packed pixels.  Each curve set and matrix
+  *  is applied to a block of pixels at a time, the CLUT interpolates the
+  *  block a pixel at a time.
+  *
+  * Args:
+  *  pApply = ApplyXform object containging temporary storage used during Apply
+  *  DstPixel = nPixels destination pixels of the tag's output channels,
+  *  SrcPixel = nPixels source pixels of 4 channels,
+  *  nPixels = number of pixels to apply
+  **************************************************************************
+  */
+void CIccXform4DLut::Apply(CIccApplyXform* pApply, icFloatNumber* DstPixel, const icFloatNumber* SrcPixel, icUInt32Number nPixels) const
+{
+  const icUInt32Number nBlockSize = 64;
+  icFloatNumber In[nBlockSize * 4], Out[nBlockSize * 16];
+  icUInt8Number nOutput = m_pTag->m_nOutput;
+  icFloatNumber* Pixels;
+  icUInt32Number n, k;
+  int i;
+
+  if (!m_pTag->m_CLUT && nOutput != 4) {
+    for (; nPixels; nPixels--, SrcPixel += 4, DstPixel += nOutput)
+      Apply(pApply, DstPixel, SrcPixel);
+    return;
+  }
+
+  while (nPixels) {
+    n = nPixels < nBlockSize ? nPixels : nBlockSize;
+
+    for (k = 0; k < n; k++) {
+      const icFloatNumber* pSrc = CheckSrcAbs(pApply, SrcPixel + k * 4);
+
+      In[k * 4] = pSrc[0];
+      In[k * 4 + 1] = pSrc[1];
+      In[k * 4 + 2] = pSrc[2];
+      In[k * 4 + 3] = pSrc[3];
     }
 
+    ApplyInputStages(In, n);
+
     if (m_pTag->m_CLUT) {
-      m_pTag->m_CLUT->Interp4d(Pixel, Pixel);
+      for (k = 0; k < n; k++)
+        m_pTag->m_CLUT->Interp4d(Out + k * nOutput, In + k * 4);
+      Pixels = Out;
+    }
+    else
+      Pixels = In;
+
+    ApplyOutputStages(Pixels, n);
+
+    for (k = 0; k < n; k++) {
+      icFloatNumber* Pixel = &Pixels[k * nOutput];
+
+      for (i = 0; i < nOutput; i++) {
+        DstPixel[i] = Pixel[i];
+      }
+
+      CheckDstAbs(DstPixel);
+      DstPixel += nOutput;
     }
 
+    SrcPixel += n * 4;
+    nPixels -= n;
+  }
+}
+
+/**
+ **************************************************************************
+  * Name: CIccXform4DLut::ApplyInputStages
+  *
+  * Purpose:
+  *  Applies the curves that precede the CLUT to a pixel in place.
+  **************************************************************************
+  */
+void CIccXform4DLut::ApplyInputStages(icFloatNumber* Pixel) const
+{
+  const LPIccCurve* pCurves = m_pTag->m_bInputMatrix ? m_ApplyCurvePtrB : m_ApplyCurvePtrA;
+
+  if (pCurves) {
+    Pixel[0] = pCurves[0]->Apply(Pixel[0]);
+    Pixel[1] = pCurves[1]->Apply(Pixel[1]);
+    Pixel[2] = pCurves[2]->Apply(Pixel[2]);
+    Pixel[3] = pCurves[3]->Apply(Pixel[3]);
+  }
+}
+
+/**
+ **************************************************************************
+  * Name: CIccXform4DLut::ApplyOutputStages
+  *
+  * Purpose:
+  *  Applies the curves and matrix that follow the CLUT to a pixel in place.
+  **************************************************************************
+  */
+void CIccXform4DLut::ApplyOutputStages(icFloatNumber* Pixel) const
+{
+  int i;
+
+  if (m_pTag->m_bInputMatrix) {
     if (m_ApplyCurvePtrA) {
       for (i = 0; i < m_pTag->m_nOutput; i++) {
         Pixel[i] = m_ApplyCurvePtrA[i]->Apply(Pixel[i]);
       }
     }
-
   }
   else {
-    if (m_ApplyCurvePtrA) {
-      Pixel[0] = m_ApplyCurvePtrA[0]->Apply(Pixel[0]);
-      Pixel[1] = m_ApplyCurvePtrA[1]->Apply(Pixel[1]);
-      Pixel[2] = m_ApplyCurvePtrA[2]->Apply(Pixel[2]);
-      Pixel[3] = m_ApplyCurvePtrA[3]->Apply(Pixel[3]);
-    }
-
-    if (m_pTag->m_CLUT) {
-      m_pTag->m_CLUT->Interp4d(Pixel, Pixel);
-    }
-
     if (m_ApplyCurvePtrM) {
       for (i = 0; i < m_pTag->m_nOutput; i++) {
         Pixel[i] = m_ApplyCurvePtrM[i]->Apply(Pixel[i]);
@@ -2408,12 +3316,59 @@ void CIccXform4DLut::Apply(CIccApplyXform* pApply, icFloatNumber* DstPixel, cons
       }
     }
   }
+}
 
-  for (i = 0; i < m_pTag->m_nOutput; i++) {
-    DstPixel[i] = Pixel[i];
+/**
+ **************************************************************************
+  * Name: CIccXform4DLut::ApplyInputStages
+  *
+  * Purpose:
+  *  Applies the curves that precede the CLUT in place to nPixels packed
+  *  pixels of 4 channels, one curve at a time.
+  **************************************************************************
+  */
+void CIccXform4DLut::ApplyInputStages(icFloatNumber* Pixels, icUInt32Number nPixels) const
+{
+  const LPIccCurve* pCurves = m_pTag->m_bInputMatrix ? m_ApplyCurvePtrB : m_ApplyCurvePtrA;
+
+  if (pCurves) {
+    icApplyCurvesN(pCurves, 4, Pixels, nPixels);
   }
+}
 
-  CheckDstAbs(DstPixel);
+/**
+ **************************************************************************
+  * Name: CIccXform4DLut::ApplyOutputStages
+  *
+  * Purpose:
+  *  Applies the curves and matrix that follow the CLUT in place to nPixels
+  *  packed pixels of the tag's output channels, one stage at a time.
+  **************************************************************************
+  */
+void CIccXform4DLut::ApplyOutputStages(icFloatNumber* Pixels, icUInt32Number nPixels) const
+{
+  int nOutput = m_pTag->m_nOutput;
+  icUInt32Number k;
+
+  if (m_pTag->m_bInputMatrix) {
+    if (m_ApplyCurvePtrA) {
+      icApplyCurvesN(m_ApplyCurvePtrA, nOutput, Pixels, nPixels);
+    }
+  }
+  else {
+    if (m_ApplyCurvePtrM) {
+      icApplyCurvesN(m_ApplyCurvePtrM, nOutput, Pixels, nPixels);
+    }
+
+    if (m_ApplyMatrixPtr) {
+      for (k = 0; k < nPixels; k++)
+        m_ApplyMatrixPtr->Apply(Pixels + k * nOutput);
+    }
+
+    if (m_ApplyCurvePtrB) {
+      icApplyCurvesN(m_ApplyCurvePtrB, nOutput, Pixels, nPixels);
+    }
+  }
 }
 
 /**
@@ -3459,6 +4414,110 @@ void CIccXformMpe::Apply(CIccApplyXform* pApply, icFloatNumber* DstPixel, const
   }
 }
 
+
+/**
+**************************************************************************
+* Name: CIccXformMPE::Apply
+*
+* Purpose:
+*  Applies the Xform to a run of packed pixels.  The tag is applied to
+*  blocks of pixels and PCS encoding is converted for the whole run or
+*  block at once.
+*
+* Args:
+*  pApply = ApplyXform object containging temporary storage used during Apply
+*  DstPixel = nPixels destination pixels of the tag's output channels,
+*  SrcPixel = nPixels source pixels of the tag's input channels (may be
+*   DstPixel if there are no more output than input channels),
+*  nPixels = number of pixels to apply
+**************************************************************************
+*/
+void CIccXformMpe::Apply(CIccApplyXform* pApply, icFloatNumber* DstPixel, const icFloatNumber* SrcPixel, icUInt32Number nPixels) const
+{
+  const CIccTagMultiProcessElement* pTag = m_pTag;
+  CIccApplyXformMpe* pApplyMpe = (CIccApplyXformMpe*)pApply;
+  icColorSpaceSignature nSpace;
+  icUInt32Number n, k;
+
+  if (!m_bInput) { //PCS comming in?
+    nSpace = GetSrcSpace();
+
+    if (nSpace != icSigXYZData && nSpace != icSigLabData) {
+      if (m_bAdjustPCS && m_nIntent != icAbsoluteColorimetric) {
+        CIccXform::Apply(pApply, DstPixel, SrcPixel, nPixels);
+        return;
+      }
+
+      pTag->Apply(pApplyMpe->m_pApply, DstPixel, SrcPixel, nPixels);
+      return;
+    }
+
+    if (pTag->NumInputChannels() != 3) {
+      CIccXform::Apply(pApply, DstPixel, SrcPixel, nPixels);
+      return;
+    }
+
+    //PCS values are converted to "real" values in a block buffer
+    icFloatNumber Pixels[icMpeBlockPixels * 3];
+    icUInt16Number nOutput = pTag->NumOutputChannels();
+
+    while (nPixels) {
+      n = nPixels < icMpeBlockPixels ? nPixels : icMpeBlockPixels;
+
+      for (k = 0; k < n; k++) {
+        const icFloatNumber* pSrc = SrcPixel + k * 3;
+
+        if (m_nIntent != icAbsoluteColorimetric)  //B2D3 tags don't need abs conversion
+          pSrc = CheckSrcAbs(pApply, pSrc);
+
+        Pixels[k * 3] = pSrc[0];
+        Pixels[k * 3 + 1] = pSrc[1];
+        Pixels[k * 3 + 2] = pSrc[2];
+      }
+
+      if (nSpace == icSigXYZData)
+        icXyzFromPcsN(Pixels, n);
+      else
+        icLabFromPcsN(Pixels, n);
+
+      pTag->Apply(pApplyMpe->m_pApply, DstPixel, Pixels, n);
+
+      SrcPixel += n * 3;
+      DstPixel += n * nOutput;
+      nPixels -= n;
+    }
+    return;
+  }
+
+  //PCS going out?
+  nSpace = GetDstSpace();
+
+  if (nSpace != icSigXYZData && nSpace != icSigLabData) {
+    if (m_bAdjustPCS && m_nIntent != icAbsoluteColorimetric)
+      CIccXform::Apply(pApply, DstPixel, SrcPixel, nPixels);
+    else
+      pTag->Apply(pApplyMpe->m_pApply, DstPixel, SrcPixel, nPixels);
+    return;
+  }
+
+  if (pTag->NumOutputChannels() != 3) {
+    CIccXform::Apply(pApply, DstPixel, SrcPixel, nPixels);
+    return;
+  }
+
+  pTag->Apply(pApplyMpe->m_pApply, DstPixel, SrcPixel, nPixels);
+
+  if (nSpace == icSigXYZData)
+    icXyzToPcsN(DstPixel, nPixels);
+  else
+    icLabToPcsN(DstPixel, nPixels);
+
+  if (m_nIntent != icAbsoluteColorimetric) { //D2B3 tags don't need abs conversion
+    for (k = 0; k < nPixels; k++)
+      CheckDstAbs(DstPixel + k * 3);
+  }
+}
+
 /**
 **************************************************************************
 * Name: CIccApplyXformMpe::CIccApplyXformMpe
@@ -3499,6 +4558,9 @@ CIccApplyCmm::CIccApplyCmm(CIccCmm* pCmm)
 {
   m_pCmm = pCmm;
   m_pPCS = m_pCmm->GetPCS();
+  m_PCSSteps = NULL;
+  m_BlockBuf = NULL;
+  m_nBlockSamples = 0;
 
   m_Xforms = new CIccApplyXformList;
   m_Xforms->clear();
@@ -3527,8 +4589,100 @@ CIccApplyCmm::~CIccApplyCmm()
 
   if (m_pPCS)
     delete m_pPCS;
+
+  if (m_PCSSteps)
+    delete [] m_PCSSteps;
+
+  if (m_BlockBuf)
+    free(m_BlockBuf);
+}
+
+/**
+**************************************************************************
+* Name: CIccApplyCmm::Plan
+*
+* Purpose:
+*  Decides the PCS adjustments before each xform and after the last one.
+*  They only depend on the xforms so Apply() just runs them.  Also allocates
+*  the scratch pixels used to pass blocks of pixels from xform to xform if
+*  the pixel sizes of neighbouring xforms agree.
+**************************************************************************
+*/
+void CIccApplyCmm::Plan()
+{
+  CIccApplyXformList::iterator i;
+  int j;
+
+  if (m_PCSSteps)
+    delete [] m_PCSSteps;
+
+  m_PCSSteps = new CIccPCSStep[m_Xforms->size() + 1];
+
+  m_pPCS->Reset(m_pCmm->m_nSrcSpace);
+
+  for (j = 0, i = m_Xforms->begin(); i != m_Xforms->end(); i++, j++)
+    m_PCSSteps[j] = m_pPCS->Step(i->ptr->GetXform());
+
+  m_PCSSteps[j] = m_pPCS->LastStep(m_pCmm->m_nDestSpace, j ? m_Xforms->back().ptr->GetXform()->NoClipPCS() : true);
+
+  if (m_BlockBuf) {
+    free(m_BlockBuf);
+    m_BlockBuf = NULL;
+  }
+  m_nBlockSamples = 0;
+
+  icUInt32Number nSamples = m_pCmm->GetSourceSamples(), nMaxSamples = 3;
+
+  for (j = 0, i = m_Xforms->begin(); i != m_Xforms->end(); i++, j++) {
+    const CIccXform *pXform = i->ptr->GetXform();
+    icUInt32Number nSrcSamples = pXform->GetNumSrcSamples();
+    icUInt32Number nDstSamples = pXform->GetNumDstSamples();
+
+    //PCS adjustments work on the first 3 samples and pass on 3
+    if (m_PCSSteps[j].ConvertN ? (nSamples < 3 || nSrcSamples != 3) : nSrcSamples != nSamples)
+      return;
+
+    if (!nDstSamples || nDstSamples > 16)
+      return;
+
+    if (nDstSamples > nMaxSamples)
+      nMaxSamples = nDstSamples;
+
+    nSamples = nDstSamples;
+  }
+
+  if (nSamples != m_pCmm->GetDestSamples() || (m_PCSSteps[j].ConvertN && nSamples < 3))
+    return;
+
+  //two buffers to pass pixels between xforms and one for PCS adjustments
+  m_BlockBuf = (icFloatNumber*)malloc((2 * nMaxSamples + 3) * icCmmBlockPixels * sizeof(icFloatNumber));
+  if (m_BlockBuf)
+    m_nBlockSamples = nMaxSamples;
 }
 
+/**
+ **************************************************************************
+  * Name: icPackPcs
+  *
+  * Purpose:
+  *  Copies the first 3 samples of pixels to a packed buffer unless they
+  *  are packed already.
+  **************************************************************************
+  */
+static const icFloatNumber* icPackPcs(icFloatNumber* pPacked, const icFloatNumber* Pixels, icUInt32Number nSamples,
+                                      icUInt32Number nPixels)
+{
+  if (nSamples == 3)
+    return Pixels;
+
+  for (icUInt32Number k = 0; k < nPixels; k++, Pixels += nSamples) {
+    pPacked[3 * k] = Pixels[0];
+    pPacked[3 * k + 1] = Pixels[1];
+    pPacked[3 * k + 2] = Pixels[2];
+  }
+
+  return pPacked;
+}
 
 /**
 **************************************************************************
@@ -3544,44 +4698,41 @@ CIccApplyCmm::~CIccApplyCmm()
 */
 icStatusCMM CIccApplyCmm::Apply(icFloatNumber* DstPixel, const icFloatNumber* SrcPixel)
 {
-  icFloatNumber Pixel[16], * pDst;
+  icFloatNumber Pixel[16], Convert[3];
   const icFloatNumber* pSrc;
-  CIccApplyXformList::iterator i;
-  const CIccXform* pLastXform;
-  int j, n = (int)m_Xforms->size();
-  bool bNoClip;
+  const CIccPCSStep* pStep;
+  CIccApplyXformList::iterator i, last;
 
-  if (!n)
+  if (m_Xforms->empty())
     return icCmmStatBadXform;
 
-  m_pPCS->Reset(m_pCmm->m_nSrcSpace);
+  if (!m_PCSSteps)
+    Plan();
 
   pSrc = SrcPixel;
-  pDst = Pixel;
-
-  if (n > 1) {
-    for (j = 0, i = m_Xforms->begin(); j < n - 1 && i != m_Xforms->end(); i++, j++) {
+  pStep = m_PCSSteps;
+  last = --m_Xforms->end();
 
-      i->ptr->Apply(pDst, m_pPCS->Check(pSrc, i->ptr->GetXform()));
-      pSrc = pDst;
+  for (i = m_Xforms->begin(); i != last; i++, pStep++) {
+    if (pStep->Convert) {
+      pStep->Convert(Convert, pSrc, pStep->bNoClip);
+      pSrc = Convert;
     }
 
-    pLastXform = i->ptr->GetXform();
-    i->ptr->Apply(DstPixel, m_pPCS->Check(pSrc, pLastXform));
-    bNoClip = pLastXform->NoClipPCS();
+    i->ptr->Apply(Pixel, pSrc);
+    pSrc = Pixel;
   }
-  else if (n == 1) {
-    i = m_Xforms->begin();
 
-    pLastXform = i->ptr->GetXform();
-    i->ptr->Apply(DstPixel, m_pPCS->Check(SrcPixel, pLastXform));
-    bNoClip = pLastXform->NoClipPCS();
-  }
-  else {
-    bNoClip = true;
+  if (pStep->Convert) {
+    pStep->Convert(Convert, pSrc, pStep->bNoClip);
+    pSrc = Convert;
   }
 
-  m_pPCS->CheckLast(DstPixel, m_pCmm->m_nDestSpace, bNoClip);
+  i->ptr->Apply(DstPixel, pSrc);
+  pStep++;
+
+  if (pStep->Convert)
+    pStep->Convert(DstPixel, DstPixel, pStep->bNoClip);
 
   return icCmmStatOk;
 }
@@ -3591,48 +4742,85 @@ icStatusCMM CIccApplyCmm::Apply(icFloatNumber* DstPixel, const icFloatNumber* Sr
 * Name: CIccApplyCmm::Apply
 *
 * Purpose:
-*  Does the actual application of the Xforms in the list.
+*  Does the actual application of the Xforms in the list to nPixels pixels.
+*  Blocks of icCmmBlockPixels pixels go through the xforms one xform at a
+*  time with the batch Apply of each xform, PCS adjustments between them are
+*  done for the whole block with the batch conversions.
 *
 * Args:
-*  DstPixel = Destination pixel where the result is stored,
-*  SrcPixel = Source pixel which is to be applied.
+*  DstPixel = Destination pixels where the result is stored,
+*  SrcPixel = Source pixels which are to be applied,
+*  nPixels = number of pixels.
 **************************************************************************
 */
 icStatusCMM CIccApplyCmm::Apply(icFloatNumber* DstPixel, const icFloatNumber* SrcPixel, icUInt32Number nPixels)
 {
-  icFloatNumber Pixel[16], * pDst;
+  icFloatNumber* Pixels[2], * Convert, * pDst;
   const icFloatNumber* pSrc;
-  CIccApplyXformList::iterator i;
-  int j, n = (int)m_Xforms->size();
-  icUInt32Number k;
+  const CIccPCSStep* pStep;
+  CIccApplyXformList::iterator i, last;
+  const icUInt32Number nSrcSamples = m_pCmm->GetSourceSamples(), nDstSamples = m_pCmm->GetDestSamples();
+  icUInt32Number nSrcStride, n, k;
+  int j;
 
-  if (!n)
+  if (m_Xforms->empty())
     return icCmmStatBadXform;
 
-  for (k = 0; k < nPixels; k++) {
-    m_pPCS->Reset(m_pCmm->m_nSrcSpace);
+  if (!m_PCSSteps)
+    Plan();
 
-    pSrc = SrcPixel;
-    pDst = Pixel;
+  if (!m_BlockBuf) {
+    for (; nPixels; nPixels--, SrcPixel += nSrcSamples, DstPixel += nDstSamples)
+      Apply(DstPixel, SrcPixel);
 
-    if (n > 1) {
-      for (j = 0, i = m_Xforms->begin(); j < n - 1 && i != m_Xforms->end(); i++, j++) {
+    return icCmmStatOk;
+  }
 
-        i->ptr->Apply(pDst, m_pPCS->Check(pSrc, i->ptr->GetXform()));
-        pSrc = pDst;
+  Pixels[0] = m_BlockBuf;
+  Pixels[1] = Pixels[0] + m_nBlockSamples * icCmmBlockPixels;
+  Convert = Pixels[1] + m_nBlockSamples * icCmmBlockPixels;
+  last = --m_Xforms->end();
+
+  while (nPixels) {
+    n = nPixels < icCmmBlockPixels ? nPixels : icCmmBlockPixels;
+
+    pSrc = SrcPixel;
+    nSrcStride = nSrcSamples;
+    pStep = m_PCSSteps;
+
+    for (j = 0, i = m_Xforms->begin(); ; i++, j++, pStep++) {
+      if (pStep->ConvertN) {
+        pStep->ConvertN(Convert, icPackPcs(Convert, pSrc, nSrcStride, n), n, pStep->bNoClip);
+        pSrc = Convert;
       }
 
-      i->ptr->Apply(DstPixel, m_pPCS->Check(pSrc, i->ptr->GetXform()));
-    }
-    else if (n == 1) {
-      i = m_Xforms->begin();
-      i->ptr->Apply(DstPixel, m_pPCS->Check(SrcPixel, i->ptr->GetXform()));
+      pDst = i == last ? DstPixel : Pixels[j & 1];
+      i->ptr->Apply(pDst, pSrc, n);
+
+      if (i == last)
+        break;
+
+      pSrc = pDst;
+      nSrcStride = i->ptr->GetXform()->GetNumDstSamples();
     }
+    pStep++;
 
-    m_pPCS->CheckLast(DstPixel, m_pCmm->m_nDestSpace);
+    if (pStep->ConvertN) {
+      if (nDstSamples == 3)
+        pStep->ConvertN(DstPixel, DstPixel, n, pStep->bNoClip);
+      else {
+        pStep->ConvertN(Convert, icPackPcs(Convert, DstPixel, nDstSamples, n), n, pStep->bNoClip);
+        for (k = 0; k < n; k++) {
+          DstPixel[k * nDstSamples] = Convert[3 * k];
+          DstPixel[k * nDstSamples + 1] = Convert[3 * k + 1];
+          DstPixel[k * nDstSamples + 2] = Convert[3 * k + 2];
+        }
+      }
+    }
 
-    DstPixel += m_pCmm->GetDestSamples();
-    SrcPixel += m_pCmm->GetSourceSamples();
+    DstPixel += n * nDstSamples;
+    SrcPixel += n * nSrcSamples;
+    nPixels -= n;
   }
 
   return icCmmStatOk;
@@ -3644,6 +4832,18 @@ void CIccApplyCmm::AppendApplyXform(CIccApplyXform* pApplyXform)
   ptr.ptr = pApplyXform;
 
   m_Xforms->push_back(ptr);
+
+  //planned again for the new list
+  if (m_PCSSteps) {
+    delete [] m_PCSSteps;
+    m_PCSSteps = NULL;
+  }
+
+  if (m_BlockBuf) {
+    free(m_BlockBuf);
+    m_BlockBuf = NULL;
+    m_nBlockSamples = 0;
+  }
 }
 
 /**
@@ -4031,6 +5231,8 @@ CIccApplyCmm* CIccCmm::GetNewApplyCmm(icStatusCMM& status)
     pApply->AppendApplyXform(pXform);
   }
 
+  pApply->Plan();
+
   m_bValid = true;
 
   status = icCmmStatOk;
@@ -4820,6 +6022,44 @@ icColorSpaceSignature CIccCmm::GetFirstXformSource()
   return m_Xforms->begin()->ptr->GetSrcSpace();
 }
 
+/**
+**************************************************************************
+* Name: CIccCmm::GetFirstXform
+*
+* Purpose:
+*  Get the first transform of the xform list, e.g. to check its type
+*
+* Return:
+* first transform or NULL if the list is empty
+**************************************************************************
+*/
+const CIccXform *CIccCmm::GetFirstXform() const
+{
+  if (!m_Xforms->size())
+    return NULL;
+
+  return m_Xforms->begin()->ptr;
+}
+
+/**
+**************************************************************************
+* Name: CIccCmm::GetLastXform
+*
+* Purpose:
+*  Get the last transform of the xform list, e.g. to check its type
+*
+* Return:
+* last transform or NULL if the list is empty
+**************************************************************************
+*/
+const CIccXform *CIccCmm::GetLastXform() const
+{
+  if (!m_Xforms->size())
+    return NULL;
+
+  return m_Xforms->rbegin()->ptr;
+}
+
 /**
 **************************************************************************
 * Name: CIccCmm::GetNumXforms
@@ -6154,6 +7394,385 @@ icStatusCMM CIccApplyMruCmm::Apply(icFloatNumber* DstPixel, const icFloatNumber*
   return icCmmStatOk;
 }
 
+
+/**
+****************************************************************************
+* Name: CIccHashCmm::CIccHashCmm
+*
+* Purpose: private constructor - Use Attach to create CIccHashCmm objects
+*****************************************************************************
+*/
+CIccHashCmm::CIccHashCmm()
+{
+  m_pCmm = NULL;
+}
+
+
+/**
+****************************************************************************
+* Name: CIccHashCmm::~CIccHashCmm
+*
+* Purpose: destructor
+*****************************************************************************
+*/
+CIccHashCmm::~CIccHashCmm()
+{
+  if (m_pCmm)
+    delete m_pCmm;
+}
+
+
+/**
+****************************************************************************
+* Name: CIccHashCmm::Attach
+*
+* Purpose: Create a Cmm decorator object that caches pixel transformations
+*  in a hash table.
+*
+* Args:
+*  pCmm - pointer to cmm object that we are attaching to.
+*  nKeyBits - bits per source sample of cache keys (8 to 16)
+*  nCacheMB - size of the cache of each apply object in megabytes
+*
+* Return:
+*  A CIccHashCmm object that represents a cached form of the pCmm passed in.
+*  The pCmm will be owned by the returned object.
+*
+*  If this function fails the pCmm object will be deleted.
+*****************************************************************************
+*/
+CIccHashCmm* CIccHashCmm::Attach(CIccCmm* pCmm, icUInt8Number nKeyBits/*=16*/, icUInt32Number nCacheMB/*=4*/)
+{
+  if (!pCmm)
+    return NULL;
+
+  if (!pCmm->Valid() || nKeyBits < 8 || nKeyBits > 16 || !nCacheMB) {
+    delete pCmm;
+    return NULL;
+  }
+
+  CIccHashCmm* rv = new CIccHashCmm();
+
+  rv->m_pCmm = pCmm;
+  rv->m_nKeyBits = nKeyBits;
+  rv->m_nCacheMB = nCacheMB;
+
+  rv->m_nSrcSpace = pCmm->GetSourceSpace();
+  rv->m_nDestSpace = pCmm->GetDestSpace();
+  rv->m_nLastSpace = pCmm->GetLastSpace();
+  rv->m_nLastIntent = pCmm->GetLastIntent();
+
+  if (rv->Begin() != icCmmStatOk) {
+    delete rv;
+    return NULL;
+  }
+
+  return rv;
+}
+
+CIccApplyCmm* CIccHashCmm::GetNewApplyCmm(icStatusCMM& status)
+{
+  CIccApplyHashCmm* rv = new CIccApplyHashCmm(this);
+
+  if (!rv) {
+    status = icCmmStatAllocErr;
+    return NULL;
+  }
+
+  if (!rv->Init(m_pCmm, m_nKeyBits, m_nCacheMB)) {
+    delete rv;
+    status = icCmmStatAllocErr;
+    return NULL;
+  }
+
+  status = icCmmStatOk;
+  return rv;
+}
+
+
+CIccApplyHashCmm::CIccApplyHashCmm(CIccHashCmm* pCmm) : CIccApplyCmm(pCmm)
+{
+  m_pCachedApply = NULL;
+
+  m_nEntries = 0;
+  m_pKeys = NULL;
+  m_pValues = NULL;
+  m_pUsed = NULL;
+
+  m_nNumMiss = 0;
+  m_pMissIndex = NULL;
+  m_pMissHash = NULL;
+  m_pMissCached = NULL;
+  m_pMissKeys = NULL;
+  m_pMissSrc = NULL;
+  m_pMissDst = NULL;
+
+  m_nHits = 0;
+  m_nMisses = 0;
+}
+
+/**
+****************************************************************************
+* Name: CIccApplyHashCmm::~CIccApplyHashCmm
+*
+* Purpose: destructor
+*****************************************************************************
+*/
+CIccApplyHashCmm::~CIccApplyHashCmm()
+{
+  if (m_pCachedApply)
+    delete m_pCachedApply;
+
+  if (m_pKeys)
+    free(m_pKeys);
+  if (m_pValues)
+    free(m_pValues);
+  if (m_pUsed)
+    free(m_pUsed);
+
+  if (m_pMissIndex)
+    free(m_pMissIndex);
+  if (m_pMissHash)
+    free(m_pMissHash);
+  if (m_pMissCached)
+    free(m_pMissCached);
+  if (m_pMissKeys)
+    free(m_pMissKeys);
+  if (m_pMissSrc)
+    free(m_pMissSrc);
+  if (m_pMissDst)
+    free(m_pMissDst);
+}
+
+/**
+****************************************************************************
+* Name: CIccApplyHashCmm::Init
+*
+* Purpose: Initialize the object and set up the cache.  The number of
+*  entries is the largest power of 2 that fits in nCacheMB megabytes.
+*
+* Args:
+*  pCachedCmm - pointer to cmm object that we are attaching to.
+*  nKeyBits - bits per source sample of cache keys
+*  nCacheMB - size of the cache in megabytes
+*
+* Return:
+*  true if successful
+*****************************************************************************
+*/
+bool CIccApplyHashCmm::Init(CIccCmm* pCachedCmm, icUInt8Number nKeyBits, icUInt32Number nCacheMB)
+{
+  icStatusCMM stat = icCmmStatOk;
+
+  m_pCachedApply = pCachedCmm->GetNewApplyCmm(stat);
+
+  if (!m_pCachedApply || stat != icCmmStatOk)
+    return false;
+
+  m_nSrcSamples = m_pCmm->GetSourceSamples();
+  m_nDstSamples = m_pCmm->GetDestSamples();
+
+  if (!m_nSrcSamples || m_nSrcSamples > icHashCmmMaxSamples || !m_nDstSamples)
+    return false;
+
+  m_fKeyMax = (icFloatNumber)((1 << nKeyBits) - 1);
+
+  size_t nEntrySize = m_nSrcSamples * sizeof(icUInt16Number) + m_nDstSamples * sizeof(icFloatNumber) + sizeof(icUInt8Number);
+  size_t nBytes = (size_t)nCacheMB << 20;
+
+  for (m_nEntries = 256; m_nEntries < 0x80000000 && 2 * (size_t)m_nEntries * nEntrySize <= nBytes; m_nEntries *= 2);
+
+  m_pKeys = (icUInt16Number*)malloc((size_t)m_nEntries * m_nSrcSamples * sizeof(icUInt16Number));
+  m_pValues = (icFloatNumber*)malloc((size_t)m_nEntries * m_nDstSamples * sizeof(icFloatNumber));
+  m_pUsed = (icUInt8Number*)calloc(m_nEntries, sizeof(icUInt8Number));
+
+  m_pMissIndex = (icUInt32Number*)malloc(icCmmBlockPixels * sizeof(icUInt32Number));
+  m_pMissHash = (icUInt32Number*)malloc(icCmmBlockPixels * sizeof(icUInt32Number));
+  m_pMissCached = (bool*)malloc(icCmmBlockPixels * sizeof(bool));
+  m_pMissKeys = (icUInt16Number*)malloc(icCmmBlockPixels * m_nSrcSamples * sizeof(icUInt16Number));
+  m_pMissSrc = (icFloatNumber*)malloc(icCmmBlockPixels * m_nSrcSamples * sizeof(icFloatNumber));
+  m_pMissDst = (icFloatNumber*)malloc(icCmmBlockPixels * m_nDstSamples * sizeof(icFloatNumber));
+
+  if (!m_pKeys || !m_pValues || !m_pUsed || !m_pMissIndex || !m_pMissHash || !m_pMissCached ||
+      !m_pMissKeys || !m_pMissSrc || !m_pMissDst)
+    return false;
+
+  return true;
+}
+
+/**
+****************************************************************************
+* Name: CIccApplyHashCmm::ClearCache
+*
+* Purpose: Removes all cached results
+*****************************************************************************
+*/
+void CIccApplyHashCmm::ClearCache()
+{
+  memset(m_pUsed, 0, m_nEntries * sizeof(icUInt8Number));
+}
+
+/**
+****************************************************************************
+* Name: CIccApplyHashCmm::Apply
+*
+* Purpose: Apply a transformation to a pixel.
+*
+* Args:
+*  DstPixel - Location to store pixel results
+*  SrcPixel - Location to get pixel values from
+*
+* Return:
+*  icCmmStatOk if successful
+*****************************************************************************
+*/
+icStatusCMM CIccApplyHashCmm::Apply(icFloatNumber* DstPixel, const icFloatNumber* SrcPixel)
+{
+  return Apply(DstPixel, SrcPixel, 1);
+}
+
+/**
+****************************************************************************
+* Name: CIccApplyHashCmm::Apply
+*
+* Purpose: Apply a transformation to a run of pixels.  Pixels found in the
+*  cache are copied right away, the others are collected and applied a
+*  block at a time through the cached CMM before they are added to the
+*  cache.
+*
+* Args:
+*  DstPixel - Location to store pixel results
+*  SrcPixel - Location to get pixel values from
+*  nPixels - number of pixels to convert
+*
+* Return:
+*  icCmmStatOk if successful
+*****************************************************************************
+*/
+icStatusCMM CIccApplyHashCmm::Apply(icFloatNumber* DstPixel, const icFloatNumber* SrcPixel, icUInt32Number nPixels)
+{
+  icUInt16Number Key[icHashCmmMaxSamples];
+  icUInt32Number k, j, h, p, nSlot, nMask = m_nEntries - 1;
+  icUInt32Number nSrc = m_nSrcSamples, nDst = m_nDstSamples;
+  icUInt32Number nKeySize = nSrc * sizeof(icUInt16Number);
+  bool bCached;
+
+  for (k = 0; k < nPixels; k++, SrcPixel += nSrc) {
+    //FNV-1a hash of the quantized samples
+    h = 2166136261U;
+    bCached = true;
+
+    for (j = 0; j < nSrc; j++) {
+      icFloatNumber v = SrcPixel[j];
+
+      if (!(v >= 0 && v <= 1.0)) {
+        bCached = false;
+        break;
+      }
+      Key[j] = (icUInt16Number)(v * m_fKeyMax + 0.5f);
+      h = (h ^ Key[j]) * 16777619U;
+    }
+
+    if (bCached) {
+      //spread the few bits of short keys over the whole hash
+      h ^= h >> 16;
+      h *= 0x85ebca6bU;
+      h ^= h >> 13;
+      h *= 0xc2b2ae35U;
+      h ^= h >> 16;
+
+      for (p = 0; p < icHashCmmMaxProbe; p++) {
+        nSlot = (h + p) & nMask;
+
+        if (!m_pUsed[nSlot])
+          break;
+
+        if (!memcmp(&m_pKeys[nSlot * nSrc], Key, nKeySize)) {
+          memcpy(DstPixel + k * nDst, &m_pValues[nSlot * nDst], nDst * sizeof(icFloatNumber));
+          m_nHits++;
+          break;
+        }
+      }
+
+      if (p < icHashCmmMaxProbe && m_pUsed[nSlot])
+        continue;
+    }
+
+    //Miss: source pixels are quantized so cached results don't depend on the first pixel of a key
+    icFloatNumber* pMissSrc = &m_pMissSrc[m_nNumMiss * nSrc];
+
+    m_pMissIndex[m_nNumMiss] = k;
+    m_pMissHash[m_nNumMiss] = h;
+    m_pMissCached[m_nNumMiss] = bCached;
+
+    if (bCached) {
+      memcpy(&m_pMissKeys[m_nNumMiss * nSrc], Key, nKeySize);
+      for (j = 0; j < nSrc; j++)
+        pMissSrc[j] = Key[j] / m_fKeyMax;
+    }
+    else {
+      memcpy(pMissSrc, SrcPixel, nSrc * sizeof(icFloatNumber));
+    }
+
+    if (++m_nNumMiss == icCmmBlockPixels)
+      ApplyMisses(DstPixel);
+  }
+
+  if (m_nNumMiss)
+    ApplyMisses(DstPixel);
+
+  return icCmmStatOk;
+}
+
+/**
+****************************************************************************
+* Name: CIccApplyHashCmm::ApplyMisses
+*
+* Purpose: Applies the collected pixels that were not in the cache, stores
+*  their results in DstPixel and adds them to the cache.  A key that finds
+*  neither itself nor a free slot within icHashCmmMaxProbe slots replaces
+*  the entry in its first slot.
+*
+* Args:
+*  DstPixel - Location of the run of pixel results being applied
+*****************************************************************************
+*/
+void CIccApplyHashCmm::ApplyMisses(icFloatNumber* DstPixel)
+{
+  icUInt32Number i, p, nSlot, nMask = m_nEntries - 1;
+  icUInt32Number nSrc = m_nSrcSamples, nDst = m_nDstSamples;
+  icUInt32Number nKeySize = nSrc * sizeof(icUInt16Number);
+
+  m_pCachedApply->Apply(m_pMissDst, m_pMissSrc, m_nNumMiss);
+
+  for (i = 0; i < m_nNumMiss; i++) {
+    const icFloatNumber* pResult = &m_pMissDst[i * nDst];
+    const icUInt16Number* Key = &m_pMissKeys[i * nSrc];
+
+    memcpy(DstPixel + m_pMissIndex[i] * nDst, pResult, nDst * sizeof(icFloatNumber));
+
+    if (!m_pMissCached[i])
+      continue;
+
+    for (p = 0; p < icHashCmmMaxProbe; p++) {
+      nSlot = (m_pMissHash[i] + p) & nMask;
+
+      if (!m_pUsed[nSlot] || !memcmp(&m_pKeys[nSlot * nSrc], Key, nKeySize))
+        break;
+    }
+
+    if (p == icHashCmmMaxProbe)
+      nSlot = m_pMissHash[i] & nMask;
+
+    memcpy(&m_pKeys[nSlot * nSrc], Key, nKeySize);
+    memcpy(&m_pValues[nSlot * nDst], pResult, nDst * sizeof(icFloatNumber));
+    m_pUsed[nSlot] = 1;
+  }
+
+  m_nMisses += m_nNumMiss;
+  m_nNumMiss = 0;
+}
+
 #ifdef USESAMPLEICCNAMESPACE
 } //namespace sampleICC
 #endif
@@ -115,6 +115,9 @@ typedef enum {
   icXformLutGamut              = 3,
 } icXformLutType;
 
+//Number of pixels passed from xform to xform at a time by CIccApplyCmm::Apply
+#define icCmmBlockPixels 256
+
 #define icPerceptualRefBlackX 0.00336
 #define icPerceptualRefBlackY 0.0034731
 #define icPerceptualRefBlackZ 0.00287
@@ -235,6 +238,50 @@ public:
 	virtual IIccAdjustPCSXform *GetNewAdjustPCSXform() const=0;
 };
 
+/**
+**************************************************************************
+* Type: Class
+* 
+* Purpose: 
+*  Hint for the number of entries in the inverse TRC tables built by
+*  output matrix/TRC and monochrome xforms (2 to 65536, default 2048)
+**************************************************************************
+*/
+class ICCPROFLIB_API CIccCreateInvCurveXformHint : public IIccCreateXformHint
+{
+public:
+	CIccCreateInvCurveXformHint(icUInt32Number nSize=2048) { m_nSize = nSize; }
+	virtual const char *GetHintType() const {return "CIccCreateInvCurveXformHint";}
+
+	icUInt32Number m_nSize;
+};
+
+/**
+**************************************************************************
+* Type: Class
+* 
+* Purpose: 
+*  Builds inverse curve tables and keeps a process wide cache of them keyed
+*  by the forward curve data and table size, so that repeated Begin() calls
+*  on the same profile curves reuse the tables.  Thread safe.
+**************************************************************************
+*/
+class ICCPROFLIB_API CIccInvCurveCache
+{
+public:
+	/// Returns a new nSize entry inverse of pCurve (owned by caller).  pCurve->Begin() must have been called.
+	static CIccTagCurve *NewInvCurve(CIccCurve *pCurve, icUInt32Number nSize);
+
+	/// Fills Lut with the nSize entry inverse of pCurve using a single sweep over the forward curve
+	static void BuildInvCurve(CIccCurve *pCurve, icFloatNumber *Lut, icUInt32Number nSize);
+
+	/// Sets the maximum number of cached tables (0 disables caching)
+	static void SetMaxEntries(icUInt32Number nMaxEntries);
+
+	/// Removes all cached tables
+	static void Clear();
+};
+
 //forward reference to CIccXform used by CIccApplyXform
 class CIccApplyXform;
 
@@ -273,6 +320,13 @@ public:
   virtual CIccApplyXform *GetNewApply(icStatusCMM &status);
 
   virtual void Apply(CIccApplyXform *pXform, icFloatNumber *DstPixel, const icFloatNumber *SrcPixel) const = 0;
+  ///Applies nPixels packed pixels of GetNumSrcSamples() and GetNumDstSamples() samples, valid after Begin()
+  virtual void Apply(CIccApplyXform *pXform, icFloatNumber *DstPixel, const icFloatNumber *SrcPixel, icUInt32Number nPixels) const;
+
+  ///Returns the number of samples of source pixels, valid after Begin()
+  virtual icUInt16Number GetNumSrcSamples() const { return (icUInt16Number)icGetSpaceSamples(GetSrcSpace()); }
+  ///Returns the number of samples of destination pixels, valid after Begin()
+  virtual icUInt16Number GetNumDstSamples() const { return (icUInt16Number)icGetSpaceSamples(GetDstSpace()); }
 
   //Detach and remove CIccIO object associated with xform's profile.  Must call after Begin()
   virtual bool RemoveIO() { return m_pProfile->Detach(); }
@@ -306,6 +360,9 @@ public:
 	/// Returns the rendering intent being used by the Xform
 	icRenderingIntent GetIntent() const { return m_nIntent; }
 
+  ///Gets the XYZ scale and offset applied to the PCS side by CheckSrcAbs/CheckDstAbs, returns false if there is none
+  bool GetPCSAdjustment(icFloatNumber *pScale, icFloatNumber *pOffset) const;
+
 protected:
   //Called by derived classes to initialize Base
 
@@ -326,6 +383,9 @@ protected:
 	bool m_bAdjustPCS;
 	icFloatNumber m_PCSScale[3]; // scale and offset for PCS adjustment in XYZ
 	icFloatNumber m_PCSOffset[3];
+
+	// number of entries in inverse curve tables (see CIccCreateInvCurveXformHint)
+	icUInt32Number m_nInvCurveSize;
 };
 
 /**
@@ -366,6 +426,7 @@ public:
   virtual icXformType GetXformType() const { return icXformTypeUnknown; }
 
   void __inline Apply(icFloatNumber *DstPixel, const icFloatNumber *SrcPixel) { m_pXform->Apply(this, DstPixel, SrcPixel); }
+  void __inline Apply(icFloatNumber *DstPixel, const icFloatNumber *SrcPixel, icUInt32Number nPixels) { m_pXform->Apply(this, DstPixel, SrcPixel, nPixels); }
 
   const CIccXform *GetXform() { return m_pXform; }
 
@@ -452,10 +513,16 @@ public:
 
   virtual icStatusCMM Begin();
   virtual void Apply(CIccApplyXform *pApplyXform, icFloatNumber *DstPixel, const icFloatNumber *SrcPixel) const;
+  virtual void Apply(CIccApplyXform *pApplyXform, icFloatNumber *DstPixel, const icFloatNumber *SrcPixel, icUInt32Number nPixels) const;
   
   virtual LPIccCurve* ExtractInputCurves();
   virtual LPIccCurve* ExtractOutputCurves();
 
+  ///Returns the row major 3x3 matrix used by Apply() (inverted for output xforms), valid after Begin()
+  const icFloatNumber *GetMatrix() const { return m_e; }
+  ///Returns the curve Apply() uses for a channel (inverse curve for output xforms), NULL if all curves are identity
+  CIccCurve *GetApplyCurve(int nChannel) const { return m_ApplyCurvePtr ? m_ApplyCurvePtr[nChannel] : NULL; }
+
 protected:
 
   virtual bool HasPerceptualHandling() { return false; }
@@ -490,12 +557,20 @@ public:
 
   virtual icStatusCMM Begin();
   virtual void Apply(CIccApplyXform *pApplyXform, icFloatNumber *DstPixel, const icFloatNumber *SrcPixel) const;
+  virtual void Apply(CIccApplyXform *pApplyXform, icFloatNumber *DstPixel, const icFloatNumber *SrcPixel, icUInt32Number nPixels) const;
+
+  virtual icUInt16Number GetNumSrcSamples() const { return 3; }
+  virtual icUInt16Number GetNumDstSamples() const { return m_pTag->m_nOutput; }
 
   virtual bool UseLegacyPCS() const { return m_pTag->UseLegacyPCS(); }
 
   virtual LPIccCurve* ExtractInputCurves();
   virtual LPIccCurve* ExtractOutputCurves();
 protected:
+  void ApplyInputStages(icFloatNumber *Pixel) const;
+  void ApplyOutputStages(icFloatNumber *Pixel) const;
+  void ApplyInputStages(icFloatNumber *Pixels, icUInt32Number nPixels) const;
+  void ApplyOutputStages(icFloatNumber *Pixels, icUInt32Number nPixels) const;
 
   const CIccMBB *m_pTag;
 
@@ -525,12 +600,21 @@ public:
 
   virtual icStatusCMM Begin();
   virtual void Apply(CIccApplyXform *pApplyXform, icFloatNumber *DstPixel, const icFloatNumber *SrcPixel) const;
+  virtual void Apply(CIccApplyXform *pApplyXform, icFloatNumber *DstPixel, const icFloatNumber *SrcPixel, icUInt32Number nPixels) const;
+
+  virtual icUInt16Number GetNumSrcSamples() const { return 4; }
+  virtual icUInt16Number GetNumDstSamples() const { return m_pTag->m_nOutput; }
 
   virtual bool UseLegacyPCS() const { return m_pTag->UseLegacyPCS(); }
 
   virtual LPIccCurve* ExtractInputCurves();
   virtual LPIccCurve* ExtractOutputCurves();
 protected:
+  void ApplyInputStages(icFloatNumber *Pixel) const;
+  void ApplyOutputStages(icFloatNumber *Pixel) const;
+  void ApplyInputStages(icFloatNumber *Pixels, icUInt32Number nPixels) const;
+  void ApplyOutputStages(icFloatNumber *Pixels, icUInt32Number nPixels) const;
+
   const CIccMBB *m_pTag;
 
   /// Pointers to data in m_pTag, used only for applying the xform
@@ -675,6 +759,10 @@ public:
 
   virtual CIccApplyXform *GetNewApply(icStatusCMM &status);
   virtual void Apply(CIccApplyXform *pApplyXform, icFloatNumber *DstPixel, const icFloatNumber *SrcPixel) const;
+  virtual void Apply(CIccApplyXform *pApplyXform, icFloatNumber *DstPixel, const icFloatNumber *SrcPixel, icUInt32Number nPixels) const;
+
+  virtual icUInt16Number GetNumSrcSamples() const { return m_pTag->NumInputChannels(); }
+  virtual icUInt16Number GetNumDstSamples() const { return m_pTag->NumOutputChannels(); }
 
   virtual bool UseLegacyPCS() const { return false; }
   virtual LPIccCurve* ExtractInputCurves() {return NULL;}
@@ -707,6 +795,23 @@ protected:
   CIccApplyTagMpe *m_pApply;
 };
 
+/**
+ **************************************************************************
+ * Type: Class
+ *
+ * Purpose: One PCS adjustment decided by CIccPCS::Step() or LastStep().
+ *  Convert and ConvertN are NULL when no adjustment is needed, both may
+ *  convert in place.
+ **************************************************************************
+ */
+class ICCPROFLIB_API CIccPCSStep
+{
+public:
+  void (*Convert)(icFloatNumber *Dst, const icFloatNumber *Src, bool bNoClip);
+  void (*ConvertN)(icFloatNumber *Dst, const icFloatNumber *Src, icUInt32Number nPixels, bool bNoClip);
+  bool bNoClip;
+};
+
 /**
  **************************************************************************
  * Type: Class
@@ -728,6 +833,10 @@ public:
   virtual const icFloatNumber *Check(const icFloatNumber *SrcPixel, const CIccXform *pXform);
   void CheckLast(icFloatNumber *SrcPixel, icColorSpaceSignature Space, bool bNoClip=false);
 
+  ///Decisions made by Check and CheckLast, CIccApplyCmm plans the adjustments of its xforms with them
+  virtual CIccPCSStep Step(const CIccXform *pXform);
+  CIccPCSStep LastStep(icColorSpaceSignature Space, bool bNoClip=false) const;
+
   static void LabToXyz(icFloatNumber *Dst, const icFloatNumber *Src, bool bNoClip=false);
   static void XyzToLab(icFloatNumber *Dst, const icFloatNumber *Src, bool bNoClip=false);
   static void Lab2ToXyz(icFloatNumber *Dst, const icFloatNumber *Src, bool bNoClip=false);
@@ -737,6 +846,13 @@ public:
 
   static void Lab2ToLab4(icFloatNumber *Dst, const icFloatNumber *Src, bool bNoclip=false);
   static void Lab4ToLab2(icFloatNumber *Dst, const icFloatNumber *Src);
+
+  static void LabToXyzN(icFloatNumber *Dst, const icFloatNumber *Src, icUInt32Number nPixels, bool bNoClip=false);
+  static void XyzToLabN(icFloatNumber *Dst, const icFloatNumber *Src, icUInt32Number nPixels, bool bNoClip=false);
+  static void Lab2ToXyzN(icFloatNumber *Dst, const icFloatNumber *Src, icUInt32Number nPixels, bool bNoClip=false);
+  static void XyzToLab2N(icFloatNumber *Dst, const icFloatNumber *Src, icUInt32Number nPixels, bool bNoClip=false);
+  static void Lab2ToLab4N(icFloatNumber *Dst, const icFloatNumber *Src, icUInt32Number nPixels, bool bNoClip=false);
+  static void Lab4ToLab2N(icFloatNumber *Dst, const icFloatNumber *Src, icUInt32Number nPixels);
 protected:
 
   bool m_bIsV2Lab;
@@ -826,10 +942,20 @@ public:
 protected:
   CIccApplyCmm(CIccCmm *pCmm);
 
+  void Plan();
+
   CIccApplyXformList *m_Xforms;
   CIccCmm *m_pCmm;
 
   CIccPCS *m_pPCS;
+
+  ///PCS adjustment before each xform and after the last one, made by Plan()
+  CIccPCSStep *m_PCSSteps;
+
+  ///Scratch pixels for passing blocks of icCmmBlockPixels pixels from xform to xform, made by Plan().
+  ///NULL if the xforms don't agree on pixel sizes, pixels are then applied one at a time.
+  icFloatNumber *m_BlockBuf;
+  icUInt32Number m_nBlockSamples;
 private:
   CIccApplyCmm(const CIccApplyCmm &);
 };
@@ -936,6 +1062,12 @@ public:
   virtual icColorSpaceSignature GetFirstXformSource();
   virtual icColorSpaceSignature GetLastXformDest();
 
+  ///Returns the first transform or NULL if none were added
+  virtual const CIccXform *GetFirstXform() const;
+
+  ///Returns the last transform or NULL if none were added
+  virtual const CIccXform *GetLastXform() const;
+
 protected:
 
   CIccApplyCmm *m_pApply;
@@ -1141,6 +1273,128 @@ protected:
 
 };
 
+///Number of slots probed for a key before the first one is replaced
+#define icHashCmmMaxProbe 8
+///Largest number of source samples that CIccHashCmm can cache
+#define icHashCmmMaxSamples 16
+
+//Forward Class for CIccApplyHashCmm
+class CIccHashCmm;
+/**
+**************************************************************************
+* Type: Class
+* 
+* Purpose: Apply object of CIccHashCmm.  Every apply object has its own
+*  cache and its own apply object of the cached CMM, so threads each use
+*  their own one from GetNewApplyCmm().
+* 
+**************************************************************************
+*/
+class ICCPROFLIB_API CIccApplyHashCmm : public CIccApplyCmm
+{
+  friend class CIccHashCmm;
+public:
+  virtual ~CIccApplyHashCmm();
+
+  virtual icStatusCMM Apply(icFloatNumber *DstPixel, const icFloatNumber *SrcPixel);
+
+  //Make sure that when DstPixel==SrcPixel the sizeof DstPixel is greater than size of SrcPixel
+  virtual icStatusCMM Apply(icFloatNumber *DstPixel, const icFloatNumber *SrcPixel, icUInt32Number nPixels);
+
+  ///Number of pixels found in the cache
+  icUInt64Number GetHits() const { return m_nHits; }
+  ///Number of pixels applied through the cached CMM, including pixels outside the 0..1 key range
+  icUInt64Number GetMisses() const { return m_nMisses; }
+  void ResetCounts() { m_nHits = m_nMisses = 0; }
+
+  ///Number of cached results that fit in the cache
+  icUInt32Number GetNumEntries() const { return m_nEntries; }
+  void ClearCache();
+
+protected:
+  CIccApplyHashCmm(CIccHashCmm *pCmm);
+
+  bool Init(CIccCmm *pCachedCmm, icUInt8Number nKeyBits, icUInt32Number nCacheMB);
+  void ApplyMisses(icFloatNumber *DstPixel);
+
+  CIccApplyCmm *m_pCachedApply;
+
+  icUInt32Number m_nSrcSamples;
+  icUInt32Number m_nDstSamples;
+  icFloatNumber m_fKeyMax;  //quantized value of 1.0
+
+  icUInt32Number m_nEntries; //power of 2
+  icUInt16Number *m_pKeys;   //m_nSrcSamples per entry
+  icFloatNumber *m_pValues;  //m_nDstSamples per entry
+  icUInt8Number *m_pUsed;
+
+  ///Pixels not found in the cache, applied a block of icCmmBlockPixels at a time
+  icUInt32Number m_nNumMiss;
+  icUInt32Number *m_pMissIndex;  //pixel offsets in the destination
+  icUInt32Number *m_pMissHash;
+  bool *m_pMissCached;           //false for pixels outside the key range
+  icUInt16Number *m_pMissKeys;
+  icFloatNumber *m_pMissSrc;
+  icFloatNumber *m_pMissDst;
+
+  icUInt64Number m_nHits;
+  icUInt64Number m_nMisses;
+};
+
+/**
+**************************************************************************
+* Type: Class
+* 
+* Purpose: A CMM decorator class that caches results in a hash table keyed
+*  on source pixels quantized to 8 to 16 bits per sample.  Cached results
+*  are those of the quantized source pixel.  Source pixels with samples
+*  outside 0..1 are applied without caching.
+* 
+**************************************************************************
+*/
+class ICCPROFLIB_API CIccHashCmm : public CIccCmm
+{
+  friend class CIccApplyHashCmm;
+private:
+  CIccHashCmm();
+public:
+  virtual ~CIccHashCmm();
+
+  //This is the function used to create a new CIccHashCmm.  The pCmm must be valid and its Begin() already called.
+  //Each apply object gets a cache of about nCacheMB megabytes.
+  static CIccHashCmm* Attach(CIccCmm *pCmm, icUInt8Number nKeyBits=16, icUInt32Number nCacheMB=4);  //The returned object will own pCmm, and pCmm is deleted on failure.
+
+  //override AddXform/Begin functions to return bad status.
+  virtual icStatusCMM AddXform(const icChar *szProfilePath, icRenderingIntent nIntent=icUnknownIntent,
+    icXformInterp nInterp=icInterpLinear, icXformLutType nLutType=icXformLutColor,
+    bool bUseMpeTags=true, CIccCreateXformHintManager *pHintManager=NULL) { return icCmmStatBad; }
+  virtual icStatusCMM AddXform(icUInt8Number *pProfileMem, icUInt32Number nProfileLen,
+    icRenderingIntent nIntent=icUnknownIntent, icXformInterp nInterp=icInterpLinear,
+    icXformLutType nLutType=icXformLutColor, bool bUseMpeTags=true, CIccCreateXformHintManager *pHintManager=NULL)  { return icCmmStatBad; }
+  virtual icStatusCMM AddXform(CIccProfile *pProfile, icRenderingIntent nIntent=icUnknownIntent,
+    icXformInterp nInterp=icInterpLinear, icXformLutType nLutType=icXformLutColor,
+    bool bUseMpeTags=true, CIccCreateXformHintManager *pHintManager=NULL)  { return icCmmStatBad; }
+  virtual icStatusCMM AddXform(CIccProfile &Profile, icRenderingIntent nIntent=icUnknownIntent,
+    icXformInterp nInterp=icInterpLinear, icXformLutType nLutType=icXformLutColor,
+    bool bUseMpeTags=true, CIccCreateXformHintManager *pHintManager=NULL) { return icCmmStatBad; }
+
+  virtual CIccApplyCmm *GetNewApplyCmm(icStatusCMM &status); 
+
+  //Forward calls to attached CMM
+  virtual icStatusCMM RemoveAllIO() { return m_pCmm->RemoveAllIO(); }
+  virtual CIccPCS *GetPCS() { return m_pCmm->GetPCS(); }
+  virtual icUInt32Number GetNumXforms() const { return m_pCmm->GetNumXforms(); }
+
+  virtual icColorSpaceSignature GetFirstXformSource() { return m_pCmm->GetFirstXformSource(); }
+  virtual icColorSpaceSignature GetLastXformDest() { return m_pCmm->GetLastXformDest(); }
+
+protected:
+  CIccCmm *m_pCmm;
+  icUInt8Number m_nKeyBits;
+  icUInt32Number m_nCacheMB;
+
+};
+
 #ifdef USESAMPLEICCNAMESPACE
 }; //namespace sampleICC
 #endif
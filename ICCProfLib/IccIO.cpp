@@ -74,6 +74,15 @@
 #include <memory.h>
 #include <string.h>
 
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #ifndef __max
 #define __max(a,b)  (((a) > (b)) ? (a) : (b))
 #endif
@@ -114,7 +123,7 @@ icInt32Number CIccIO::ReadLine(void* pBuf8, icInt32Number nNum/*=256*/)
 icInt32Number CIccIO::Read16(void* pBuf16, icInt32Number nNum)
 {
   nNum = Read8(pBuf16, nNum << 1) >> 1;
-  icSwab16Array(pBuf16, nNum);
+  icBulkSwab16(pBuf16, nNum);
 
   return nNum;
 }
@@ -143,7 +152,7 @@ icInt32Number CIccIO::Write16(void* pBuf16, icInt32Number nNum)
 icInt32Number CIccIO::Read32(void* pBuf32, icInt32Number nNum)
 {
   nNum = Read8(pBuf32, nNum << 2) >> 2;
-  icSwab32Array(pBuf32, nNum);
+  icBulkSwab32(pBuf32, nNum);
 
   return nNum;
 }
@@ -203,14 +212,20 @@ icInt32Number CIccIO::Write64(void* pBuf64, icInt32Number nNum)
 icInt32Number CIccIO::Read8Float(void* pBufFloat, icInt32Number nNum)
 {
   icFloatNumber* ptr = (icFloatNumber*)pBufFloat;
-  icUInt8Number tmp;
-  icInt32Number i;
+  icUInt8Number tmp[1024];
+  icInt32Number i = 0;
 
-  for (i = 0; i < nNum; i++) {
-    if (Read8(&tmp, 1) != 1)
+  //Read in blocks rather than one virtual Read8 per sample
+  while (i < nNum) {
+    icInt32Number nBlock = __min(nNum - i, (icInt32Number)sizeof(tmp));
+    icInt32Number nRead = Read8(tmp, nBlock);
+
+    icBulk8ToFloat(ptr, tmp, nRead);
+
+    ptr += nRead;
+    i += nRead;
+    if (nRead != nBlock)
       break;
-    *ptr = (icFloatNumber)((icFloatNumber)tmp / 255.0);
-    ptr++;
   }
 
   return i;
@@ -236,14 +251,20 @@ icInt32Number CIccIO::Write8Float(void* pBufFloat, icInt32Number nNum)
 icInt32Number CIccIO::Read16Float(void* pBufFloat, icInt32Number nNum)
 {
   icFloatNumber* ptr = (icFloatNumber*)pBufFloat;
-  icUInt16Number tmp;
-  icInt32Number i;
+  icUInt8Number tmp[2048];
+  icInt32Number i = 0;
 
-  for (i = 0; i < nNum; i++) {
-    if (Read16(&tmp, 1) != 1)
+  //Read raw big endian blocks, swapping and scaling is done in one pass
+  while (i < nNum) {
+    icInt32Number nBlock = __min(nNum - i, (icInt32Number)(sizeof(tmp) / 2));
+    icInt32Number nRead = Read8(tmp, nBlock << 1) >> 1;
+
+    icBulk16ToFloat(ptr, tmp, nRead);
+
+    ptr += nRead;
+    i += nRead;
+    if (nRead != nBlock)
       break;
-    *ptr = (icFloatNumber)((icFloatNumber)tmp / 65535.0);
-    ptr++;
   }
 
   return i;
@@ -613,6 +634,151 @@ icInt32Number CIccMemIO::Tell()
   return (icInt32Number)m_nPos;
 }
 
+//////////////////////////////////////////////////////////////////////
+// Class CIccMappedIO
+//////////////////////////////////////////////////////////////////////
+
+CIccMappedIO::CIccMappedIO() : CIccMemIO()
+{
+  m_pMapping = NULL;
+  m_nMapSize = 0;
+  m_hMapping = NULL;
+  m_nModified = 0;
+}
+
+CIccMappedIO::~CIccMappedIO()
+{
+  Close();
+}
+
+#if defined(_WIN32)
+
+static bool icMapFile(HANDLE hFile, void*& pMapping, icUInt32Number& nSize, void*& hMapping, long long& nModified)
+{
+  if (hFile == INVALID_HANDLE_VALUE)
+    return false;
+
+  //size and time are taken from the open handle, so they belong to the mapped contents
+  LARGE_INTEGER size;
+  FILETIME modified;
+  if (!GetFileSizeEx(hFile, &size) || size.QuadPart <= 0 || size.QuadPart > 0x7fffffff ||
+      !GetFileTime(hFile, NULL, NULL, &modified)) {
+    CloseHandle(hFile);
+    return false;
+  }
+
+  HANDLE hMap = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+  CloseHandle(hFile);
+  if (!hMap)
+    return false;
+
+  pMapping = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+  if (!pMapping) {
+    CloseHandle(hMap);
+    return false;
+  }
+
+  nSize = (icUInt32Number)size.QuadPart;
+  hMapping = hMap;
+  nModified = ((long long)modified.dwHighDateTime << 32) | modified.dwLowDateTime;
+
+  return true;
+}
+
+bool CIccMappedIO::Open(const icChar* szFilename)
+{
+  Close();
+
+  HANDLE hFile = CreateFileA(szFilename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+  if (!icMapFile(hFile, m_pMapping, m_nMapSize, m_hMapping, m_nModified))
+    return false;
+
+  return Attach((icUInt8Number*)m_pMapping, m_nMapSize);
+}
+
+#if defined(WIN32) || defined(WIN64)
+bool CIccMappedIO::Open(const icWChar* szFilename)
+{
+  Close();
+
+  HANDLE hFile = CreateFileW(szFilename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+  if (!icMapFile(hFile, m_pMapping, m_nMapSize, m_hMapping, m_nModified))
+    return false;
+
+  return Attach((icUInt8Number*)m_pMapping, m_nMapSize);
+}
+#endif
+
+void CIccMappedIO::Close()
+{
+  CIccMemIO::Close();
+
+  if (m_pMapping) {
+    UnmapViewOfFile(m_pMapping);
+    m_pMapping = NULL;
+  }
+  if (m_hMapping) {
+    CloseHandle((HANDLE)m_hMapping);
+    m_hMapping = NULL;
+  }
+  m_nMapSize = 0;
+  m_nModified = 0;
+}
+
+#else
+
+bool CIccMappedIO::Open(const icChar* szFilename)
+{
+  Close();
+
+  int fd = open(szFilename, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0 || st.st_size > 0x7fffffff) {
+    close(fd);
+    return false;
+  }
+
+  void* pMapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (pMapping == MAP_FAILED)
+    return false;
+
+  //Tags are parsed front to back
+  madvise(pMapping, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+  m_pMapping = pMapping;
+  m_nMapSize = (icUInt32Number)st.st_size;
+#if defined(__APPLE__)
+  m_nModified = (long long)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+  m_nModified = (long long)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+
+  return Attach((icUInt8Number*)m_pMapping, m_nMapSize);
+}
+
+void CIccMappedIO::Close()
+{
+  CIccMemIO::Close();
+
+  if (m_pMapping) {
+    munmap(m_pMapping, m_nMapSize);
+    m_pMapping = NULL;
+  }
+  m_nMapSize = 0;
+  m_nModified = 0;
+}
+
+#endif
+
 ///////////////////////////////
 
 //////////////////////////////////////////////////////////////////////
@@ -204,6 +204,39 @@ protected:
   bool m_bFreeData;
 };
 
+/**
+ **************************************************************************
+  * Type: Class
+  *
+  * Purpose: Handles read only IO of a memory mapped file.  The file is
+  *  mapped as a whole, so reads are plain copies out of the page cache
+  *  without stdio buffering.
+  **************************************************************************
+  */
+class ICCPROFLIB_API CIccMappedIO : public CIccMemIO
+{
+public:
+  CIccMappedIO();
+  virtual ~CIccMappedIO();
+
+  bool Open(const icChar* szFilename);
+#if defined(WIN32) || defined(WIN64)
+  bool Open(const icWChar* szFilename);
+#endif
+  virtual void Close();
+
+  virtual icInt32Number Write8(void* /*pBuf*/, icInt32Number /*nNum*/ = 1) { return 0; }
+
+  ///Last write time of the opened file, in ns (100 ns ticks on Windows), 0 if none is open
+  long long GetModifiedTime() const { return m_nModified; }
+
+protected:
+  void* m_pMapping;
+  icUInt32Number m_nMapSize;
+  void* m_hMapping;  //file mapping object on Windows
+  long long m_nModified;
+};
+
 /**
  **************************************************************************
   * Type: Class
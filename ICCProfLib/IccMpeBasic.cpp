@@ -1342,6 +1342,55 @@ icFloatNumber CIccSegmentedCurve::Apply(icFloatNumber v) const
   return v;
 }
 
+/**
+ ******************************************************************************
+  * Name: CIccSegmentedCurve::ApplyN
+  *
+  * Purpose:
+  *  Applies the curve to a run of values in place.  The segment found for a
+  *  value is kept with the range of values that select it, so runs of values
+  *  in the same segment skip the segment search.  Results are identical to
+  *  Apply().
+  *
+  * Args:
+  *  pValues = first value,
+  *  nCount = number of values,
+  *  nStride = distance between values
+  ******************************************************************************/
+void CIccSegmentedCurve::ApplyN(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride/*=1*/) const
+{
+  CIccCurveSegmentList::iterator i;
+  CIccCurveSegment* pSeg = NULL;
+  icFloatNumber lo = icMinFloat32Number, hi = icMinFloat32Number, v;
+
+  for (; nCount; nCount--, pValues += nStride) {
+    v = *pValues;
+
+    if (!pSeg || !(v > lo && v <= hi)) {
+      //Values above the end of all preceding segments and up to the end of
+      //the segment found select the same segment
+      pSeg = NULL;
+      lo = icMinFloat32Number;
+
+      for (i = m_list->begin(); i != m_list->end(); i++) {
+        if (v <= (*i)->EndPoint()) {
+          pSeg = *i;
+          hi = pSeg->EndPoint();
+          break;
+        }
+
+        if ((*i)->EndPoint() > lo)
+          lo = (*i)->EndPoint();
+      }
+
+      if (!pSeg)
+        continue;
+    }
+
+    *pValues = pSeg->Apply(v);
+  }
+}
+
 /**
  ******************************************************************************
   * Name: CIccSegmentedCurve::Validate
@@ -1402,6 +1451,25 @@ CIccCurveSetCurve* CIccCurveSetCurve::Create(icCurveElemSignature sig)
   }
 }
 
+/**
+ ******************************************************************************
+  * Name: CIccCurveSetCurve::ApplyN
+  *
+  * Purpose:
+  *  Applies the curve to a run of values in place, the default applies each
+  *  value in turn.
+  *
+  * Args:
+  *  pValues = first value,
+  *  nCount = number of values,
+  *  nStride = distance between values
+  ******************************************************************************/
+void CIccCurveSetCurve::ApplyN(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride/*=1*/) const
+{
+  for (; nCount; nCount--, pValues += nStride)
+    *pValues = Apply(*pValues);
+}
+
 /**
  ******************************************************************************
   * Name: CIccMpeCurveSet::CIccMpeCurveSet
@@ -1861,6 +1929,31 @@ void CIccMpeCurveSet::Apply(CIccApplyMpe* pApply, icFloatNumber* pDestPixel, con
   }
 }
 
+/**
+ ******************************************************************************
+  * Name: CIccMpeCurveSet::Apply
+  *
+  * Purpose:
+  *  Applies the curves to nPixels packed pixels, one channel at a time.
+  *
+  * Args:
+  *  pApply = apply object for the element,
+  *  pDestPixel = nPixels destination pixels,
+  *  pSrcPixel = nPixels source pixels,
+  *  nPixels = number of pixels
+  ******************************************************************************/
+void CIccMpeCurveSet::Apply(CIccApplyMpe* pApply, icFloatNumber* pDestPixel, const icFloatNumber* pSrcPixel, icUInt32Number nPixels) const
+{
+  int i;
+
+  if (pDestPixel != pSrcPixel)
+    memcpy(pDestPixel, pSrcPixel, nPixels * m_nInputChannels * sizeof(icFloatNumber));
+
+  for (i = 0; i < m_nInputChannels; i++) {
+    m_curve[i]->ApplyN(pDestPixel + i, nPixels, m_nInputChannels);
+  }
+}
+
 /**
  ******************************************************************************
   * Name: CIccMpeCurveSet::Validate
@@ -2624,6 +2717,27 @@ void CIccMpeCLUT::Apply(CIccApplyMpe* pApply, icFloatNumber* dstPixel, const icF
   }
 }
 
+/**
+ ******************************************************************************
+  * Name: CIccMpeCLUT::Apply
+  *
+  * Purpose: Applies the CLUT to nPixels packed pixels.  Tetrahedral
+  *  interpolation is done for the whole run by CIccCLUT::Interp3dTetraN.
+  *
+  * Args:
+  *  pApply = apply object for the element,
+  *  dstPixel = nPixels output pixels (must not overlap srcPixel),
+  *  srcPixel = nPixels input pixels,
+  *  nPixels = number of pixels
+  ******************************************************************************/
+void CIccMpeCLUT::Apply(CIccApplyMpe* pApply, icFloatNumber* dstPixel, const icFloatNumber* srcPixel, icUInt32Number nPixels) const
+{
+  if (m_interpType == ic3dInterpTetra)
+    m_pCLUT->Interp3dTetraN(dstPixel, srcPixel, nPixels);
+  else
+    CIccMultiProcessElement::Apply(pApply, dstPixel, srcPixel, nPixels);
+}
+
 /**
  ******************************************************************************
   * Name: CIccMpeCLUT::Validate
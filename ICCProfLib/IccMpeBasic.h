@@ -227,6 +227,8 @@ public:
 
   virtual bool Begin() = 0;
   virtual icFloatNumber Apply(icFloatNumber v) const = 0;
+  ///Applies the curve in place to nCount values that are nStride values apart
+  virtual void ApplyN(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride = 1) const;
   virtual icValidateStatus Validate(icTagSignature sig, std::string& sReport, const CIccTagMultiProcessElement* pMPE = NULL) const = 0;
 
 protected:
@@ -263,6 +265,7 @@ public:
 
   virtual bool Begin();
   virtual icFloatNumber Apply(icFloatNumber v) const;
+  virtual void ApplyN(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride = 1) const;
   virtual icValidateStatus Validate(icTagSignature sig, std::string& sReport, const CIccTagMultiProcessElement* pMPE = NULL) const;
 
 protected:
@@ -303,6 +306,7 @@ public:
 
   virtual bool Begin(icElemInterp nInterp, CIccTagMultiProcessElement* pMPE);
   virtual void Apply(CIccApplyMpe* pApply, icFloatNumber* dstPixel, const icFloatNumber* srcPixel) const;
+  virtual void Apply(CIccApplyMpe* pApply, icFloatNumber* dstPixel, const icFloatNumber* srcPixel, icUInt32Number nPixels) const;
 
   virtual icValidateStatus Validate(icTagSignature sig, std::string& sReport, const CIccTagMultiProcessElement* pMPE = NULL) const;
 
@@ -397,6 +401,7 @@ public:
 
   virtual bool Begin(icElemInterp nInterp, CIccTagMultiProcessElement* pMPE);
   virtual void Apply(CIccApplyMpe* pApply, icFloatNumber* dstPixel, const icFloatNumber* srcPixel) const;
+  virtual void Apply(CIccApplyMpe* pApply, icFloatNumber* dstPixel, const icFloatNumber* srcPixel, icUInt32Number nPixels) const;
 
   virtual icValidateStatus Validate(icTagSignature sig, std::string& sReport, const CIccTagMultiProcessElement* pMPE = NULL) const;
 
@@ -156,6 +156,31 @@ namespace sampleICC {
 // remove comment below if you want LAB to XYZ conversions to not clip negative XYZ values
 #define SAMPLEICC_NOCLIPLABTOXYZ
 
+// SIMD kernels.  SSE2 is part of the x86-64 baseline; SSE4.1 and AVX2 kernels are
+// compiled alongside and only selected at run time when the CPU supports them.
+// Define ICC_NO_SIMD to build the scalar code paths only.
+#if !defined(ICC_NO_SIMD)
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ICC_USE_SSE2
+#if (defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__GNUC__)
+#define ICC_USE_SSE41
+#define ICC_USE_AVX2
+#endif
+#endif
+#endif
+
+#if defined(ICC_USE_SSE41) && defined(__GNUC__)
+#define ICC_TARGET_SSE41 __attribute__((target("sse4.1")))
+#else
+#define ICC_TARGET_SSE41
+#endif
+
+#if defined(ICC_USE_AVX2) && defined(__GNUC__)
+#define ICC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define ICC_TARGET_AVX2
+#endif
+
 #ifdef SAMPLEICCCMM_EXPORTS
 #define MAKE_A_DLL
 #endif
@@ -81,6 +81,12 @@
 #include "IccTag.h"
 #include "IccUtil.h"
 #include "IccProfile.h"
+#ifdef ICC_USE_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef ICC_USE_AVX2
+#include <immintrin.h>
+#endif
 
 #ifdef USESAMPLEICCNAMESPACE
 namespace sampleICC {
@@ -131,6 +137,194 @@ icFloatNumber CIccCurve::Find(icFloatNumber v,
 }
 
 
+/**
+****************************************************************************
+* Name: CIccCurve::ApplyN
+*
+* Purpose: Applies the curve to a run of values in place.  Curves override
+*  this with the kernel picked by their Begin(), the default applies each
+*  value in turn.
+*
+* Args:
+*  pValues = first value,
+*  nCount = number of values,
+*  nStride = distance between values (e.g. the number of channels of
+*   interleaved pixels)
+*
+*****************************************************************************
+*/
+void CIccCurve::ApplyN(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride/*=1*/)
+{
+  for (; nCount; nCount--, pValues += nStride)
+    *pValues = Apply(*pValues);
+}
+
+
+/**
+****************************************************************************
+* Name: CIccCurve::CIccCurve
+*
+* Purpose: Copy Constructor
+*
+* Args:
+*  curve = The CIccCurve object to be copied
+*****************************************************************************
+*/
+CIccCurve::CIccCurve(const CIccCurve& curve)
+{
+  m_pTable = NULL;
+  m_nTableMax = 0;
+
+  *this = curve;
+}
+
+
+/**
+****************************************************************************
+* Name: CIccCurve::operator=
+*
+* Purpose: Copy Operator, copies the table built by BeginTable()
+*
+* Args:
+*  curve = The CIccCurve object to be copied
+*****************************************************************************
+*/
+CIccCurve& CIccCurve::operator=(const CIccCurve& curve)
+{
+  if (&curve == this)
+    return *this;
+
+  if (m_pTable)
+    free(m_pTable);
+  m_pTable = NULL;
+  m_nTableMax = 0;
+
+  if (curve.m_pTable) {
+    m_pTable = (icFloatNumber*)malloc((curve.m_nTableMax + 2) * sizeof(icFloatNumber));
+    if (m_pTable) {
+      memcpy(m_pTable, curve.m_pTable, (curve.m_nTableMax + 2) * sizeof(icFloatNumber));
+      m_nTableMax = curve.m_nTableMax;
+    }
+  }
+
+  return *this;
+}
+
+
+/**
+****************************************************************************
+* Name: CIccCurve::~CIccCurve
+*
+* Purpose: Destructor
+*
+*****************************************************************************
+*/
+CIccCurve::~CIccCurve()
+{
+  if (m_pTable)
+    free(m_pTable);
+}
+
+
+/**
+****************************************************************************
+* Name: CIccCurve::BeginTable
+*
+* Purpose: Samples TableFunction() into a table that TableLookup()
+*  interpolates linearly, so the gamma and parametric kernels can skip
+*  pow().  4096 intervals are tried first and 16384 next.  A table is kept
+*  only if its interpolation is within 2^-24 of TableFunction() at the
+*  middle of every interval, where the error of a smooth function is
+*  largest.  With float rounding, table values stay within 2^-23 (a float
+*  step at 1.0) of the exact ones.  Steep functions, such as gammas below 1
+*  near 0, fail the check and keep the exact kernel.
+*
+*  A table equal to the one already held is kept, so curves shared by
+*  several CMMs can Begin() again while another one applies them.
+*
+* Return: true if a table is available
+*
+*****************************************************************************
+*/
+bool CIccCurve::BeginTable()
+{
+  static const icUInt32Number nSizes[] = { 4096, 16384 };
+  static const double dMaxError = 1.0 / 16777216.0;
+  icFloatNumber* pTable;
+  icUInt32Number n, i;
+  size_t k;
+
+  for (k = 0; k < sizeof(nSizes) / sizeof(nSizes[0]); k++) {
+    n = nSizes[k];
+    pTable = (icFloatNumber*)malloc((n + 2) * sizeof(icFloatNumber));
+    if (!pTable)
+      break;
+
+    pTable[0] = TableFunction(0.0);
+    for (i = 0; i < n; i++) {
+      pTable[i + 1] = TableFunction((icFloatNumber)((double)(i + 1) / n));
+
+      double dMid = TableFunction((icFloatNumber)((i + 0.5) / n));
+      if (!(fabs(dMid - 0.5 * ((double)pTable[i] + pTable[i + 1])) <= dMaxError))
+        break;
+    }
+
+    if (i < n) {
+      free(pTable);
+      continue;
+    }
+    pTable[n + 1] = pTable[n];
+
+    if (m_pTable && m_nTableMax == n && !memcmp(m_pTable, pTable, (n + 2) * sizeof(icFloatNumber))) {
+      free(pTable);
+    }
+    else {
+      if (m_pTable)
+        free(m_pTable);
+      m_pTable = pTable;
+      m_nTableMax = n;
+    }
+    return true;
+  }
+
+  if (m_pTable)
+    free(m_pTable);
+  m_pTable = NULL;
+  m_nTableMax = 0;
+
+  return false;
+}
+
+
+/**
+****************************************************************************
+* Name: CIccCurve::ApplyTableN
+*
+* Purpose: Applies a curve tabulated whole by BeginTable() to a run of
+*  values in place.  Values outside 0..1 (and NaNs) go through Apply().
+*
+* Args:
+*  pValues = first value,
+*  nCount = number of values,
+*  nStride = distance between values
+*
+*****************************************************************************
+*/
+void CIccCurve::ApplyTableN(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride)
+{
+  icFloatNumber v;
+
+  for (; nCount; nCount--, pValues += nStride) {
+    v = *pValues;
+
+    if (v >= 0.0 && v <= 1.0)
+      *pValues = TableLookup(v);
+    else
+      *pValues = Apply(v);
+  }
+}
+
+
 /**
 ****************************************************************************
 * Name: CIccTagCurve::CIccTagCurve
@@ -148,6 +342,9 @@ CIccTagCurve::CIccTagCurve(int nSize/*=0*/)
     m_Curve = (icFloatNumber*)calloc(nSize, sizeof(icFloatNumber));
   else
     m_Curve = NULL;
+
+  m_nKernel = icCurveKernelGeneric;
+  m_fGamma = 1.0;
 }
 
 
@@ -161,10 +358,12 @@ CIccTagCurve::CIccTagCurve(int nSize/*=0*/)
 *  ITCurve = The CIccTagCurve object to be copied
 *****************************************************************************
 */
-CIccTagCurve::CIccTagCurve(const CIccTagCurve& ITCurve)
+CIccTagCurve::CIccTagCurve(const CIccTagCurve& ITCurve) : CIccCurve(ITCurve)
 {
   m_nSize = ITCurve.m_nSize;
   m_nMaxIndex = ITCurve.m_nMaxIndex;
+  m_nKernel = ITCurve.m_nKernel;
+  m_fGamma = ITCurve.m_fGamma;
 
   m_Curve = (icFloatNumber*)calloc(m_nSize, sizeof(icFloatNumber));
   memcpy(m_Curve, ITCurve.m_Curve, m_nSize * sizeof(icFloatNumber));
@@ -186,8 +385,12 @@ CIccTagCurve& CIccTagCurve::operator=(const CIccTagCurve& CurveTag)
   if (&CurveTag == this)
     return *this;
 
+  CIccCurve::operator=(CurveTag);
+
   m_nSize = CurveTag.m_nSize;
   m_nMaxIndex = CurveTag.m_nMaxIndex;
+  m_nKernel = CurveTag.m_nKernel;
+  m_fGamma = CurveTag.m_fGamma;
 
   if (m_Curve)
     free(m_Curve);
@@ -434,6 +637,9 @@ void CIccTagCurve::SetSize(icUInt32Number nSize, icTagCurveSizeInit nSizeOpt/*=i
   if (nSize == m_nSize)
     return;
 
+  //Begin() has to pick the kernel again
+  m_nKernel = icCurveKernelGeneric;
+
   if (!nSize && m_Curve) {
     free(m_Curve);
     m_Curve = NULL;
@@ -552,6 +758,33 @@ bool CIccTagCurve::IsIdentity()
   return true;
 }
 
+/**
+****************************************************************************
+* Name: CIccTagCurve::Begin
+*
+* Purpose: Prepares the curve for Apply and picks the ApplyN kernel: an
+*  empty curve only clips, a single entry is a gamma (tabulated if
+*  BeginTable() can) and anything else is a sampled table.
+*
+*****************************************************************************
+*/
+void CIccTagCurve::Begin()
+{
+  m_nMaxIndex = (icUInt16Number)m_nSize - 1;
+
+  if (!m_nSize) {
+    m_nKernel = icCurveKernelIdentity;
+  }
+  else if (m_nSize == 1) {
+    //Convert 0.0 to 1.0 float to 16bit and then convert from u8Fixed8Number
+    m_fGamma = (icFloatNumber)(m_Curve[0] * 65535.0 / 256.0);
+    m_nKernel = BeginTable() ? icCurveKernelTabulated : icCurveKernelGamma;
+  }
+  else {
+    m_nKernel = icCurveKernelTable;
+  }
+}
+
 /**
 ****************************************************************************
 * Name: CIccTagCurve::Apply
@@ -596,6 +829,145 @@ icFloatNumber CIccTagCurve::Apply(icFloatNumber v)
 }
 
 
+/**
+****************************************************************************
+* Name: CIccTagCurve::ApplyN
+*
+* Purpose: Applies the curve to a run of values in place with the kernel
+*  picked by Begin().  Results are identical to Apply(), except for a
+*  tabulated gamma that is within 2^-23 of it.
+*
+* Args:
+*  pValues = first value,
+*  nCount = number of values,
+*  nStride = distance between values
+*
+*****************************************************************************
+*/
+void CIccTagCurve::ApplyN(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride/*=1*/)
+{
+  icUInt32Number nDone = 0, nIndex;
+  icFloatNumber v;
+
+  switch (m_nKernel) {
+  case icCurveKernelIdentity:
+    for (; nCount; nCount--, pValues += nStride) {
+      v = *pValues;
+      if (v < 0.0) *pValues = 0.0;
+      else if (v > 1.0) *pValues = 1.0;
+    }
+    break;
+
+  case icCurveKernelGamma:
+    for (; nCount; nCount--, pValues += nStride) {
+      v = *pValues;
+      if (v < 0.0) v = 0.0;
+      else if (v > 1.0) v = 1.0;
+
+      *pValues = pow(v, m_fGamma);
+    }
+    break;
+
+  case icCurveKernelTabulated:
+    ApplyTableN(pValues, nCount, nStride);
+    break;
+
+  case icCurveKernelTable:
+#ifdef ICC_USE_AVX2
+    if (icCpuHasAVX2())
+      nDone = ApplyTableAVX2(pValues, nCount, nStride);
+#endif
+
+    pValues += nDone * nStride;
+    for (; nDone < nCount; nDone++, pValues += nStride) {
+      v = *pValues;
+      if (v < 0.0) v = 0.0;
+      else if (v > 1.0) v = 1.0;
+
+      nIndex = (icUInt32Number)(v * m_nMaxIndex);
+
+      if (nIndex == m_nMaxIndex) {
+        *pValues = m_Curve[nIndex];
+      }
+      else {
+        icFloatNumber nDif = v * m_nMaxIndex - nIndex;
+        icFloatNumber p0 = m_Curve[nIndex];
+
+        icFloatNumber rv = p0 + (m_Curve[nIndex + 1] - p0) * nDif;
+        if (rv > 1.0)
+          rv = 1.0;
+
+        *pValues = rv;
+      }
+    }
+    break;
+
+  default:
+    CIccCurve::ApplyN(pValues, nCount, nStride);
+    break;
+  }
+}
+
+
+#ifdef ICC_USE_AVX2
+/**
+****************************************************************************
+* Name: CIccTagCurve::ApplyTableAVX2
+*
+* Purpose: AVX2 table lookup of eight values at a time, the table entries
+*  are gathered per lane.  Only called for the table kernel after
+*  icCpuHasAVX2() has been checked.
+*
+* Return: number of values processed (a multiple of 8)
+*
+*****************************************************************************
+*/
+ICC_TARGET_AVX2 icUInt32Number CIccTagCurve::ApplyTableAVX2(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride) const
+{
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 mx = _mm256_set1_ps((icFloatNumber)m_nMaxIndex);
+  const __m256i imx = _mm256_set1_epi32(m_nMaxIndex);
+  const __m256i inc = _mm256_set1_epi32(1);
+  const __m256i lanes = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((int)nStride));
+  icFloatNumber rvs[8];
+  icUInt32Number n, k;
+
+  for (n = 0; n + 8 <= nCount; n += 8) {
+    icFloatNumber* p = pValues + n * nStride;
+    __m256 v = nStride == 1 ? _mm256_loadu_ps(p) : _mm256_i32gather_ps(p, lanes, 4);
+
+    v = _mm256_min_ps(_mm256_max_ps(v, zero), one);
+
+    __m256 pos = _mm256_mul_ps(v, mx);
+    __m256i idx = _mm256_cvttps_epi32(pos);
+    __m256 dif = _mm256_sub_ps(pos, _mm256_cvtepi32_ps(idx));
+    __m256i last = _mm256_cmpeq_epi32(idx, imx);
+
+    __m256 p0 = _mm256_i32gather_ps(m_Curve, idx, 4);
+    __m256 p1 = _mm256_i32gather_ps(m_Curve, _mm256_min_epi32(_mm256_add_epi32(idx, inc), imx), 4);
+
+    __m256 rv = _mm256_add_ps(p0, _mm256_mul_ps(_mm256_sub_ps(p1, p0), dif));
+    rv = _mm256_blendv_ps(rv, one, _mm256_cmp_ps(rv, one, _CMP_GT_OQ));
+
+    //The last entry is returned as is
+    rv = _mm256_blendv_ps(rv, p0, _mm256_castsi256_ps(last));
+
+    if (nStride == 1) {
+      _mm256_storeu_ps(p, rv);
+    }
+    else {
+      _mm256_storeu_ps(rvs, rv);
+      for (k = 0; k < 8; k++)
+        p[k * nStride] = rvs[k];
+    }
+  }
+
+  return n;
+}
+#endif
+
+
 /**
 ******************************************************************************
 * Name: CIccTagCurve::Validate
@@ -648,6 +1020,9 @@ CIccTagParametricCurve::CIccTagParametricCurve()
   m_nNumParam = 0;
   m_dParam = NULL;
   m_nReserved2 = 0;
+
+  m_nKernel = icCurveKernelGeneric;
+  m_dThreshold = 0.0;
 }
 
 
@@ -661,10 +1036,12 @@ CIccTagParametricCurve::CIccTagParametricCurve()
 *  ITPC = The CIccTagParametricCurve object to be copied
 *****************************************************************************
 */
-CIccTagParametricCurve::CIccTagParametricCurve(const CIccTagParametricCurve& ITPC)
+CIccTagParametricCurve::CIccTagParametricCurve(const CIccTagParametricCurve& ITPC) : CIccCurve(ITPC)
 {
   m_nFunctionType = ITPC.m_nFunctionType;
   m_nNumParam = ITPC.m_nNumParam;
+  m_nKernel = ITPC.m_nKernel;
+  m_dThreshold = ITPC.m_dThreshold;
 
   m_dParam = new icFloatNumber[m_nNumParam];
   memcpy(m_dParam, ITPC.m_dParam, m_nNumParam * sizeof(icFloatNumber));
@@ -686,8 +1063,12 @@ CIccTagParametricCurve& CIccTagParametricCurve::operator=(const CIccTagParametri
   if (&ParamCurveTag == this)
     return *this;
 
+  CIccCurve::operator=(ParamCurveTag);
+
   m_nFunctionType = ParamCurveTag.m_nFunctionType;
   m_nNumParam = ParamCurveTag.m_nNumParam;
+  m_nKernel = ParamCurveTag.m_nKernel;
+  m_dThreshold = ParamCurveTag.m_dThreshold;
 
   if (m_dParam)
     delete[] m_dParam;
@@ -970,6 +1351,7 @@ bool CIccTagParametricCurve::SetFunctionType(icUInt16Number nFunctionType)
     delete m_dParam;
   m_nNumParam = nNumParam;
   m_nFunctionType = nFunctionType;
+  m_nKernel = icCurveKernelGeneric;
 
   if (m_nNumParam)
     m_dParam = new icFloatNumber[m_nNumParam];
@@ -1007,6 +1389,173 @@ bool CIccTagParametricCurve::IsIdentity()
   }
 }
 
+/**
+****************************************************************************
+* Name: CIccTagParametricCurve::Begin
+*
+* Purpose: Picks the ApplyN kernel.  Type 0 is a pure gamma (or identity
+*  for a gamma of exactly 1), types 1 to 4 are a power segment above a
+*  threshold and a constant or linear segment below it.  A gamma or the
+*  power segment of a piecewise curve is tabulated if BeginTable() can.
+*
+*****************************************************************************
+*/
+void CIccTagParametricCurve::Begin()
+{
+  if (!m_dParam || m_nFunctionType > 0x0004) {
+    m_nKernel = m_nFunctionType > 0x0004 ? icCurveKernelIdentity : icCurveKernelGeneric;
+    return;
+  }
+
+  switch (m_nFunctionType) {
+  case 0x0000:
+    m_nKernel = m_dParam[0] == 1.0 ? icCurveKernelIdentity : icCurveKernelGamma;
+    break;
+
+  case 0x0001:
+  case 0x0002:
+    m_dThreshold = -(double)m_dParam[2] / (double)m_dParam[1];
+    m_nKernel = icCurveKernelPiecewise;
+    break;
+
+  default:
+    m_dThreshold = m_dParam[4];
+    m_nKernel = icCurveKernelPiecewise;
+    break;
+  }
+
+  if (m_nKernel != icCurveKernelIdentity && BeginTable())
+    m_nKernel = icCurveKernelTabulated;
+}
+
+
+/**
+****************************************************************************
+* Name: CIccTagParametricCurve::ApplyN
+*
+* Purpose: Applies the curve to a run of values in place with the kernel
+*  picked by Begin().  Results are identical to Apply(), except for
+*  tabulated curves that are within 2^-23 of it.
+*
+* Args:
+*  pValues = first value,
+*  nCount = number of values,
+*  nStride = distance between values
+*
+*****************************************************************************
+*/
+void CIccTagParametricCurve::ApplyN(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride/*=1*/)
+{
+  icFloatNumber X;
+
+  switch (m_nKernel) {
+  case icCurveKernelIdentity:
+    break;
+
+  case icCurveKernelGamma:
+    {
+      icFloatNumber g = m_dParam[0];
+
+      for (; nCount; nCount--, pValues += nStride)
+        *pValues = pow(*pValues, g);
+    }
+    break;
+
+  case icCurveKernelTabulated:
+    if (m_nFunctionType == 0x0000) {
+      ApplyTableN(pValues, nCount, nStride);
+      break;
+    }
+
+    //the table holds the power segment over 0..1, the segment below the threshold is exact
+    for (; nCount; nCount--, pValues += nStride) {
+      X = *pValues;
+      *pValues = (X >= m_dThreshold && X >= 0.0 && X <= 1.0) ? TableLookup(X) : DoApply(X);
+    }
+    break;
+
+  case icCurveKernelPiecewise:
+    {
+      double g = m_dParam[0], a = m_dParam[1], b = m_dParam[2];
+      icFloatNumber c = m_dParam[3];
+
+      switch (m_nFunctionType) {
+      case 0x0001:
+        for (; nCount; nCount--, pValues += nStride) {
+          X = *pValues;
+          *pValues = X >= m_dThreshold ? (icFloatNumber)pow(a * X + b, g) : 0;
+        }
+        break;
+
+      case 0x0002:
+        for (; nCount; nCount--, pValues += nStride) {
+          X = *pValues;
+          *pValues = X >= m_dThreshold ? (icFloatNumber)pow(a * X + b, g) + c : c;
+        }
+        break;
+
+      case 0x0003:
+        for (; nCount; nCount--, pValues += nStride) {
+          X = *pValues;
+          *pValues = X >= m_dThreshold ? (icFloatNumber)pow(a * X + b, g) : c * X;
+        }
+        break;
+
+      case 0x0004:
+        {
+          icFloatNumber e = m_dParam[5], f = m_dParam[6];
+
+          for (; nCount; nCount--, pValues += nStride) {
+            X = *pValues;
+            *pValues = X >= m_dThreshold ? (icFloatNumber)pow(a * X + b, g) + e : c * X + f;
+          }
+        }
+        break;
+      }
+    }
+    break;
+
+  default:
+    CIccCurve::ApplyN(pValues, nCount, nStride);
+    break;
+  }
+}
+
+
+/**
+****************************************************************************
+* Name: CIccTagParametricCurve::TableFunction
+*
+* Purpose: Function tabulated by BeginTable(): the gamma of type 0, the
+*  power segment of types 1 to 4 extended below the threshold (with its base
+*  clipped at 0), so the table is smooth across the threshold.
+*
+*****************************************************************************
+*/
+icFloatNumber CIccTagParametricCurve::TableFunction(icFloatNumber X)
+{
+  double dBase;
+
+  if (m_nFunctionType == 0x0000)
+    return DoApply(X);
+
+  dBase = (double)m_dParam[1] * X + m_dParam[2];
+  if (dBase < 0.0)
+    dBase = 0.0;
+
+  switch (m_nFunctionType) {
+  case 0x0002:
+    return (icFloatNumber)pow(dBase, (double)m_dParam[0]) + m_dParam[3];
+
+  case 0x0004:
+    return (icFloatNumber)pow(dBase, (double)m_dParam[0]) + m_dParam[5];
+
+  default:
+    return (icFloatNumber)pow(dBase, (double)m_dParam[0]);
+  }
+}
+
+
 /**
 ****************************************************************************
 * Name: CIccTagParametricCurve::DoApply
@@ -1168,6 +1717,196 @@ icValidateStatus CIccTagParametricCurve::Validate(icTagSignature sig, std::strin
   return rv;
 }
 
+/**
+****************************************************************************
+* Name: CIccInvParametricCurve::Solve
+*
+* Purpose: Gets the inverse of a parametric curve.  All function types are
+*  handled as (a*X + b)^g + e above d and c*X + f below it.  The forward
+*  curve is only evaluated at a few points, it is not begun or tabulated.
+*
+* Args:
+*  pCurve = forward curve,
+*  pInv = receives the inverse, may be NULL to check only
+*
+* Return:
+*  false if the curve is not increasing over 0..1 (a sampled inverse has
+*  to be used then).
+*****************************************************************************
+*/
+bool CIccInvParametricCurve::Solve(const CIccTagParametricCurve* pCurve, CIccInvParametricCurve* pInv)
+{
+  icUInt16Number nType = pCurve->GetFunctionType();
+  const icFloatNumber* p = pCurve->GetParams();
+  double g, a = 1.0, b = 0.0, c = 0.0, d = 0.0, e = 0.0, f = 0.0;
+
+  if (!p || nType > 0x0004)
+    return false;
+
+  g = p[0];
+
+  switch (nType) {
+  case 0x0001:
+  case 0x0002:
+    a = p[1];
+    b = p[2];
+    if (nType == 0x0002)
+      e = f = p[3];
+    if (a > 0)
+      d = -b / a;
+    break;
+
+  case 0x0003:
+  case 0x0004:
+    a = p[1];
+    b = p[2];
+    c = p[3];
+    d = p[4];
+    if (nType == 0x0004) {
+      e = p[5];
+      f = p[6];
+    }
+    break;
+  }
+
+  if (!(g > 0) || !(a > 0) || !(c >= 0))
+    return false;
+
+  double dMin = pCurve->DoApply(0);
+  double dMax = pCurve->DoApply(1.0);
+
+  if (!(dMax > dMin))
+    return false;
+
+  //linear and power segments meet at d (within 0..1), a jump up between them
+  //is allowed as is a tiny jump down from rounding of the parameters
+  double ds = d < 0 ? 0 : (d > 1.0 ? 1.0 : d);
+  double dLinearEnd = ds > 0 ? c * ds + f : dMin;
+  double dPowerStart = d > 1.0 ? dMax : pow(a * ds + b, g) + e;
+
+  if (!(dPowerStart >= dLinearEnd - 1.0e-6))
+    return false;
+
+  if (pInv) {
+    pInv->m_dInvGamma = 1.0 / g;
+    pInv->m_dA = a;
+    pInv->m_dB = b;
+    pInv->m_dC = c;
+    pInv->m_dD = ds;
+    pInv->m_dE = e;
+    pInv->m_dF = f;
+    pInv->m_dMin = dMin;
+    pInv->m_dMax = dMax;
+    pInv->m_dLinearEnd = dLinearEnd;
+    pInv->m_dPowerStart = dPowerStart;
+  }
+
+  return true;
+}
+
+/**
+****************************************************************************
+* Name: CIccInvParametricCurve::Create
+*
+* Purpose: Creates the closed form inverse of a parametric curve (see
+*  Solve).  Values at or below the curve value at 0 map to 0 and values at
+*  or above the curve value at 1 map to 1, as for sampled inverse tables.
+*
+* Args:
+*  pCurve = forward curve
+*
+* Return:
+*  New inverse curve owned by the caller, or NULL if the curve is not
+*  increasing over 0..1 (a sampled inverse has to be used then).
+*****************************************************************************
+*/
+CIccInvParametricCurve* CIccInvParametricCurve::Create(CIccTagParametricCurve* pCurve)
+{
+  CIccInvParametricCurve* pInv = new CIccInvParametricCurve;
+
+  if (!Solve(pCurve, pInv)) {
+    delete pInv;
+    return NULL;
+  }
+
+  pInv->m_bIdentity = pCurve->IsIdentity();
+
+  return pInv;
+}
+
+/**
+****************************************************************************
+* Name: CIccInvParametricCurve::IsInvertible
+*
+* Purpose: Tells if Create would succeed, without building the inverse.
+*
+* Args:
+*  pCurve = forward curve
+*****************************************************************************
+*/
+bool CIccInvParametricCurve::IsInvertible(const CIccTagParametricCurve* pCurve)
+{
+  return Solve(pCurve, NULL);
+}
+
+
+/**
+****************************************************************************
+* Name: CIccInvParametricCurve::Apply
+*
+* Purpose: Applies the inverse curve to the value passed.
+*
+* Args:
+*  v = value to be passed through the inverse curve.
+*
+* Return: The value modified by the inverse curve (0..1).
+*
+*****************************************************************************
+*/
+icFloatNumber CIccInvParametricCurve::Apply(icFloatNumber v)
+{
+  double X;
+
+  if (!(v > m_dMin))
+    return 0;
+  if (v >= m_dMax)
+    return 1.0;
+
+  if (v < m_dLinearEnd)
+    X = (v - m_dF) / m_dC;
+  else if (v <= m_dPowerStart)
+    X = m_dD;
+  else
+    X = (pow(v - m_dE, m_dInvGamma) - m_dB) / m_dA;
+
+  if (X <= 0)
+    return 0;
+  if (X >= 1.0)
+    return 1.0;
+
+  return (icFloatNumber)X;
+}
+
+
+/**
+****************************************************************************
+* Name: CIccInvParametricCurve::ApplyN
+*
+* Purpose: Applies the inverse curve to a run of values in place.
+*
+* Args:
+*  pValues = first value,
+*  nCount = number of values,
+*  nStride = distance between values
+*
+*****************************************************************************
+*/
+void CIccInvParametricCurve::ApplyN(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride/*=1*/)
+{
+  for (; nCount; nCount--, pValues += nStride)
+    *pValues = CIccInvParametricCurve::Apply(*pValues);
+}
+
 /**
 ****************************************************************************
 * Name: CIccMatrix::CIccMatrix
@@ -1406,10 +2145,6 @@ CIccCLUT::CIccCLUT(icUInt8Number nInputChannels, icUInt16Number nOutputChannels,
   m_nPrecision = nPrecision;
   m_pData = NULL;
   m_nOffset = NULL;
-  m_g = NULL;
-  m_ig = NULL;
-  m_s = NULL;
-  m_df = NULL;
   memset(&m_nReserved2, 0, sizeof(m_nReserved2));
 
   UnitClip = ClutUnitClip;
@@ -1430,10 +2165,6 @@ CIccCLUT::CIccCLUT(const CIccCLUT& ICLUT)
 {
   m_pData = NULL;
   m_nOffset = NULL;
-  m_g = NULL;
-  m_ig = NULL;
-  m_s = NULL;
-  m_df = NULL;
   m_nInput = ICLUT.m_nInput;
   m_nOutput = ICLUT.m_nOutput;
   m_nPrecision = ICLUT.m_nPrecision;
@@ -1512,18 +2243,6 @@ CIccCLUT::~CIccCLUT()
 
   if (m_nOffset)
     delete[] m_nOffset;
-
-  if (m_g)
-    delete[] m_g;
-
-  if (m_ig)
-    delete[] m_ig;
-
-  if (m_s)
-    delete[] m_s;
-
-  if (m_df)
-    delete[] m_df;
 }
 
 /**
@@ -1941,6 +2660,20 @@ void CIccCLUT::Begin()
     m_nOffset[5] = n101 = n100 + n001;
     m_nOffset[6] = n110 = n100 + n010;
     m_nOffset[7] = n111 = n110 + n001;
+
+    const icUInt32Number tetra[6][6] = {
+      { n110, n010, n010, n000, n111, n110 },
+      { n111, n011, n011, n001, n001, n000 },
+      { n111, n011, n010, n000, n011, n010 },
+      { n101, n001, n111, n101, n001, n000 },
+      { n100, n000, n111, n101, n101, n100 },
+      { n100, n000, n110, n100, n111, n110 },
+    };
+    memset(m_nTetraOffset, 0, sizeof(m_nTetraOffset));
+    for (i = 0; i < 6; i++) {
+      for (int j = 0; j < 6; j++)
+        m_nTetraOffset[j][i] = tetra[i][j];
+    }
   }
   else if (m_nInput == 4) {
     m_nOffset[0] = 0;
@@ -2062,11 +2795,6 @@ void CIccCLUT::Begin()
   }
   else {
     //initialize ND interpolation variables
-    m_g = new icFloatNumber[m_nInput];
-    m_ig = new icUInt32Number[m_nInput];
-    m_s = new icFloatNumber[m_nInput];
-    m_df = new icFloatNumber[m_nNodes];
-
     m_nOffset[0] = 0;
     int count, nFlag;
     icUInt32Number nPower[2];
@@ -2138,48 +2866,295 @@ void CIccCLUT::Interp3dTetra(icFloatNumber* destPixel, const icFloatNumber* srcP
     t = 1.0;
   }
 
+  //Select the tetrahedron once for all output channels
+  int nTetra;
+  if (t < u) {
+    if (t > v)
+      nTetra = 0;
+    else if (u < v)
+      nTetra = 1;
+    else
+      nTetra = 2;
+  }
+  else {
+    if (t < v)
+      nTetra = 3;
+    else if (u < v)
+      nTetra = 4;
+    else
+      nTetra = 5;
+  }
+
+  icUInt32Number t1 = m_nTetraOffset[0][nTetra], t0 = m_nTetraOffset[1][nTetra];
+  icUInt32Number u1 = m_nTetraOffset[2][nTetra], u0 = m_nTetraOffset[3][nTetra];
+  icUInt32Number v1 = m_nTetraOffset[4][nTetra], v0 = m_nTetraOffset[5][nTetra];
+
   int i;
   icFloatNumber* p = &m_pData[ix * n001 + iy * n010 + iz * n100];
 
-  //Normalize grid units
-
   for (i = 0; i < m_nOutput; i++, p++) {
-    if (t < u) {
-      if (t > v) {
-        destPixel[i] = (p[n000] + t * (p[n110] - p[n010]) +
-          u * (p[n010] - p[n000]) +
-          v * (p[n111] - p[n110]));
-      }
-      else if (u < v) {
-        destPixel[i] = (p[n000] + t * (p[n111] - p[n011]) +
-          u * (p[n011] - p[n001]) +
-          v * (p[n001] - p[n000]));
-      }
-      else {
-        destPixel[i] = (p[n000] + t * (p[n111] - p[n011]) +
-          u * (p[n010] - p[n000]) +
-          v * (p[n011] - p[n010]));
-      }
+    destPixel[i] = (p[n000] + t * (p[t1] - p[t0]) +
+      u * (p[u1] - p[u0]) +
+      v * (p[v1] - p[v0]));
+  }
+}
+
+
+/**
+ ******************************************************************************
+  * Name: CIccCLUT::Interp3dTetraN
+  *
+  * Purpose: Tetrahedral interpolation of a run of pixels.  Uses the AVX2 or
+  *  SSE2 kernel when available and falls back to Interp3dTetra for the
+  *  remainder.  Results are identical to calling Interp3dTetra per pixel.
+  *
+  * Args:
+  *  destPixel = nPixels results of GetOutputChannels() values each,
+  *  srcPixel = nPixels input pixels of 3 values each (destPixel may only
+  *   share storage with srcPixel when there are no more than 3 outputs),
+  *  nPixels = number of pixels to interpolate
+  *******************************************************************************
+  */
+void CIccCLUT::Interp3dTetraN(icFloatNumber* destPixel, const icFloatNumber* srcPixel, icUInt32Number nPixels) const
+{
+  icUInt32Number nDone = 0;
+
+#ifdef ICC_USE_SSE2
+  //The vector kernels clip inline so they only apply to the default clip function
+  if (UnitClip == ClutUnitClip) {
+#ifdef ICC_USE_AVX2
+    if (icCpuHasAVX2())
+      nDone = Interp3dTetraAVX2(destPixel, srcPixel, nPixels);
+    else
+#endif
+      nDone = Interp3dTetraSSE2(destPixel, srcPixel, nPixels);
+  }
+#endif
+
+  srcPixel += nDone * 3;
+  destPixel += nDone * m_nOutput;
+
+  for (; nDone < nPixels; nDone++, srcPixel += 3, destPixel += m_nOutput) {
+    Interp3dTetra(destPixel, srcPixel);
+  }
+}
+
+
+#ifdef ICC_USE_SSE2
+static inline __m128i icMulLo32(__m128i a, __m128i b)
+{
+  __m128i even = _mm_mul_epu32(a, b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128 icSelect(__m128 mask, __m128 a, __m128 b)
+{
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+/**
+ ******************************************************************************
+  * Name: CIccCLUT::Interp3dTetraSSE2
+  *
+  * Purpose: SSE2 tetrahedral interpolation of four pixels at a time.  Grid
+  *  positions, weights and tetrahedron selection are computed as vectors,
+  *  the grid nodes are loaded per lane.
+  *
+  * Return: number of pixels processed (a multiple of 4)
+  *******************************************************************************
+  */
+icUInt32Number CIccCLUT::Interp3dTetraSSE2(icFloatNumber* destPixel, const icFloatNumber* srcPixel, icUInt32Number nPixels) const
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 mx = _mm_set1_ps((icFloatNumber)m_MaxGridPoint[0]);
+  const __m128 my = _mm_set1_ps((icFloatNumber)m_MaxGridPoint[1]);
+  const __m128 mz = _mm_set1_ps((icFloatNumber)m_MaxGridPoint[2]);
+  const __m128i imx = _mm_set1_epi32(m_MaxGridPoint[0]);
+  const __m128i imy = _mm_set1_epi32(m_MaxGridPoint[1]);
+  const __m128i imz = _mm_set1_epi32(m_MaxGridPoint[2]);
+  const __m128i dx = _mm_set1_epi32(n001);
+  const __m128i dy = _mm_set1_epi32(n010);
+  const __m128i dz = _mm_set1_epi32(n100);
+  const __m128i two = _mm_set1_epi32(2);
+  const __m128i three = _mm_set1_epi32(3);
+
+  icUInt32Number nBlocks = nPixels / 4;
+  icUInt32Number base[4], tetra[4], idx[6][4];
+  icFloatNumber r[4];
+  int i, j, k;
+
+  for (icUInt32Number b = 0; b < nBlocks; b++, srcPixel += 12, destPixel += 4 * m_nOutput) {
+    __m128 x = _mm_set_ps(srcPixel[9], srcPixel[6], srcPixel[3], srcPixel[0]);
+    __m128 y = _mm_set_ps(srcPixel[10], srcPixel[7], srcPixel[4], srcPixel[1]);
+    __m128 z = _mm_set_ps(srcPixel[11], srcPixel[8], srcPixel[5], srcPixel[2]);
+
+    x = _mm_mul_ps(_mm_min_ps(_mm_max_ps(x, zero), one), mx);
+    y = _mm_mul_ps(_mm_min_ps(_mm_max_ps(y, zero), one), my);
+    z = _mm_mul_ps(_mm_min_ps(_mm_max_ps(z, zero), one), mz);
+
+    __m128i ix = _mm_cvttps_epi32(x);
+    __m128i iy = _mm_cvttps_epi32(y);
+    __m128i iz = _mm_cvttps_epi32(z);
+
+    __m128 v = _mm_sub_ps(x, _mm_cvtepi32_ps(ix));
+    __m128 u = _mm_sub_ps(y, _mm_cvtepi32_ps(iy));
+    __m128 t = _mm_sub_ps(z, _mm_cvtepi32_ps(iz));
+
+    //Points on the last grid plane use the previous cell with a weight of 1
+    __m128i ex = _mm_cmpeq_epi32(ix, imx);
+    __m128i ey = _mm_cmpeq_epi32(iy, imy);
+    __m128i ez = _mm_cmpeq_epi32(iz, imz);
+    ix = _mm_add_epi32(ix, ex);
+    iy = _mm_add_epi32(iy, ey);
+    iz = _mm_add_epi32(iz, ez);
+    v = icSelect(_mm_castsi128_ps(ex), one, v);
+    u = icSelect(_mm_castsi128_ps(ey), one, u);
+    t = icSelect(_mm_castsi128_ps(ez), one, t);
+
+    __m128i pos = _mm_add_epi32(_mm_add_epi32(icMulLo32(ix, dx), icMulLo32(iy, dy)), icMulLo32(iz, dz));
+
+    //Same decision tree as Interp3dTetra yielding tetrahedron 0..5
+    __m128 tu = _mm_cmplt_ps(t, u);
+    __m128 first = icSelect(tu, _mm_cmpgt_ps(t, v), _mm_cmplt_ps(t, v));
+    __m128i uv = _mm_castps_si128(_mm_cmplt_ps(u, v));
+    __m128i sel = _mm_add_epi32(_mm_andnot_si128(_mm_castps_si128(tu), three),
+                                _mm_andnot_si128(_mm_castps_si128(first), _mm_add_epi32(two, uv)));
+
+    _mm_storeu_si128((__m128i*)base, pos);
+    _mm_storeu_si128((__m128i*)tetra, sel);
+
+    for (j = 0; j < 6; j++) {
+      for (k = 0; k < 4; k++)
+        idx[j][k] = base[k] + m_nTetraOffset[j][tetra[k]];
     }
-    else {
-      if (t < v) {
-        destPixel[i] = (p[n000] + t * (p[n101] - p[n001]) +
-          u * (p[n111] - p[n101]) +
-          v * (p[n001] - p[n000]));
-      }
-      else if (u < v) {
-        destPixel[i] = (p[n000] + t * (p[n100] - p[n000]) +
-          u * (p[n111] - p[n101]) +
-          v * (p[n101] - p[n100]));
-      }
-      else {
-        destPixel[i] = (p[n000] + t * (p[n100] - p[n000]) +
-          u * (p[n110] - p[n100]) +
-          v * (p[n111] - p[n110]));
-      }
+
+    for (i = 0; i < m_nOutput; i++) {
+      const icFloatNumber* p = m_pData + i;
+      __m128 val = _mm_set_ps(p[base[3]], p[base[2]], p[base[1]], p[base[0]]);
+      __m128 dt = _mm_sub_ps(_mm_set_ps(p[idx[0][3]], p[idx[0][2]], p[idx[0][1]], p[idx[0][0]]),
+                             _mm_set_ps(p[idx[1][3]], p[idx[1][2]], p[idx[1][1]], p[idx[1][0]]));
+      __m128 du = _mm_sub_ps(_mm_set_ps(p[idx[2][3]], p[idx[2][2]], p[idx[2][1]], p[idx[2][0]]),
+                             _mm_set_ps(p[idx[3][3]], p[idx[3][2]], p[idx[3][1]], p[idx[3][0]]));
+      __m128 dv = _mm_sub_ps(_mm_set_ps(p[idx[4][3]], p[idx[4][2]], p[idx[4][1]], p[idx[4][0]]),
+                             _mm_set_ps(p[idx[5][3]], p[idx[5][2]], p[idx[5][1]], p[idx[5][0]]));
+
+      val = _mm_add_ps(val, _mm_mul_ps(t, dt));
+      val = _mm_add_ps(val, _mm_mul_ps(u, du));
+      val = _mm_add_ps(val, _mm_mul_ps(v, dv));
+
+      _mm_storeu_ps(r, val);
+      for (k = 0; k < 4; k++)
+        destPixel[k * m_nOutput + i] = r[k];
+    }
+  }
+
+  return nBlocks * 4;
+}
+#endif
+
+
+#ifdef ICC_USE_AVX2
+/**
+ ******************************************************************************
+  * Name: CIccCLUT::Interp3dTetraAVX2
+  *
+  * Purpose: AVX2 tetrahedral interpolation of eight pixels at a time using
+  *  gathers for the source pixels and grid nodes.  Only called after
+  *  icCpuHasAVX2() has been checked.
+  *
+  * Return: number of pixels processed (a multiple of 8)
+  *******************************************************************************
+  */
+ICC_TARGET_AVX2 icUInt32Number CIccCLUT::Interp3dTetraAVX2(icFloatNumber* destPixel, const icFloatNumber* srcPixel, icUInt32Number nPixels) const
+{
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 mx = _mm256_set1_ps((icFloatNumber)m_MaxGridPoint[0]);
+  const __m256 my = _mm256_set1_ps((icFloatNumber)m_MaxGridPoint[1]);
+  const __m256 mz = _mm256_set1_ps((icFloatNumber)m_MaxGridPoint[2]);
+  const __m256i imx = _mm256_set1_epi32(m_MaxGridPoint[0]);
+  const __m256i imy = _mm256_set1_epi32(m_MaxGridPoint[1]);
+  const __m256i imz = _mm256_set1_epi32(m_MaxGridPoint[2]);
+  const __m256i dx = _mm256_set1_epi32(n001);
+  const __m256i dy = _mm256_set1_epi32(n010);
+  const __m256i dz = _mm256_set1_epi32(n100);
+  const __m256i two = _mm256_set1_epi32(2);
+  const __m256i three = _mm256_set1_epi32(3);
+  const __m256i src3 = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+
+  __m256i tab[6];
+  int i, j, k;
+
+  for (j = 0; j < 6; j++)
+    tab[j] = _mm256_loadu_si256((const __m256i*)m_nTetraOffset[j]);
+
+  icUInt32Number nBlocks = nPixels / 8;
+  icFloatNumber r[8];
+
+  for (icUInt32Number b = 0; b < nBlocks; b++, srcPixel += 24, destPixel += 8 * m_nOutput) {
+    __m256 x = _mm256_i32gather_ps(srcPixel, src3, 4);
+    __m256 y = _mm256_i32gather_ps(srcPixel + 1, src3, 4);
+    __m256 z = _mm256_i32gather_ps(srcPixel + 2, src3, 4);
+
+    x = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(x, zero), one), mx);
+    y = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(y, zero), one), my);
+    z = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(z, zero), one), mz);
+
+    __m256i ix = _mm256_cvttps_epi32(x);
+    __m256i iy = _mm256_cvttps_epi32(y);
+    __m256i iz = _mm256_cvttps_epi32(z);
+
+    __m256 v = _mm256_sub_ps(x, _mm256_cvtepi32_ps(ix));
+    __m256 u = _mm256_sub_ps(y, _mm256_cvtepi32_ps(iy));
+    __m256 t = _mm256_sub_ps(z, _mm256_cvtepi32_ps(iz));
+
+    __m256i ex = _mm256_cmpeq_epi32(ix, imx);
+    __m256i ey = _mm256_cmpeq_epi32(iy, imy);
+    __m256i ez = _mm256_cmpeq_epi32(iz, imz);
+    ix = _mm256_add_epi32(ix, ex);
+    iy = _mm256_add_epi32(iy, ey);
+    iz = _mm256_add_epi32(iz, ez);
+    v = _mm256_blendv_ps(v, one, _mm256_castsi256_ps(ex));
+    u = _mm256_blendv_ps(u, one, _mm256_castsi256_ps(ey));
+    t = _mm256_blendv_ps(t, one, _mm256_castsi256_ps(ez));
+
+    __m256i pos = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(ix, dx), _mm256_mullo_epi32(iy, dy)),
+                                   _mm256_mullo_epi32(iz, dz));
+
+    __m256 tu = _mm256_cmp_ps(t, u, _CMP_LT_OQ);
+    __m256 first = _mm256_blendv_ps(_mm256_cmp_ps(t, v, _CMP_LT_OQ), _mm256_cmp_ps(t, v, _CMP_GT_OQ), tu);
+    __m256i uv = _mm256_castps_si256(_mm256_cmp_ps(u, v, _CMP_LT_OQ));
+    __m256i sel = _mm256_add_epi32(_mm256_andnot_si256(_mm256_castps_si256(tu), three),
+                                   _mm256_andnot_si256(_mm256_castps_si256(first), _mm256_add_epi32(two, uv)));
+
+    __m256i idx[6];
+    for (j = 0; j < 6; j++)
+      idx[j] = _mm256_add_epi32(pos, _mm256_permutevar8x32_epi32(tab[j], sel));
+
+    for (i = 0; i < m_nOutput; i++) {
+      const icFloatNumber* p = m_pData + i;
+      __m256 val = _mm256_i32gather_ps(p, pos, 4);
+      __m256 dt = _mm256_sub_ps(_mm256_i32gather_ps(p, idx[0], 4), _mm256_i32gather_ps(p, idx[1], 4));
+      __m256 du = _mm256_sub_ps(_mm256_i32gather_ps(p, idx[2], 4), _mm256_i32gather_ps(p, idx[3], 4));
+      __m256 dv = _mm256_sub_ps(_mm256_i32gather_ps(p, idx[4], 4), _mm256_i32gather_ps(p, idx[5], 4));
+
+      val = _mm256_add_ps(val, _mm256_mul_ps(t, dt));
+      val = _mm256_add_ps(val, _mm256_mul_ps(u, du));
+      val = _mm256_add_ps(val, _mm256_mul_ps(v, dv));
+
+      _mm256_storeu_ps(r, val);
+      for (k = 0; k < 8; k++)
+        destPixel[k * m_nOutput + i] = r[k];
     }
   }
+
+  return nBlocks * 8;
 }
+#endif
 
 
 
@@ -2609,6 +3584,8 @@ void CIccCLUT::Interp6d(icFloatNumber* destPixel, const icFloatNumber* srcPixel)
   * Name: CIccCLUT::InterpND
   *
   * Purpose: Generic N-dimensional interpolation function
+  *  All temporary data is kept on the stack, so one CLUT can be
+  *  interpolated from several threads at the same time.
   *
   * Args:
   *  Pixel = Pixel value to be found in the CLUT. Also used to store the result.
@@ -2617,47 +3594,41 @@ void CIccCLUT::Interp6d(icFloatNumber* destPixel, const icFloatNumber* srcPixel)
 void CIccCLUT::InterpND(icFloatNumber* destPixel, const icFloatNumber* srcPixel) const
 {
   icUInt32Number i, j, index = 0;
+  icFloatNumber g, s[16], temp[16][2];
+  icUInt32Number ig;
 
   for (i = 0; i < m_nInput; i++) {
-    m_g[i] = UnitClip(srcPixel[i]) * m_MaxGridPoint[i];
-    m_ig[i] = (icUInt32Number)m_g[i];
-    m_s[m_nInput - 1 - i] = m_g[i] - m_ig[i];
-    if (m_ig[i] == m_MaxGridPoint[i]) {
-      m_ig[i]--;
-      m_s[m_nInput - 1 - i] = 1.0;
+    g = UnitClip(srcPixel[i]) * m_MaxGridPoint[i];
+    ig = (icUInt32Number)g;
+    s[m_nInput - 1 - i] = g - ig;
+    if (ig == m_MaxGridPoint[i]) {
+      ig--;
+      s[m_nInput - 1 - i] = 1.0;
     }
-    index += m_ig[i] * m_DimSize[i];
+    index += ig * m_DimSize[i];
   }
 
-  icFloatNumber* p = &m_pData[index];
-  icFloatNumber temp[2];
-  icFloatNumber pv;
-  int nFlag = 0;
-
-  for (i = 0; i < m_nNodes; i++) {
-    m_df[i] = 1.0;
+  for (i = 0; i < m_nInput; i++) {
+    temp[i][0] = (icFloatNumber)(1.0 - s[i]);
+    temp[i][1] = (icFloatNumber)(s[i]);
   }
 
+  const icFloatNumber* p = &m_pData[index];
+  icFloatNumber df;
 
-  for (i = 0; i < m_nInput; i++) {
-    temp[0] = (icFloatNumber)(1.0 - m_s[i]);
-    temp[1] = (icFloatNumber)(m_s[i]);
-    index = m_nPower[i];
-    for (j = 0; j < m_nNodes; j++) {
-      m_df[j] *= temp[nFlag];
-      if ((j + 1) % index == 0)
-        nFlag = !nFlag;
-    }
-    nFlag = 0;
-  }
+  //srcPixel is not used any more, so destPixel can be used as accumulator
+  for (i = 0; i < m_nOutput; i++)
+    destPixel[i] = 0;
 
-  for (i = 0; i < m_nOutput; i++, p++) {
-    for (pv = 0, j = 0; j < m_nNodes; j++)
-      pv += p[m_nOffset[j]] * m_df[j];
+  for (j = 0; j < m_nNodes; j++) {
+    df = 1.0;
+    for (i = 0; i < m_nInput; i++)
+      df *= temp[i][(j & m_nPower[i]) ? 1 : 0];
 
-    destPixel[i] = pv;
+    const icFloatNumber* pNode = p + m_nOffset[j];
+    for (i = 0; i < m_nOutput; i++)
+      destPixel[i] += pNode[i] * df;
   }
-
 }
 
 
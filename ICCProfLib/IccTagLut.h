@@ -90,9 +90,11 @@ namespace sampleICC {
 class ICCPROFLIB_API CIccCurve : public CIccTag
 {
 public:
-  CIccCurve() {}
+  CIccCurve() { m_pTable = NULL; m_nTableMax = 0; }
+  CIccCurve(const CIccCurve& curve);
+  CIccCurve& operator=(const CIccCurve& curve);
   virtual CIccTag* NewCopy() const { return new CIccCurve; }
-  virtual ~CIccCurve() {}
+  virtual ~CIccCurve();
 
   virtual void DumpLut(std::string& sDescription, const icChar* szName,
     icColorSpaceSignature csSig, int nIndex) {
@@ -100,6 +102,8 @@ public:
 
   virtual void Begin() {}
   virtual icFloatNumber Apply(icFloatNumber v) { return v; }
+  ///Applies the curve in place to nCount values that are nStride values apart
+  virtual void ApplyN(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride = 1);
 
   icFloatNumber Find(icFloatNumber v) { return Find(v, 0, Apply(0), 1.0, Apply(1.0)); }
   virtual bool IsIdentity() { return false; }
@@ -109,6 +113,24 @@ protected:
     icFloatNumber p0, icFloatNumber v0,
     icFloatNumber p1, icFloatNumber v1);
 
+  bool BeginTable();
+  ///Function sampled by BeginTable(), Apply() unless a curve tabulates one segment only
+  virtual icFloatNumber TableFunction(icFloatNumber v) { return Apply(v); }
+  ///Interpolated table value of v in 0..1
+  icFloatNumber TableLookup(icFloatNumber v) const
+  {
+    //the table size is a power of 2, so pos and its fraction are exact
+    icFloatNumber pos = v * m_nTableMax;
+    icUInt32Number nIndex = (icUInt32Number)pos;
+    icFloatNumber p0 = m_pTable[nIndex];
+
+    return p0 + (m_pTable[nIndex + 1] - p0) * (pos - nIndex);
+  }
+  void ApplyTableN(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride);
+
+  ///Apply() sampled at m_nTableMax + 1 even steps over 0..1 and the last value repeated (see BeginTable)
+  icFloatNumber* m_pTable;
+  icUInt32Number m_nTableMax;
 };
 typedef CIccCurve* LPIccCurve;
 
@@ -118,6 +140,16 @@ typedef enum {
   icInitIdentity,
 } icTagCurveSizeInit;
 
+/// Curve evaluation kernels picked by Begin() for ApplyN()
+typedef enum {
+  icCurveKernelGeneric,       //Apply() per value (Begin() not called yet)
+  icCurveKernelIdentity,      //values pass unchanged (or only clipped for curveType)
+  icCurveKernelGamma,         //pow(v, gamma)
+  icCurveKernelTable,         //sampled table with linear interpolation
+  icCurveKernelPiecewise,     //parametric types 1 to 4, a power segment above a threshold
+  icCurveKernelTabulated,     //gamma or power segment sampled by BeginTable(), within 2^-23 of Apply()
+} icCurveKernel;
+
 /**
 ****************************************************************************
 * Class: CIccTagCurve
@@ -150,15 +182,23 @@ public:
   void SetSize(icUInt32Number nSize, icTagCurveSizeInit nSizeOpt = icInitZero);
   void SetGamma(icFloatNumber gamma);
 
-  virtual void Begin() { m_nMaxIndex = (icUInt16Number)m_nSize - 1; }
+  virtual void Begin();
   virtual icFloatNumber Apply(icFloatNumber v);
+  virtual void ApplyN(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride = 1);
   virtual icValidateStatus Validate(icTagSignature sig, std::string& sReport, const CIccProfile* pProfile = NULL) const;
   virtual bool IsIdentity();
 
 protected:
+#ifdef ICC_USE_AVX2
+  ICC_TARGET_AVX2 icUInt32Number ApplyTableAVX2(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride) const;
+#endif
+
   icFloatNumber* m_Curve;
   icUInt32Number m_nSize;
   icUInt16Number m_nMaxIndex;
+
+  icCurveKernel m_nKernel;
+  icFloatNumber m_fGamma;
 };
 
 /**
@@ -196,16 +236,63 @@ public:
   icFloatNumber Param(int index) const { return m_dParam[index]; }
   icFloatNumber& operator[](int index) { return m_dParam[index]; }
 
+  virtual void Begin();
   virtual icFloatNumber Apply(icFloatNumber v) { return DoApply(v); }
+  virtual void ApplyN(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride = 1);
   virtual icValidateStatus Validate(icTagSignature sig, std::string& sReport, const CIccProfile* pProfile = NULL) const;
   virtual bool IsIdentity();
 
   icUInt16Number      m_nReserved2;
 protected:
+  friend class ICCPROFLIB_API CIccInvParametricCurve;
+
   icFloatNumber DoApply(icFloatNumber v) const;
+  virtual icFloatNumber TableFunction(icFloatNumber v);
   icUInt16Number      m_nFunctionType;
   icUInt16Number      m_nNumParam;
   icFloatNumber* m_dParam;
+
+  icCurveKernel m_nKernel;
+  double m_dThreshold;    //start of the power segment of the piecewise kernel
+};
+
+/**
+****************************************************************************
+* Class: CIccInvParametricCurve
+*
+* Purpose: Closed form inverse over 0..1 of an increasing parametricCurveType
+*  curve, used in place of a sampled inverse table.
+*****************************************************************************
+*/
+class ICCPROFLIB_API CIccInvParametricCurve : public CIccCurve
+{
+public:
+  virtual CIccTag* NewCopy() const { return new CIccInvParametricCurve(*this); }
+  virtual ~CIccInvParametricCurve() {}
+
+  virtual const icChar* GetClassName() const { return "CIccInvParametricCurve"; }
+
+  ///Returns a new inverse of pCurve (owned by caller), or NULL if it has no closed form inverse
+  static CIccInvParametricCurve* Create(CIccTagParametricCurve* pCurve);
+  ///Returns true if Create would give an inverse, the curve is not begun or tabulated
+  static bool IsInvertible(const CIccTagParametricCurve* pCurve);
+
+  virtual icFloatNumber Apply(icFloatNumber v);
+  virtual void ApplyN(icFloatNumber* pValues, icUInt32Number nCount, icUInt32Number nStride = 1);
+  virtual bool IsIdentity() { return m_bIdentity; }
+
+protected:
+  CIccInvParametricCurve() {}
+
+  static bool Solve(const CIccTagParametricCurve* pCurve, CIccInvParametricCurve* pInv);
+
+  //The forward curve is (a*X + b)^g + e for X >= d and c*X + f below d
+  double m_dInvGamma, m_dA, m_dB, m_dC, m_dD, m_dE, m_dF;
+
+  double m_dMin, m_dMax;          //curve values at 0 and 1
+  double m_dLinearEnd;            //end of the linear segment
+  double m_dPowerStart;           //start of the power segment (values in between map to d)
+  bool m_bIdentity;
 };
 
 
@@ -297,6 +384,7 @@ public:
 
   void Begin();
   void Interp3dTetra(icFloatNumber* destPixel, const icFloatNumber* srcPixel) const;
+  void Interp3dTetraN(icFloatNumber* destPixel, const icFloatNumber* srcPixel, icUInt32Number nPixels) const;
   void Interp3d(icFloatNumber* destPixel, const icFloatNumber* srcPixel) const;
   void Interp4d(icFloatNumber* destPixel, const icFloatNumber* srcPixel) const;
   void Interp5d(icFloatNumber* destPixel, const icFloatNumber* srcPixel) const;
@@ -314,6 +402,13 @@ protected:
   void Iterate(std::string& sDescription, icUInt8Number nIndex, icUInt32Number nPos, bool bUseLegacy = false);
   void SubIterate(IIccCLUTExec* pExec, icUInt8Number nIndex, icUInt32Number nPos);
 
+#ifdef ICC_USE_SSE2
+  icUInt32Number Interp3dTetraSSE2(icFloatNumber* destPixel, const icFloatNumber* srcPixel, icUInt32Number nPixels) const;
+#endif
+#ifdef ICC_USE_AVX2
+  ICC_TARGET_AVX2 icUInt32Number Interp3dTetraAVX2(icFloatNumber* destPixel, const icFloatNumber* srcPixel, icUInt32Number nPixels) const;
+#endif
+
   icCLUTCLIPFUNC UnitClip;
 
   icUInt8Number m_nReserved2[3];
@@ -338,11 +433,12 @@ protected:
   icUInt8Number m_MaxGridPoint[16];
   icUInt32Number n000, n001, n010, n011, n100, n101, n110, n111, n1000, n10000, n100000;
 
+  //Vertex offsets of the t, u and v terms for each of the six tetrahedra
+  //(indexed [term][tetrahedron], padded to 8 for SIMD table lookups)
+  icUInt32Number m_nTetraOffset[6][8];
+
   //ND Interpolation
   icUInt32Number* m_nOffset;
-  // Temporary ND Interp Variables
-  icFloatNumber* m_g, * m_s, * m_df;
-  icUInt32Number* m_ig;
   icUInt32Number m_nNodes, m_nPower[16];
 };
 
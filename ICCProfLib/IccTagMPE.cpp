@@ -147,6 +147,31 @@ CIccApplyMpe* CIccMultiProcessElement::GetNewApply( CIccApplyTagMpe *pApplyTag )
   return new CIccApplyMpe(this);
 }
 
+/**
+ ******************************************************************************
+ * Name: CIccMultiProcessElement::Apply
+ * 
+ * Purpose: Applies the element to nPixels packed pixels.  Elements that
+ *  have a block implementation override this, the default applies each
+ *  pixel in turn.
+ * 
+ * Args: 
+ *  pApply = apply object for the element,
+ *  pDestPixel = nPixels pixels of NumOutputChannels() values,
+ *  pSrcPixel = nPixels pixels of NumInputChannels() values,
+ *  nPixels = number of pixels
+ ******************************************************************************/
+void CIccMultiProcessElement::Apply(CIccApplyMpe *pApply, icFloatNumber *pDestPixel, const icFloatNumber *pSrcPixel, icUInt32Number nPixels) const
+{
+  icUInt16Number nSrc = NumInputChannels();
+  icUInt16Number nDst = NumOutputChannels();
+  icUInt32Number i;
+
+  for (i=0; i<nPixels; i++, pSrcPixel+=nSrc, pDestPixel+=nDst) {
+    Apply(pApply, pDestPixel, pSrcPixel);
+  }
+}
+
 
 /**
  ******************************************************************************
@@ -624,6 +649,7 @@ CIccApplyTagMpe::CIccApplyTagMpe(CIccTagMultiProcessElement *pTag)
 {
   m_pTag = pTag;
   m_list = NULL;
+  m_blockBuf = NULL;
 }
 
 
@@ -648,6 +674,43 @@ CIccApplyTagMpe::~CIccApplyTagMpe()
 
     delete m_list;
   }
+
+  if (m_blockBuf)
+    free(m_blockBuf);
+}
+
+
+/**
+******************************************************************************
+* Name: CIccApplyTagMpe::GetBlockBufs
+* 
+* Purpose: Gets the pair of buffers used by block Apply.  Each holds
+*  icMpeBlockPixels pixels of the largest element channel count.  They are
+*  allocated on first use so single pixel applies don't pay for them.
+* 
+* Args: 
+*  pBuf1, pBuf2 = receive the buffers
+* 
+* Return: 
+*  true if buffers are available
+******************************************************************************/
+bool CIccApplyTagMpe::GetBlockBufs(icFloatNumber *&pBuf1, icFloatNumber *&pBuf2)
+{
+  icUInt32Number nBufSize = icMpeBlockPixels * m_applyBuf.GetMaxChannels();
+
+  if (!m_blockBuf) {
+    if (!nBufSize)
+      return false;
+
+    m_blockBuf = (icFloatNumber*)malloc(2 * nBufSize * sizeof(icFloatNumber));
+    if (!m_blockBuf)
+      return false;
+  }
+
+  pBuf1 = m_blockBuf;
+  pBuf2 = m_blockBuf + nBufSize;
+
+  return true;
 }
 
 
@@ -1362,6 +1425,84 @@ void CIccTagMultiProcessElement::Apply(CIccApplyTagMpe *pApply, icFloatNumber *p
 }
 
 
+/**
+ ******************************************************************************
+ * Name: CIccTagMultiProcessElement::Apply
+ * 
+ * Purpose: Applies the element list to nPixels packed pixels.  Pixels are
+ *  pushed through the elements icMpeBlockPixels at a time so each element
+ *  gets its block Apply.  Elements are sequenced the same way as the single
+ *  pixel Apply.
+ * 
+ * Args: 
+ *  pApply = apply object from GetNewApply(),
+ *  pDestPixel = nPixels pixels of m_nOutputChannels values,
+ *  pSrcPixel = nPixels pixels of m_nInputChannels values (may be pDestPixel
+ *   if m_nOutputChannels <= m_nInputChannels),
+ *  nPixels = number of pixels
+ ******************************************************************************/
+void CIccTagMultiProcessElement::Apply(CIccApplyTagMpe *pApply, icFloatNumber *pDestPixel, const icFloatNumber *pSrcPixel, icUInt32Number nPixels) const
+{
+  if (!pApply || !pApply->GetList() || !pApply->GetList()->size()) {
+    if (pDestPixel!=pSrcPixel)
+      memmove(pDestPixel, pSrcPixel, nPixels*m_nInputChannels*sizeof(icFloatNumber));
+    return;
+  }
+
+  icFloatNumber *pBuf1, *pBuf2;
+  icUInt32Number n;
+
+  if (!pApply->GetBlockBufs(pBuf1, pBuf2)) {
+    for (n=0; n<nPixels; n++, pSrcPixel+=m_nInputChannels, pDestPixel+=m_nOutputChannels)
+      Apply(pApply, pDestPixel, pSrcPixel);
+    return;
+  }
+
+  CIccApplyMpeIter first = pApply->begin();
+  CIccApplyMpeIter last = pApply->end();
+  last--;
+
+  while (nPixels) {
+    icUInt32Number nBlock = nPixels < icMpeBlockPixels ? nPixels : icMpeBlockPixels;
+    icFloatNumber *pSrcBuf = pBuf1;
+    icFloatNumber *pDstBuf = pBuf2;
+
+    if (first==last) {
+      //Elements rely on pDestPixel != pSrcPixel
+      if (pSrcPixel==pDestPixel) {
+        first->ptr->Apply(pDstBuf, pSrcPixel, nBlock);
+        memcpy(pDestPixel, pDstBuf, nBlock*m_nOutputChannels*sizeof(icFloatNumber));
+      }
+      else {
+        first->ptr->Apply(pDestPixel, pSrcPixel, nBlock);
+      }
+    }
+    else {
+      CIccApplyMpeIter i = first;
+      icFloatNumber *tmp;
+
+      i->ptr->Apply(pDstBuf, pSrcPixel, nBlock);
+      tmp = pSrcBuf; pSrcBuf = pDstBuf; pDstBuf = tmp;
+
+      for (i++; i!=last; i++) {
+        CIccMultiProcessElement *pElem = i->ptr->GetElem();
+
+        if (!pElem->IsAcs()) {
+          i->ptr->Apply(pDstBuf, pSrcBuf, nBlock);
+          tmp = pSrcBuf; pSrcBuf = pDstBuf; pDstBuf = tmp;
+        }
+      }
+
+      i->ptr->Apply(pDestPixel, pSrcBuf, nBlock);
+    }
+
+    pSrcPixel += nBlock*m_nInputChannels;
+    pDestPixel += nBlock*m_nOutputChannels;
+    nPixels -= nBlock;
+  }
+}
+
+
 /**
  ******************************************************************************
  * Name: CIccTagMultiProcessElement::Validate
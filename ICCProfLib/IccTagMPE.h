@@ -118,6 +118,9 @@ typedef CIccMultiProcessElementList::iterator CIccMultiProcessElementIter;
 
 #define icSigMpeLevel0 ((icSignature)0x6D706530)  /* 'mpe0' */
 
+//Number of pixels passed through each element at a time by block Apply
+#define icMpeBlockPixels 64
+
 class CIccApplyMpePtr
 {
 public:
@@ -168,6 +171,7 @@ public:
 
   virtual CIccApplyMpe* GetNewApply(CIccApplyTagMpe *pApplyTag);
   virtual void Apply(CIccApplyMpe *pApply, icFloatNumber *pDestPixel, const icFloatNumber *pSrcPixel) const = 0;
+  virtual void Apply(CIccApplyMpe *pApply, icFloatNumber *pDestPixel, const icFloatNumber *pSrcPixel, icUInt32Number nPixels) const;
 
   virtual icValidateStatus Validate(icTagSignature sig, std::string &sReport, const CIccTagMultiProcessElement* pMPE=NULL) const = 0;
 
@@ -206,6 +210,7 @@ public:
   CIccMultiProcessElement *GetElem() const { return m_pElem; }
 
   void Apply(icFloatNumber *pDestPixel, const icFloatNumber *pSrcPixel) { m_pElem->Apply(this, pDestPixel, pSrcPixel); }
+  void Apply(icFloatNumber *pDestPixel, const icFloatNumber *pSrcPixel, icUInt32Number nPixels) { m_pElem->Apply(this, pDestPixel, pSrcPixel, nPixels); }
 
 protected:
   CIccApplyTagMpe *m_pApplyTag;
@@ -322,6 +327,9 @@ public:
   CIccDblPixelBuffer *GetBuf() { return &m_applyBuf; }
   CIccApplyMpeList *GetList() { return m_list; }
 
+  ///Gets two buffers of icMpeBlockPixels pixels for block Apply (allocated on first use)
+  bool GetBlockBufs(icFloatNumber *&pBuf1, icFloatNumber *&pBuf2);
+
   CIccApplyMpeIter begin() { return m_list->begin(); }
   CIccApplyMpeIter end() { return m_list->end(); }
 
@@ -333,6 +341,9 @@ protected:
 
   //Pixel data for Apply 
   CIccDblPixelBuffer m_applyBuf;
+
+  //Pixel data for block Apply
+  icFloatNumber *m_blockBuf;
 };
 
 /**
@@ -370,6 +381,7 @@ public:
   virtual CIccApplyTagMpe *GetNewApply();
 
   virtual void Apply(CIccApplyTagMpe *pApply, icFloatNumber *pDestPixel, const icFloatNumber *pSrcPixel) const;
+  virtual void Apply(CIccApplyTagMpe *pApply, icFloatNumber *pDestPixel, const icFloatNumber *pSrcPixel, icUInt32Number nPixels) const;
 
   virtual icValidateStatus Validate(icTagSignature sig, std::string &sReport, const CIccProfile* pProfile=NULL) const;
 
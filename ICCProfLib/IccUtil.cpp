@@ -78,6 +78,15 @@
 #include <math.h>
 #include <string.h>
 #include <time.h>
+#if (defined(ICC_USE_AVX2) || defined(ICC_USE_SSE41)) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#ifdef ICC_USE_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef ICC_USE_AVX2
+#include <immintrin.h>
+#endif
 
 #define PI 3.1415926535897932384626433832795
 
@@ -658,6 +667,228 @@ icUInt32Number icIntMax(icUInt32Number v1, icUInt32Number v2)
 }
 
 
+#if defined(ICC_USE_AVX2)
+static bool icDetectAVX2()
+{
+#if defined(_MSC_VER)
+  int info[4];
+
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+
+  //OSXSAVE and AVX, then make sure the OS saves the YMM state
+  __cpuid(info, 1);
+  if ((info[2] & 0x18000000) != 0x18000000)
+    return false;
+  if ((_xgetbv(0) & 0x6) != 0x6)
+    return false;
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & 0x20) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+bool icCpuHasAVX2()
+{
+#if defined(ICC_USE_AVX2)
+  static const bool bHasAVX2 = icDetectAVX2();
+  return bHasAVX2;
+#else
+  return false;
+#endif
+}
+
+
+#if defined(ICC_USE_SSE41)
+static bool icDetectSSE41()
+{
+#if defined(_MSC_VER)
+  int info[4];
+
+  __cpuid(info, 1);
+  return (info[2] & 0x80000) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.1") != 0;
+#endif
+}
+#endif
+
+bool icCpuHasSSE41()
+{
+#if defined(ICC_USE_SSE41)
+  static const bool bHasSSE41 = icDetectSSE41();
+  return bHasSSE41;
+#else
+  return false;
+#endif
+}
+
+
+//The vector kernels below swap bytes, so they are only used on little endian hosts
+#if defined(ICC_USE_SSE2) && defined(ICC_BYTE_ORDER_LITTLE_ENDIAN)
+#define ICC_USE_SIMD_SWAB
+#endif
+
+#ifdef ICC_USE_SIMD_SWAB
+static inline __m128i icSwab16SSE2(__m128i v)
+{
+  return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static inline __m128i icSwab32SSE2(__m128i v)
+{
+  v = icSwab16SSE2(v);
+  return _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+}
+
+#ifdef ICC_USE_AVX2
+static const char icSwab16Mask[32] = { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                       1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 };
+static const char icSwab32Mask[32] = { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                       3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 };
+
+ICC_TARGET_AVX2 static icInt32Number icBulkSwabAVX2(icUInt8Number* ptr, icInt32Number nBytes, const char* mask)
+{
+  const __m256i shuffle = _mm256_loadu_si256((const __m256i*)mask);
+  icInt32Number i;
+
+  for (i = 0; i + 32 <= nBytes; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(ptr + i));
+    _mm256_storeu_si256((__m256i*)(ptr + i), _mm256_shuffle_epi8(v, shuffle));
+  }
+
+  return i;
+}
+
+ICC_TARGET_AVX2 static icInt32Number icBulk16ToFloatAVX2(icFloatNumber* pDst, const icUInt8Number* pSrc, icInt32Number nNum)
+{
+  const __m256i shuffle = _mm256_loadu_si256((const __m256i*)icSwab16Mask);
+  const __m256 scale = _mm256_set1_ps(65535.0f);
+  icInt32Number i;
+
+  for (i = 0; i + 16 <= nNum; i += 16) {
+    __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(pSrc + 2 * i)), shuffle);
+    __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+    __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+
+    //float division by 65535 rounds the same as the double division of the scalar code
+    _mm256_storeu_ps(pDst + i, _mm256_div_ps(_mm256_cvtepi32_ps(lo), scale));
+    _mm256_storeu_ps(pDst + i + 8, _mm256_div_ps(_mm256_cvtepi32_ps(hi), scale));
+  }
+
+  return i;
+}
+#endif
+
+static icInt32Number icBulk16ToFloatSSE2(icFloatNumber* pDst, const icUInt8Number* pSrc, icInt32Number nNum)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128 scale = _mm_set1_ps(65535.0f);
+  icInt32Number i;
+
+  for (i = 0; i + 8 <= nNum; i += 8) {
+    __m128i v = icSwab16SSE2(_mm_loadu_si128((const __m128i*)(pSrc + 2 * i)));
+
+    _mm_storeu_ps(pDst + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), scale));
+    _mm_storeu_ps(pDst + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), scale));
+  }
+
+  return i;
+}
+#endif
+
+void icBulkSwab16(void* pVoid, icInt32Number nNum)
+{
+#ifdef ICC_BYTE_ORDER_LITTLE_ENDIAN
+  icUInt8Number* ptr = (icUInt8Number*)pVoid;
+  icInt32Number nBytes = nNum * 2, i = 0;
+
+#ifdef ICC_USE_SIMD_SWAB
+#ifdef ICC_USE_AVX2
+  if (icCpuHasAVX2())
+    i = icBulkSwabAVX2(ptr, nBytes, icSwab16Mask);
+#endif
+  for (; i + 16 <= nBytes; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(ptr + i));
+    _mm_storeu_si128((__m128i*)(ptr + i), icSwab16SSE2(v));
+  }
+#endif
+
+  icSwab16Array(ptr + i, (nBytes - i) / 2);
+#endif
+}
+
+void icBulkSwab32(void* pVoid, icInt32Number nNum)
+{
+#ifdef ICC_BYTE_ORDER_LITTLE_ENDIAN
+  icUInt8Number* ptr = (icUInt8Number*)pVoid;
+  icInt32Number nBytes = nNum * 4, i = 0;
+
+#ifdef ICC_USE_SIMD_SWAB
+#ifdef ICC_USE_AVX2
+  if (icCpuHasAVX2())
+    i = icBulkSwabAVX2(ptr, nBytes, icSwab32Mask);
+#endif
+  for (; i + 16 <= nBytes; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(ptr + i));
+    _mm_storeu_si128((__m128i*)(ptr + i), icSwab32SSE2(v));
+  }
+#endif
+
+  icSwab32Array(ptr + i, (nBytes - i) / 4);
+#endif
+}
+
+void icBulk16ToFloat(icFloatNumber* pDst, const void* pSrc16, icInt32Number nNum)
+{
+  const icUInt8Number* pSrc = (const icUInt8Number*)pSrc16;
+  icInt32Number i = 0;
+
+#ifdef ICC_USE_SIMD_SWAB
+#ifdef ICC_USE_AVX2
+  if (icCpuHasAVX2())
+    i = icBulk16ToFloatAVX2(pDst, pSrc, nNum);
+#endif
+  i += icBulk16ToFloatSSE2(pDst + i, pSrc + 2 * i, nNum - i);
+#endif
+
+  for (; i < nNum; i++) {
+    icUInt16Number tmp = (icUInt16Number)((pSrc[2 * i] << 8) | pSrc[2 * i + 1]);
+    pDst[i] = (icFloatNumber)((icFloatNumber)tmp / 65535.0);
+  }
+}
+
+void icBulk8ToFloat(icFloatNumber* pDst, const void* pSrc8, icInt32Number nNum)
+{
+  const icUInt8Number* pSrc = (const icUInt8Number*)pSrc8;
+  icInt32Number i = 0;
+
+#ifdef ICC_USE_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128 scale = _mm_set1_ps(255.0f);
+
+  for (; i + 16 <= nNum; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(pSrc + i));
+    __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+
+    _mm_storeu_ps(pDst + i, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+    _mm_storeu_ps(pDst + i + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+    _mm_storeu_ps(pDst + i + 8, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+    _mm_storeu_ps(pDst + i + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+  }
+#endif
+
+  for (; i < nNum; i++)
+    pDst[i] = (icFloatNumber)((icFloatNumber)pSrc[i] / 255.0);
+}
+
+
 void icLabFromPcs(icFloatNumber* Lab)
 {
   Lab[0] *= 100.0;
@@ -688,6 +919,167 @@ void icXyzToPcs(icFloatNumber* XYZ)
 }
 
 
+//cubeth() of arrays: the cube root is seeded from the exponent bits (a third of the float bit pattern plus
+//a bias is within 4%), refined by two float Newton steps and a last one in double that leaves it within
+//float rounding. Values at or below the threshold take the linear segment computed as in cubeth().
+#ifdef ICC_USE_SSE2
+#ifdef ICC_USE_AVX2
+ICC_TARGET_AVX2 static icInt32Number icCubethAVX2(icFloatNumber* v, icInt32Number nNum)
+{
+  const __m256 third = _mm256_set1_ps(1.0f / 3.0f), two = _mm256_set1_ps(2.0f);
+  const __m256i bias = _mm256_set1_epi32(0x2a5137a0);
+  const __m256d twod = _mm256_set1_pd(2.0), threed = _mm256_set1_pd(3.0);
+  const __m256d thresh = _mm256_set1_pd(0.008856);
+  const __m256d slope = _mm256_set1_pd(7.787037037037037037037037037037), offset = _mm256_set1_pd(16.0 / 116.0);
+  icInt32Number i;
+
+  for (i = 0; i + 8 <= nNum; i += 8) {
+    __m256 x = _mm256_loadu_ps(v + i);
+    __m256 y = _mm256_castsi256_ps(_mm256_add_epi32(_mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_castps_si256(x)), third)), bias));
+
+    y = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(two, y), _mm256_div_ps(x, _mm256_mul_ps(y, y))), third);
+    y = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(two, y), _mm256_div_ps(x, _mm256_mul_ps(y, y))), third);
+
+    __m128 res[2];
+    for (int h = 0; h < 2; h++) {
+      __m256d xd = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(x, 1) : _mm256_castps256_ps128(x));
+      __m256d yd = _mm256_cvtps_pd(h ? _mm256_extractf128_ps(y, 1) : _mm256_castps256_ps128(y));
+
+      yd = _mm256_div_pd(_mm256_add_pd(_mm256_mul_pd(twod, yd), _mm256_div_pd(xd, _mm256_mul_pd(yd, yd))), threed);
+      res[h] = _mm256_cvtpd_ps(_mm256_blendv_pd(_mm256_add_pd(_mm256_mul_pd(slope, xd), offset), yd,
+                                                _mm256_cmp_pd(xd, thresh, _CMP_GT_OQ)));
+    }
+
+    _mm256_storeu_ps(v + i, _mm256_insertf128_ps(_mm256_castps128_ps256(res[0]), res[1], 1));
+  }
+
+  return i;
+}
+#endif
+
+static icInt32Number icCubethSSE2(icFloatNumber* v, icInt32Number nNum)
+{
+  const __m128 third = _mm_set1_ps(1.0f / 3.0f), two = _mm_set1_ps(2.0f);
+  const __m128i bias = _mm_set1_epi32(0x2a5137a0);
+  const __m128d twod = _mm_set1_pd(2.0), threed = _mm_set1_pd(3.0);
+  const __m128d thresh = _mm_set1_pd(0.008856);
+  const __m128d slope = _mm_set1_pd(7.787037037037037037037037037037), offset = _mm_set1_pd(16.0 / 116.0);
+  icInt32Number i;
+
+  for (i = 0; i + 4 <= nNum; i += 4) {
+    __m128 x = _mm_loadu_ps(v + i);
+    __m128 y = _mm_castsi128_ps(_mm_add_epi32(_mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(_mm_castps_si128(x)), third)), bias));
+
+    y = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(two, y), _mm_div_ps(x, _mm_mul_ps(y, y))), third);
+    y = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(two, y), _mm_div_ps(x, _mm_mul_ps(y, y))), third);
+
+    __m128 res[2];
+    for (int h = 0; h < 2; h++) {
+      __m128d xd = _mm_cvtps_pd(h ? _mm_movehl_ps(x, x) : x);
+      __m128d yd = _mm_cvtps_pd(h ? _mm_movehl_ps(y, y) : y);
+
+      yd = _mm_div_pd(_mm_add_pd(_mm_mul_pd(twod, yd), _mm_div_pd(xd, _mm_mul_pd(yd, yd))), threed);
+
+      __m128d mask = _mm_cmpgt_pd(xd, thresh);
+      res[h] = _mm_cvtpd_ps(_mm_or_pd(_mm_and_pd(mask, yd),
+                                      _mm_andnot_pd(mask, _mm_add_pd(_mm_mul_pd(slope, xd), offset))));
+    }
+
+    _mm_storeu_ps(v + i, _mm_movelh_ps(res[0], res[1]));
+  }
+
+  return i;
+}
+#endif
+
+static void icCubethN(icFloatNumber* v, icInt32Number nNum)
+{
+  icInt32Number i = 0;
+
+#ifdef ICC_USE_SSE2
+#ifdef ICC_USE_AVX2
+  if (icCpuHasAVX2())
+    i = icCubethAVX2(v, nNum);
+#endif
+  i += icCubethSSE2(v + i, nNum - i);
+#endif
+
+  for (; i < nNum; i++)
+    v[i] = cubeth(v[i]);
+}
+
+void icXYZtoLabN(icFloatNumber* Lab, const icFloatNumber* XYZ, icUInt32Number nPixels, const icFloatNumber* WhiteXYZ /*=NULL*/)
+{
+  const icUInt32Number nBlock = 64;
+  icFloatNumber t[3 * nBlock];
+
+  if (!WhiteXYZ)
+    WhiteXYZ = icD50XYZ;
+
+  while (nPixels) {
+    icUInt32Number n = nPixels < nBlock ? nPixels : nBlock, i;
+
+    for (i = 0; i < 3 * n; i += 3) {
+      t[i] = XYZ[i] / WhiteXYZ[0];
+      t[i + 1] = XYZ[i + 1] / WhiteXYZ[1];
+      t[i + 2] = XYZ[i + 2] / WhiteXYZ[2];
+    }
+
+    icCubethN(t, 3 * n);
+
+    for (i = 0; i < 3 * n; i += 3) {
+      Lab[i] = (icFloatNumber)(116.0 * t[i + 1] - 16.0);
+      Lab[i + 1] = (icFloatNumber)(500.0 * (t[i] - t[i + 1]));
+      Lab[i + 2] = (icFloatNumber)(200.0 * (t[i + 1] - t[i + 2]));
+    }
+
+    Lab += 3 * n;
+    XYZ += 3 * n;
+    nPixels -= n;
+  }
+}
+
+void icLabtoXYZN(icFloatNumber* XYZ, const icFloatNumber* Lab, icUInt32Number nPixels, const icFloatNumber* WhiteXYZ /*=NULL*/)
+{
+  if (!WhiteXYZ)
+    WhiteXYZ = icD50XYZ;
+
+  for (; nPixels; nPixels--, XYZ += 3, Lab += 3) {
+    icFloatNumber fy = (icFloatNumber)((Lab[0] + 16.0) / 116.0);
+    icFloatNumber fx = (icFloatNumber)(Lab[1] / 500.0 + fy);
+    icFloatNumber fz = (icFloatNumber)(fy - Lab[2] / 200.0);
+
+    XYZ[0] = icubeth(fx) * WhiteXYZ[0];
+    XYZ[1] = icubeth(fy) * WhiteXYZ[1];
+    XYZ[2] = icubeth(fz) * WhiteXYZ[2];
+  }
+}
+
+void icLabFromPcsN(icFloatNumber* Lab, icUInt32Number nPixels)
+{
+  for (; nPixels; nPixels--, Lab += 3)
+    icLabFromPcs(Lab);
+}
+
+void icLabToPcsN(icFloatNumber* Lab, icUInt32Number nPixels)
+{
+  for (; nPixels; nPixels--, Lab += 3)
+    icLabToPcs(Lab);
+}
+
+void icXyzFromPcsN(icFloatNumber* XYZ, icUInt32Number nPixels)
+{
+  for (; nPixels; nPixels--, XYZ += 3)
+    icXyzFromPcs(XYZ);
+}
+
+void icXyzToPcsN(icFloatNumber* XYZ, icUInt32Number nPixels)
+{
+  for (; nPixels; nPixels--, XYZ += 3)
+    icXyzToPcs(XYZ);
+}
+
+
 #define DUMPBYTESPERLINE 16
 
 void icMemDump(std::string& sDump, void* pBuf, icUInt32Number nNum)
@@ -152,6 +152,16 @@ void ICCPROFLIB_API icLabToPcs(icFloatNumber* Lab);
 void ICCPROFLIB_API icXyzFromPcs(icFloatNumber* XYZ);
 void ICCPROFLIB_API icXyzToPcs(icFloatNumber* XYZ);
 
+/** Batch versions of the conversions above for nPixels packed 3 channel pixels, Dst may be the same as Src.
+ * icXYZtoLabN takes cube roots with SIMD kernels accurate to float precision, so Lab values may differ from
+ * icXYZtoLab (which uses cbrtf) in the last bit */
+void ICCPROFLIB_API icXYZtoLabN(icFloatNumber* Lab, const icFloatNumber* XYZ, icUInt32Number nPixels, const icFloatNumber* WhiteXYZ = NULL);
+void ICCPROFLIB_API icLabtoXYZN(icFloatNumber* XYZ, const icFloatNumber* Lab, icUInt32Number nPixels, const icFloatNumber* WhiteXYZ = NULL);
+void ICCPROFLIB_API icLabFromPcsN(icFloatNumber* Lab, icUInt32Number nPixels);
+void ICCPROFLIB_API icLabToPcsN(icFloatNumber* Lab, icUInt32Number nPixels);
+void ICCPROFLIB_API icXyzFromPcsN(icFloatNumber* XYZ, icUInt32Number nPixels);
+void ICCPROFLIB_API icXyzToPcsN(icFloatNumber* XYZ, icUInt32Number nPixels);
+
 
 void ICCPROFLIB_API icMemDump(std::string& sDump, void* pBuf, icUInt32Number nNum);
 void ICCPROFLIB_API icMatrixDump(std::string& sDump, icS15Fixed16Number* pMatrix);
@@ -161,6 +171,17 @@ ICCPROFLIB_API const icChar* icGetSigStr(icChar* pBuf, icUInt32Number nSig);
 icUInt32Number ICCPROFLIB_API icGetSigVal(const icChar* pBuf);
 icUInt32Number ICCPROFLIB_API icGetSpaceSamples(icColorSpaceSignature sig);
 
+/** Run time CPU feature checks used to select SIMD kernels (results are cached) */
+bool ICCPROFLIB_API icCpuHasAVX2();
+bool ICCPROFLIB_API icCpuHasSSE41();
+
+/** Bulk conversions of big endian (ICC encoded) arrays used by the CIccIO readers.
+ * Results are identical to the per element code (icSwab16/32, v/65535.0, v/255.0) */
+void ICCPROFLIB_API icBulkSwab16(void* pVoid, icInt32Number nNum);
+void ICCPROFLIB_API icBulkSwab32(void* pVoid, icInt32Number nNum);
+void ICCPROFLIB_API icBulk16ToFloat(icFloatNumber* pDst, const void* pSrc16, icInt32Number nNum);
+void ICCPROFLIB_API icBulk8ToFloat(icFloatNumber* pDst, const void* pSrc8, icInt32Number nNum);
+
 ICCPROFLIB_API extern const char* icValidateWarningMsg;
 ICCPROFLIB_API extern const char* icValidateNonCompliantMsg;
 ICCPROFLIB_API extern const char* icValidateCriticalErrorMsg;
@@ -12,6 +12,7 @@
 #include "ICCProfLib/IccPrmg.h"
 
 #include "qubyxprofilechain.h"
+#include "qubyxprofilecache.h"
 
 #include <algorithm>
 #include <cmath>
@@ -434,37 +435,103 @@ void QubyxProfile::fillParamCurveTagLinear(CIccTagParametricCurve* curve)
 
 bool QubyxProfile::LoadFromFile()
 {
-    CIccFileIO in;
-    bool isOpen = false;
-    isOpen = in.Open(filename_.c_str(), "r");
+    //parsed profiles are shared through the process-wide cache, copying is much cheaper than Read
+    QubyxProfileCache::ProfilePtr cached = QubyxProfileCache::load(filename_);
+    if (!cached)
+        return false;
 
-    if (isOpen) 
-    {
-        bool res = profile_.Read(&in);
-        in.Close();
+    profile_ = *cached;
 
-        inColorSpace_ = profile_.m_Header.colorSpace;
-        outColorSpace_ = profile_.m_Header.pcs;
+    inColorSpace_ = profile_.m_Header.colorSpace;
+    outColorSpace_ = profile_.m_Header.pcs;
 
-        spec_ = (profile_.m_Header.version < icVersionNumberV4) ? ICCSpec::ICCv2 : ICCSpec::ICCv4;
+    spec_ = (profile_.m_Header.version < icVersionNumberV4) ? ICCSpec::ICCv2 : ICCSpec::ICCv4;
 
-        return res;
+    return true;
+}
+
+bool QubyxProfile::LoadFromMappedFile()
+{
+    CIccMappedIO in;
+    if (!in.Open(filename_.c_str()))
+        return false;
+
+    if (!profile_.Read(&in))
+        return false;
+
+    inColorSpace_ = profile_.m_Header.colorSpace;
+    outColorSpace_ = profile_.m_Header.pcs;
+
+    spec_ = (profile_.m_Header.version < icVersionNumberV4) ? ICCSpec::ICCv2 : ICCSpec::ICCv4;
+
+    return true;
+}
+
+bool QubyxProfile::LoadFromFileLazy()
+{
+    CIccMappedIO* in = new CIccMappedIO;
+    if (!in->Open(filename_.c_str()))
+    {
+        delete in;
+        return false;
     }
-    else {
+
+    //attached profile owns the IO
+    if (!profile_.Attach(in))
+    {
+        delete in;
         return false;
     }
+
+    inColorSpace_ = profile_.m_Header.colorSpace;
+    outColorSpace_ = profile_.m_Header.pcs;
+
+    spec_ = (profile_.m_Header.version < icVersionNumberV4) ? ICCSpec::ICCv2 : ICCSpec::ICCv4;
+
+    return true;
+}
+
+void QubyxProfile::prefetchTags(icRenderingIntent intent) const
+{
+    if (intent == icUnknownIntent)
+        intent = icPerceptual;
+
+    //same lookups as CIccXform::Create does, intent specific tag first and then its fallbacks
+    const icSignature luts[] = { icSigAToB0Tag, icSigBToA0Tag, icSigDToB0Tag, icSigBToD0Tag };
+    for (icSignature lut : luts)
+    {
+        profile_.FindTag(lut + intent);
+        profile_.FindTag(lut + icRelativeColorimetric);
+        profile_.FindTag(lut);
+    }
+
+    const icSignature tags[] = {
+        icSigRedMatrixColumnTag, icSigGreenMatrixColumnTag, icSigBlueMatrixColumnTag,
+        icSigRedTRCTag, icSigGreenTRCTag, icSigBlueTRCTag, icSigGrayTRCTag,
+        icSigMediaWhitePointTag, icSigChromaticAdaptationTag, icSigLuminanceTag
+    };
+    for (icSignature tag : tags)
+        profile_.FindTag(tag);
+
+    if (profile_.m_Header.deviceClass == icSigNamedColorClass)
+        profile_.FindTag(icSigNamedColor2Tag);
 }
 
-bool QubyxProfile::LoadFromMemory(unsigned char* buf, size_t size)
+bool QubyxProfile::LoadFromMemory(const unsigned char* buf, size_t size)
 {
-    CIccMemIO in;
-    in.Attach(buf, size, false);
-    bool res = profile_.Read(&in);
+    //same content as an already loaded file or buffer is not parsed again
+    QubyxProfileCache::ProfilePtr cached = QubyxProfileCache::load(buf, size);
+    if (!cached)
+        return false;
+
+    profile_ = *cached;
 
     inColorSpace_ = profile_.m_Header.colorSpace;
     outColorSpace_ = profile_.m_Header.pcs;
 
-    return res;
+    spec_ = (profile_.m_Header.version < icVersionNumberV4) ? ICCSpec::ICCv2 : ICCSpec::ICCv4;
+
+    return true;
 }
 
 bool QubyxProfile::SaveToMemory(unsigned char*& buf, size_t& size)
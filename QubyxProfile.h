@@ -159,7 +159,31 @@ public:
     // ProfileCLUT_Equidistant getBToATag(icTagSignature signature);
 
     bool LoadFromFile();
-    bool LoadFromMemory(unsigned char* buf, size_t size);
+    /**
+     * Parses the profile directly from the memory mapped file, bypassing the profile cache
+     * (see QubyxProfileCache). Intended for big one-off profiles that shouldn't be kept in memory.
+     * @return false if the file can't be mapped or parsed
+     */
+    bool LoadFromMappedFile();
+    /**
+     * Lazy load mode. Only the header and the tag directory are read, the memory mapped file stays
+     * attached and every tag is parsed on first access (FindTag). Tags that are never used (descriptions,
+     * dictionaries, embedded previews) are never parsed.
+     * Copies of the profile (copy constructor, CIccCmm::AddXform) only get already loaded tags,
+     * so call prefetchTags first (QubyxProfileChain::addProfile does it for its intent).
+     * @return false if the file can't be mapped or isn't a profile
+     */
+    bool LoadFromFileLazy();
+    /**
+     * Loads the tags a color transform with the given intent needs (AToB/BToA/DToB/BToD, matrix/TRC,
+     * white point, chad and lumi). Does nothing for tags that are already loaded or not present.
+     */
+    void prefetchTags(icRenderingIntent intent) const;
+    /**
+     * Loads the profile from a buffer through the profile cache, the buffer is not kept
+     * @return false if the data can't be parsed
+     */
+    bool LoadFromMemory(const unsigned char* buf, size_t size);
     bool SaveToMemory(unsigned char*& buf, size_t& size);
 
     /**
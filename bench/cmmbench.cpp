@@ -0,0 +1,330 @@
+/*
+ * Author: QUBYX Software Technologies LTD HK
+ * Copyright: QUBYX Software Technologies LTD HK
+ */
+
+/*
+ * Micro-benchmark of CIccApplyCmm on 2 and 3 profile chains. Profiles are built in memory, so the numbers
+ * don't depend on files: matrix/TRC RGB profiles with parametric, table and gamma curves (XYZ PCS) and LUT based
+ * RGB profiles with Lab PCS in v4 (lutAtoB/lutBtoA) and v2 (lut16) encoding.
+ *
+ * Prints the best time of several runs in ns per pixel for the per-pixel and the batch Apply.
+ * Run it on two revisions to compare them: build.bat bench, then bin\cmmbench.exe [runs].
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../ICCProfLib/IccCmm.h"
+#include "../ICCProfLib/IccProfile.h"
+#include "../ICCProfLib/IccTagBasic.h"
+#include "../ICCProfLib/IccTagLut.h"
+#include "../ICCProfLib/IccUtil.h"
+
+namespace
+{
+    const int pixelCount = 4096;
+    const int repeats = 20;
+
+    //linear RGB -> XYZ (D50)
+    const double rgbToXyz[9] = { 0.4361, 0.3851, 0.1431, 0.2225, 0.7169, 0.0606, 0.0139, 0.0971, 0.7141 };
+
+    enum class Trc
+    {
+        Parametric,     //sRGB, function type 3
+        Table,          //1024 entries
+        Gamma           //single gamma value
+    };
+
+    enum class LabLut
+    {
+        V4,             //lutAtoB/lutBtoA
+        V2              //lut16, legacy Lab encoding
+    };
+
+    void setXyz(CIccProfile* profile, icTagSignature sig, double X, double Y, double Z)
+    {
+        CIccTagXYZ* tag = new CIccTagXYZ;
+        (*tag)[0].X = icDtoF((icFloatNumber)X);
+        (*tag)[0].Y = icDtoF((icFloatNumber)Y);
+        (*tag)[0].Z = icDtoF((icFloatNumber)Z);
+        profile->AttachTag(sig, tag);
+    }
+
+    CIccProfile* newProfile(icColorSpaceSignature pcs, bool v4)
+    {
+        CIccProfile* profile = new CIccProfile;
+        profile->InitHeader();
+        profile->m_Header.deviceClass = icSigDisplayClass;
+        profile->m_Header.colorSpace = icSigRgbData;
+        profile->m_Header.pcs = pcs;
+        profile->m_Header.version = v4 ? icVersionNumberV4 : 0x02100000;
+        setXyz(profile, icSigMediaWhitePointTag, 0.9642, 1.0, 0.8249);
+        return profile;
+    }
+
+    CIccProfile* matrixTrcProfile(Trc trc)
+    {
+        CIccProfile* profile = newProfile(icSigXYZData, trc == Trc::Parametric);
+        setXyz(profile, icSigRedMatrixColumnTag, rgbToXyz[0], rgbToXyz[3], rgbToXyz[6]);
+        setXyz(profile, icSigGreenMatrixColumnTag, rgbToXyz[1], rgbToXyz[4], rgbToXyz[7]);
+        setXyz(profile, icSigBlueMatrixColumnTag, rgbToXyz[2], rgbToXyz[5], rgbToXyz[8]);
+
+        const icTagSignature trcTags[3] = { icSigRedTRCTag, icSigGreenTRCTag, icSigBlueTRCTag };
+        for (int c = 0; c < 3; c++)
+        {
+            if (trc == Trc::Parametric)
+            {
+                CIccTagParametricCurve* curve = new CIccTagParametricCurve;
+                curve->SetFunctionType(3);
+                (*curve)[0] = 2.4f;
+                (*curve)[1] = (icFloatNumber)(1 / 1.055);
+                (*curve)[2] = (icFloatNumber)(0.055 / 1.055);
+                (*curve)[3] = (icFloatNumber)(1 / 12.92);
+                (*curve)[4] = 0.04045f;
+                profile->AttachTag(trcTags[c], curve);
+            }
+            else if (trc == Trc::Table)
+            {
+                CIccTagCurve* curve = new CIccTagCurve(1024);
+                for (int i = 0; i < 1024; i++)
+                    (*curve)[i] = (icFloatNumber)pow(i / 1023.0, 2.3 + 0.1 * c);
+                profile->AttachTag(trcTags[c], curve);
+            }
+            else
+            {
+                CIccTagCurve* curve = new CIccTagCurve(1);
+                curve->SetGamma(2.2f);
+                profile->AttachTag(trcTags[c], curve);
+            }
+        }
+
+        return profile;
+    }
+
+    CIccTagCurve* gammaTable(double gamma)
+    {
+        CIccTagCurve* curve = new CIccTagCurve(256);
+        for (int i = 0; i < 256; i++)
+            (*curve)[i] = (icFloatNumber)pow(i / 255.0, gamma);
+        return curve;
+    }
+
+    CIccTagCurve* identityCurve()
+    {
+        CIccTagCurve* curve = new CIccTagCurve(2);
+        (*curve)[0] = 0;
+        (*curve)[1] = 1;
+        return curve;
+    }
+
+    /** linear RGB -> Lab in PCS encoding */
+    void rgbToLabPcs(const double* rgb, bool legacy, icFloatNumber* lab)
+    {
+        icFloatNumber xyz[3];
+        for (int i = 0; i < 3; i++)
+            xyz[i] = (icFloatNumber)(rgbToXyz[3 * i] * rgb[0] + rgbToXyz[3 * i + 1] * rgb[1] + rgbToXyz[3 * i + 2] * rgb[2]);
+
+        icXYZtoLab(lab, xyz);
+        icLabToPcs(lab);
+        if (legacy)
+        {
+            for (int i = 0; i < 3; i++)
+                lab[i] = (icFloatNumber)(lab[i] * 65280.0 / 65535.0);
+        }
+    }
+
+    /** Lab in PCS encoding -> linear RGB, clipped to 0..1 */
+    void labPcsToRgb(const double* pcs, bool legacy, const icFloatNumber* xyzToRgb, icFloatNumber* rgb)
+    {
+        icFloatNumber lab[3], xyz[3];
+        for (int i = 0; i < 3; i++)
+            lab[i] = (icFloatNumber)(legacy ? pcs[i] * 65535.0 / 65280.0 : pcs[i]);
+
+        icLabFromPcs(lab);
+        icLabtoXYZ(xyz, lab);
+        for (int i = 0; i < 3; i++)
+        {
+            const double v = xyzToRgb[3 * i] * xyz[0] + xyzToRgb[3 * i + 1] * xyz[1] + xyzToRgb[3 * i + 2] * xyz[2];
+            rgb[i] = (icFloatNumber)std::min(std::max(v, 0.0), 1.0);
+        }
+    }
+
+    void fillToLab(CIccCLUT* clut, int grid, bool legacy)
+    {
+        int n = 0;
+        for (int r = 0; r < grid; r++)
+            for (int g = 0; g < grid; g++)
+                for (int b = 0; b < grid; b++, n += 3)
+                {
+                    const double rgb[3] = { r / (grid - 1.0), g / (grid - 1.0), b / (grid - 1.0) };
+                    rgbToLabPcs(rgb, legacy, &(*clut)[n]);
+                }
+    }
+
+    void fillFromLab(CIccCLUT* clut, int grid, bool legacy)
+    {
+        icFloatNumber xyzToRgb[9];
+        for (int i = 0; i < 9; i++)
+            xyzToRgb[i] = (icFloatNumber)rgbToXyz[i];
+        icMatrixInvert3x3(xyzToRgb);
+
+        int n = 0;
+        for (int l = 0; l < grid; l++)
+            for (int a = 0; a < grid; a++)
+                for (int b = 0; b < grid; b++, n += 3)
+                {
+                    const double pcs[3] = { l / (grid - 1.0), a / (grid - 1.0), b / (grid - 1.0) };
+                    labPcsToRgb(pcs, legacy, xyzToRgb, &(*clut)[n]);
+                }
+    }
+
+    CIccProfile* labLutProfile(LabLut kind)
+    {
+        const bool legacy = (kind == LabLut::V2);
+        CIccProfile* profile = newProfile(icSigLabData, !legacy);
+
+        if (legacy)
+        {
+            CIccTagLut16* toLab = new CIccTagLut16;
+            toLab->Init(3, 3);
+            toLab->SetColorSpaces(icSigRgbData, icSigLabData);
+            LPIccCurve* input = toLab->NewCurvesB();
+            LPIccCurve* output = toLab->NewCurvesA();
+            for (int c = 0; c < 3; c++)
+            {
+                input[c] = gammaTable(2.2);
+                output[c] = identityCurve();
+            }
+            fillToLab(toLab->NewCLUT(17), 17, true);
+            profile->AttachTag(icSigAToB0Tag, toLab);
+
+            CIccTagLut16* fromLab = new CIccTagLut16;
+            fromLab->Init(3, 3);
+            fromLab->SetColorSpaces(icSigLabData, icSigRgbData);
+            input = fromLab->NewCurvesB();
+            output = fromLab->NewCurvesA();
+            for (int c = 0; c < 3; c++)
+            {
+                input[c] = identityCurve();
+                output[c] = gammaTable(1 / 2.2);
+            }
+            fillFromLab(fromLab->NewCLUT(33), 33, true);
+            profile->AttachTag(icSigBToA0Tag, fromLab);
+        }
+        else
+        {
+            CIccTagLutAtoB* toLab = new CIccTagLutAtoB;
+            toLab->Init(3, 3);
+            toLab->SetColorSpaces(icSigRgbData, icSigLabData);
+            LPIccCurve* a = toLab->NewCurvesA();
+            LPIccCurve* b = toLab->NewCurvesB();
+            for (int c = 0; c < 3; c++)
+            {
+                a[c] = gammaTable(2.2);
+                b[c] = identityCurve();
+            }
+            fillToLab(toLab->NewCLUT(17), 17, false);
+            profile->AttachTag(icSigAToB0Tag, toLab);
+
+            CIccTagLutBtoA* fromLab = new CIccTagLutBtoA;
+            fromLab->Init(3, 3);
+            fromLab->SetColorSpaces(icSigLabData, icSigRgbData);
+            b = fromLab->NewCurvesB();
+            a = fromLab->NewCurvesA();
+            for (int c = 0; c < 3; c++)
+            {
+                b[c] = identityCurve();
+                a[c] = gammaTable(1 / 2.2);
+            }
+            fillFromLab(fromLab->NewCLUT(33), 33, false);
+            profile->AttachTag(icSigBToA0Tag, fromLab);
+        }
+
+        return profile;
+    }
+
+    struct Chain
+    {
+        const char* name;
+        CIccProfile* (*profiles[3])();
+    };
+
+    CIccProfile* parametric() { return matrixTrcProfile(Trc::Parametric); }
+    CIccProfile* table() { return matrixTrcProfile(Trc::Table); }
+    CIccProfile* gamma() { return matrixTrcProfile(Trc::Gamma); }
+    CIccProfile* labV4() { return labLutProfile(LabLut::V4); }
+    CIccProfile* labV2() { return labLutProfile(LabLut::V2); }
+
+    /**
+     * @return best ns per pixel of the per-pixel (perPixel) or batch Apply, negative if the chain can't be linked
+     */
+    double measure(const Chain& chain, bool perPixel, int runs)
+    {
+        CIccCmm cmm(icSigUnknownData, icSigUnknownData, true);
+        for (int i = 0; i < 3 && chain.profiles[i]; i++)
+        {
+            if (cmm.AddXform(chain.profiles[i](), icPerceptual) != icCmmStatOk)
+                return -1;
+        }
+        if (cmm.Begin() != icCmmStatOk)
+            return -1;
+
+        const int srcSamples = cmm.GetSourceSamples(), dstSamples = cmm.GetDestSamples();
+        std::vector<icFloatNumber> src(pixelCount * srcSamples), dst(pixelCount * dstSamples);
+        srand(1);
+        for (size_t i = 0; i < src.size(); i++)
+            src[i] = (icFloatNumber)rand() / RAND_MAX;
+
+        double best = 1e30;
+        for (int run = 0; run < runs; run++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            for (int k = 0; k < repeats; k++)
+            {
+                if (perPixel)
+                {
+                    for (int i = 0; i < pixelCount; i++)
+                        cmm.Apply(&dst[i * dstSamples], &src[i * srcSamples]);
+                }
+                else
+                    cmm.Apply(&dst[0], &src[0], pixelCount);
+            }
+            const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            best = std::min(best, ns / pixelCount / repeats);
+        }
+
+        return best;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const int runs = (argc > 1) ? std::max(atoi(argv[1]), 1) : 40;
+
+    const Chain chains[] = {
+        { "RGB > RGB (XYZ PCS)",        { parametric, table, nullptr } },
+        { "RGB > Lab v4 profile",       { parametric, labV4, nullptr } },
+        { "Lab v2 profile > RGB",       { labV2, parametric, nullptr } },
+        { "RGB > RGB > RGB",            { parametric, table, gamma } },
+        { "RGB > Lab v4 > RGB",         { parametric, labV4, table } },
+        { "Lab v4 > Lab v2 > RGB",      { labV4, labV2, parametric } },
+    };
+
+    printf("%-28s %12s %12s\n", "ns/pixel, best of runs", "per pixel", "batch");
+    for (const Chain& chain : chains)
+    {
+        const double perPixel = measure(chain, true, runs);
+        const double batch = measure(chain, false, runs);
+        if (perPixel < 0 || batch < 0)
+            printf("%-28s %12s %12s\n", chain.name, "failed", "failed");
+        else
+            printf("%-28s %12.1f %12.1f\n", chain.name, perPixel, batch);
+    }
+
+    return 0;
+}
@@ -28,6 +28,9 @@ REM Clean up old object files
 del obj\*.obj 2>nul
 del *.obj 2>nul
 
+REM "build.bat bench" builds the CMM micro-benchmark instead of the library
+if /I "%1"=="bench" goto bench
+
 REM Compile all source files
 echo Compiling source files...
 cl /LD /std:c++14 /EHsc /O2 /W3 /D_CRT_SECURE_NO_WARNINGS /DWINDOWS_IGNORE_PACKING_MISMATCH /DNOMINMAX ^
@@ -35,6 +38,12 @@ cl /LD /std:c++14 /EHsc /O2 /W3 /D_CRT_SECURE_NO_WARNINGS /DWINDOWS_IGNORE_PACKI
     qubyx3dlutgenerator.cpp ^
     QubyxProfile.cpp ^
     qubyxprofilechain.cpp ^
+    qubyxprofilecache.cpp ^
+    qubyxchaincache.cpp ^
+    qubyxlutwriter.cpp ^
+    qubyxadaptivegrid.cpp ^
+    qubyxjobpool.cpp ^
+    qubyxlutapply.cpp ^
     ICCProfLib\*.cpp ^
     /Fe:bin\Qubyx3DLUTGenerator.dll ^
     /link /SUBSYSTEM:WINDOWS /DEF:Qubyx3DLUTGenerator.def
@@ -65,3 +74,22 @@ if %errorlevel% equ 0 (
 echo.
 echo Build script completed.
 pause
+exit /b 0
+
+:bench
+echo Compiling CMM benchmark...
+cl /std:c++14 /EHsc /O2 /W3 /D_CRT_SECURE_NO_WARNINGS /DWINDOWS_IGNORE_PACKING_MISMATCH /DNOMINMAX ^
+    /Foobj\ ^
+    bench\cmmbench.cpp ^
+    ICCProfLib\*.cpp ^
+    /Fe:bin\cmmbench.exe
+
+if %errorlevel% neq 0 (
+    echo ERROR: Compilation failed
+    pause
+    exit /b 1
+)
+
+echo.
+echo Run bin\cmmbench.exe [runs] to measure ns per pixel of 2 and 3 profile chains
+pause
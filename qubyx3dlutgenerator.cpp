@@ -5,11 +5,778 @@
 
 #include "qubyx3dlutgenerator.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "QubyxProfile.h"
+#include "qubyxadaptivegrid.h"
+#include "qubyxchaincache.h"
+#include "qubyxjobpool.h"
+#include "qubyxlutapply.h"
+#include "qubyxlutwriter.h"
+#include "qubyxprofilecache.h"
 #include "qubyxprofilechain.h"
 
+struct Q3dLut_Chain
+{
+    QubyxChainCache::ChainPtr chain;
+};
+
+struct Q3dLut_Job
+{
+    QubyxJobPool::JobPtr job;
+};
+
+struct Q3dLut_Applier
+{
+    std::unique_ptr<QubyxLutApply> lut;
+};
+
+namespace
+{
+    /**
+     * Converts float to IEEE 754 half precision, rounding to nearest even.
+     */
+    uint16_t toHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+
+        const uint16_t sign = (bits >> 16) & 0x8000;
+        const uint32_t absBits = bits & 0x7fffffff;
+
+        if (absBits >= 0x7f800000) //inf or nan
+            return sign | 0x7c00 | (absBits > 0x7f800000 ? 0x200 : 0);
+        if (absBits >= 0x477ff000) //rounds above the biggest half
+            return sign | 0x7c00;
+        if (absBits < 0x38800000) //half denormals and zero
+        {
+            if (absBits < 0x33000000)
+                return sign;
+
+            const uint32_t mantissa = (absBits & 0x7fffff) | 0x800000;
+            const int shift = 126 - (absBits >> 23);
+            uint32_t half = mantissa >> shift;
+            const uint32_t rest = mantissa & ((1u << shift) - 1);
+            const uint32_t halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half & 1)))
+                ++half;
+            return sign | half;
+        }
+
+        uint32_t half = ((absBits - 0x38000000) >> 13);
+        const uint32_t rest = absBits & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+            ++half;
+        return sign | half;
+    }
+
+    /**
+     * Converts IEEE 754 half precision to float.
+     */
+    float fromHalf(uint16_t half)
+    {
+        const uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+        const uint32_t exponent = (half >> 10) & 0x1f;
+        uint32_t mantissa = half & 0x3ff;
+
+        uint32_t bits;
+        if (exponent == 0x1f) //inf or nan
+            bits = sign | 0x7f800000 | (mantissa << 13);
+        else if (exponent)
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        else if (!mantissa)
+            bits = sign;
+        else //denormal, normalized for float
+        {
+            int shift = 0;
+            while (!(mantissa & 0x400))
+            {
+                mantissa <<= 1;
+                shift++;
+            }
+            bits = sign | ((uint32_t)(113 - shift) << 23) | ((mantissa & 0x3ff) << 13);
+        }
+
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    size_t sampleSize(Q3dLut_SampleType type)
+    {
+        switch (type)
+        {
+        case Q3dLut_UInt16:
+        case Q3dLut_Float16:
+            return 2;
+        case Q3dLut_UInt32:
+        case Q3dLut_Float32:
+            return 4;
+        }
+        return 0;
+    }
+
+    /**
+     * Writes transformed nodes to the caller buffers described by Q3dLut_Output.
+     */
+    class NodeWriter
+    {
+    public:
+        explicit NodeWriter(const Q3dLut_Output& output)
+            : output_(output),
+            sampleSize_(sampleSize(output.type))
+        {
+            if (!output_.stride)
+                output_.stride = (output_.layout == Q3dLut_Interleaved) ? 3 * sampleSize_ : sampleSize_;
+
+            for (int c = 0; c < 3; c++)
+            {
+                if (output_.layout == Q3dLut_Interleaved)
+                    base_[c] = (char*)output_.data[0] + c * sampleSize_;
+                else
+                    base_[c] = (char*)output_.data[c];
+            }
+        }
+
+        bool valid() const
+        {
+            if (!sampleSize_)
+                return false;
+            if (output_.layout == Q3dLut_Interleaved)
+                return output_.data[0] != nullptr && output_.stride >= 3 * sampleSize_;
+            return output_.layout == Q3dLut_Planar
+                && output_.data[0] != nullptr && output_.data[1] != nullptr && output_.data[2] != nullptr
+                && output_.stride >= sampleSize_;
+        }
+
+        /**
+         * @param node index of the first node
+         * @param rgb count transformed nodes, 3 values each
+         */
+        void write(size_t node, const double* rgb, int count) const
+        {
+            switch (output_.type)
+            {
+            case Q3dLut_UInt16:
+                store<uint16_t>(node, rgb, count, [](double v) {
+                    return (uint16_t)std::min(std::max(round(v * maxValue), 0.0), (double)maxValue);
+                });
+                break;
+            case Q3dLut_UInt32:
+                store<unsigned int>(node, rgb, count, [](double v) {
+                    return (unsigned int)round(v * maxValue);
+                });
+                break;
+            case Q3dLut_Float16:
+                store<uint16_t>(node, rgb, count, [](double v) { return toHalf((float)v); });
+                break;
+            case Q3dLut_Float32:
+                store<float>(node, rgb, count, [](double v) { return (float)v; });
+                break;
+            }
+        }
+
+    private:
+        static const int maxValue = 256 * 256 - 1;
+
+        Q3dLut_Output output_;
+        size_t sampleSize_;
+        char* base_[3];
+
+        template<typename T, typename Convert>
+        void store(size_t node, const double* rgb, int count, Convert convert) const
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                char* dst = base_[c] + node * output_.stride;
+                for (int i = 0; i < count; i++, dst += output_.stride)
+                {
+                    T value = convert(rgb[3 * i + c]);
+                    memcpy(dst, &value, sizeof(T));
+                }
+            }
+        }
+    };
+
+    /**
+     * Reads nodes of the LUT described by Q3dLut_Output as 16 bit RGB values.
+     */
+    bool readNodes(int grid, const Q3dLut_Output& lut, std::vector<uint16_t>& nodes)
+    {
+        if (!NodeWriter(lut).valid())
+            return false;
+
+        const size_t size = sampleSize(lut.type);
+        const size_t stride = lut.stride ? lut.stride : (lut.layout == Q3dLut_Interleaved) ? 3 * size : size;
+        const size_t count = (size_t)grid * grid * grid;
+        const int maxValue = 256 * 256 - 1;
+
+        nodes.resize(3 * count);
+        for (int c = 0; c < 3; c++)
+        {
+            const char* src = (lut.layout == Q3dLut_Interleaved) ? (const char*)lut.data[0] + c * size : (const char*)lut.data[c];
+            for (size_t i = 0; i < count; i++, src += stride)
+            {
+                double value = 0;
+                switch (lut.type)
+                {
+                case Q3dLut_UInt16:
+                {
+                    uint16_t v;
+                    memcpy(&v, src, sizeof(v));
+                    nodes[3 * i + c] = v;
+                    continue;
+                }
+                case Q3dLut_UInt32:
+                {
+                    unsigned int v;
+                    memcpy(&v, src, sizeof(v));
+                    nodes[3 * i + c] = (uint16_t)std::min(v, (unsigned int)maxValue);
+                    continue;
+                }
+                case Q3dLut_Float16:
+                {
+                    uint16_t v;
+                    memcpy(&v, src, sizeof(v));
+                    value = fromHalf(v);
+                    break;
+                }
+                case Q3dLut_Float32:
+                {
+                    float v;
+                    memcpy(&v, src, sizeof(v));
+                    value = v;
+                    break;
+                }
+                }
+
+                //nan goes to 0
+                value = (value > 0) ? round(std::min(value, 1.0) * maxValue) : 0;
+                nodes[3 * i + c] = (uint16_t)value;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Describes the image for QubyxLutApply, fills in default strides.
+     */
+    bool imageBuffer(const Q3dLut_Image& image, QubyxLutApply::Buffer& buffer)
+    {
+        if (image.width < 1 || image.height < 1)
+            return false;
+
+        switch (image.type)
+        {
+        case Q3dLut_Pixel8:
+            buffer.type = QubyxLutApply::SampleType::UInt8;
+            break;
+        case Q3dLut_Pixel10:
+            buffer.type = QubyxLutApply::SampleType::UInt10;
+            break;
+        case Q3dLut_Pixel16:
+            buffer.type = QubyxLutApply::SampleType::UInt16;
+            break;
+        default:
+            return false;
+        }
+
+        const size_t size = QubyxLutApply::sampleSize(buffer.type);
+        buffer.planar = (image.layout == Q3dLut_Planar);
+        for (int c = 0; c < 3; c++)
+            buffer.plane[c] = image.data[buffer.planar ? c : 0];
+
+        buffer.pixelStride = image.pixelStride ? image.pixelStride : buffer.planar ? size : 3 * size;
+        buffer.rowStride = image.rowStride ? image.rowStride : image.width * buffer.pixelStride;
+
+        if (image.layout == Q3dLut_Interleaved)
+            return image.data[0] != nullptr && buffer.pixelStride >= 3 * size;
+        return image.layout == Q3dLut_Planar
+            && image.data[0] != nullptr && image.data[1] != nullptr && image.data[2] != nullptr
+            && buffer.pixelStride >= size;
+    }
+
+    /**
+     * Fills one R plane of the LUT, a contiguous slab of grid*grid nodes in the output.
+     */
+    bool fillSlab(QubyxProfileChain& chain, QubyxProfileChain::ApplyContext* context, int grid, int R,
+        const NodeWriter& writer)
+    {
+        std::vector<double> out(3 * grid);
+
+        size_t index = (size_t)R * grid * grid;
+        for (int G = 0; G < grid; G++)
+        {
+            const int node[3] = { R, G, 0 };
+            if (!chain.transformGridLine(grid, node, 2, &out[0], context))
+                return false;
+
+            writer.write(index, &out[0], grid);
+            index += grid;
+        }
+
+        return true;
+    }
+
+    /**
+     * Fills R planes of the LUT taken from the shared counter until all planes are done.
+     */
+    bool fillSlabs(QubyxProfileChain& chain, QubyxProfileChain::ApplyContext* context, int grid,
+        std::atomic<int>& nextR, const NodeWriter& writer)
+    {
+        for (int R = nextR++; R < grid; R = nextR++)
+        {
+            if (!fillSlab(chain, context, grid, R, writer))
+                return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Background generation of a LUT, one slab is one R plane.
+     */
+    class LutJob : public QubyxJobPool::Job
+    {
+    public:
+        typedef std::function<Q3dLut_Status(QubyxChainCache::ChainPtr& chain)> Linker;
+
+        /**
+         * @param link links the transform, called by a pool worker
+         */
+        LutJob(int grid, const Q3dLut_Output& output, int threads, const Linker& link,
+            Q3dLut_ProgressCallback callback, void* userData)
+            : Job(grid, threads),
+            grid_(grid),
+            writer_(output),
+            link_(link),
+            linkStatus_(Q3dLut_Ok),
+            callback_(callback),
+            userData_(userData)
+        {
+        }
+
+        Q3dLut_Status status(State state) const
+        {
+            switch (state)
+            {
+            case State::Running:
+            case State::Done:
+                return Q3dLut_Ok;
+            case State::Cancelled:
+                return Q3dLut_Error_Cancelled;
+            case State::Failed:
+                break;
+            }
+            return (linkStatus_ != Q3dLut_Ok) ? linkStatus_ : Q3dLut_Error_Other;
+        }
+
+    protected:
+        QubyxChainCache::ChainPtr prepare() override
+        {
+            QubyxChainCache::ChainPtr chain;
+            linkStatus_ = link_(chain);
+            return (linkStatus_ == Q3dLut_Ok) ? chain : QubyxChainCache::ChainPtr();
+        }
+
+        bool run(int slab, QubyxProfileChain& chain, QubyxProfileChain::ApplyContext* context) override
+        {
+            return fillSlab(chain, context, grid_, slab, writer_);
+        }
+
+        void progress(int done, int total) override
+        {
+            if (callback_)
+                callback_(userData_, done, total);
+        }
+
+    private:
+        const int grid_;
+        const NodeWriter writer_;
+        const Linker link_;
+        Q3dLut_Status linkStatus_;  //set by prepare, read after the job finished
+        const Q3dLut_ProgressCallback callback_;
+        void* const userData_;
+    };
+
+    Q3dLut_Status submitJob(int grid, const Q3dLut_Output* output, int threads, const LutJob::Linker& link,
+        Q3dLut_ProgressCallback progress, void* user_data, Q3dLut_Job** job)
+    {
+        if (job == nullptr)
+            return Q3dLut_Error_NullPointerForOutput;
+        *job = nullptr;
+
+        if (grid < 2)
+            return Q3dLut_Error_WrongGridValue;
+
+        if (output == nullptr || !NodeWriter(*output).valid())
+            return Q3dLut_Error_NullPointerForOutput;
+
+        QubyxJobPool::JobPtr submitted(new LutJob(grid, *output, threads, link, progress, user_data));
+        QubyxJobPool::submit(submitted);
+
+        *job = new Q3dLut_Job;
+        (*job)->job = submitted;
+        return Q3dLut_Ok;
+    }
+
+    /**
+     * Transforms R planes of the grid taken from the shared counter into XYZ (see generate3dLutBatch).
+     * @param pcs 3 values per grid node, in node order
+     */
+    bool fillPcsSlabs(QubyxProfileChain& head, QubyxProfileChain::ApplyContext* context, int grid,
+        std::atomic<int>& nextR, float* pcs)
+    {
+        for (int R = nextR++; R < grid; R = nextR++)
+        {
+            for (int G = 0; G < grid; G++)
+            {
+                const int node[3] = { R, G, 0 };
+                const size_t index = ((size_t)R * grid + G) * grid;
+                if (!head.transformGridLine(grid, node, 2, pcs + 3 * index, context))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Fills one R plane of the LUT from XYZ of its nodes by the PCS -> display part of the transform.
+     */
+    bool fillSlabFromPcs(QubyxProfileChain& tail, QubyxProfileChain::ApplyContext* context, int grid, int R,
+        const float* pcs, const NodeWriter& writer)
+    {
+        std::vector<float> rgb(3 * grid);
+        std::vector<double> out(3 * grid);
+
+        size_t index = (size_t)R * grid * grid;
+        for (int G = 0; G < grid; G++, index += grid)
+        {
+            if (!tail.transform(pcs + 3 * index, &rgb[0], grid, 3, 3, context))
+                return false;
+
+            std::copy(rgb.begin(), rgb.end(), out.begin());
+            writer.write(index, &out[0], grid);
+        }
+
+        return true;
+    }
+
+    /**
+     * Lets formatted slabs be written in file order, whichever thread finishes them first.
+     */
+    class SlabSequencer
+    {
+    public:
+        SlabSequencer() : next_(0), failed_(false) {}
+
+        /**
+         * @brief waitTurn blocks until all previous slabs are written
+         * @return false if writing was stopped
+         */
+        bool waitTurn(int slab)
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            turn_.wait(lock, [&]() { return next_ == slab || failed_; });
+            return !failed_;
+        }
+
+        void done()
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            ++next_;
+            turn_.notify_all();
+        }
+
+        void fail()
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            failed_ = true;
+            turn_.notify_all();
+        }
+
+        bool failed()
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            return failed_;
+        }
+
+    private:
+        std::mutex lock_;
+        std::condition_variable turn_;
+        int next_;
+        bool failed_;
+    };
+
+    typedef std::function<bool(const std::string& data)> Sink;
+
+    /**
+     * Same as fillSlabs, but formats every slab with the LUT writer and passes it to the sink in order.
+     * Slabs are planes along the slowest axis of the file, so only one slab per thread is kept in memory.
+     */
+    bool streamSlabs(QubyxProfileChain& chain, QubyxProfileChain::ApplyContext* context, int grid,
+        std::atomic<int>& nextSlab, const QubyxLutWriter& writer, SlabSequencer& sequencer, const Sink& sink)
+    {
+        std::vector<double> out(3 * grid);
+        std::string text;
+
+        //red fastest files are sliced into B planes, others into R planes
+        const int slowest = writer.redFastest() ? 2 : 0;
+        const int fastest = 2 - slowest;
+
+        for (int S = nextSlab++; S < grid && !sequencer.failed(); S = nextSlab++)
+        {
+            text.clear();
+            for (int G = 0; G < grid; G++)
+            {
+                int node[3];
+                node[slowest] = S;
+                node[1] = G;
+                node[fastest] = 0;
+
+                if (!chain.transformGridLine(grid, node, fastest, &out[0], context))
+                {
+                    sequencer.fail();
+                    return false;
+                }
+
+                writer.nodes(&out[0], grid, text);
+            }
+
+            if (!sequencer.waitTurn(S))
+                return false;
+
+            if (!sink(text))
+            {
+                sequencer.fail();
+                return false;
+            }
+            sequencer.done();
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief threadCount resolves the requested number of threads
+     * @param threads requested number, 0 - all cores
+     * @param limit number of work items, no more threads are used
+     */
+    int threadCount(int threads, size_t limit)
+    {
+        if (threads <= 0)
+            threads = std::thread::hardware_concurrency();
+        if ((size_t)threads > limit)
+            threads = (int)limit;
+        if (threads < 1)
+            threads = 1;
+        return threads;
+    }
+
+    /**
+     * Runs work on the given number of threads, work gets the thread index (0 - the calling thread).
+     * All callers take work items from shared counters, so if a thread can't be started
+     * the work is done by the threads started before it.
+     */
+    bool runThreads(int threads, const std::function<bool(int thread)>& work)
+    {
+        std::atomic<bool> ok(true);
+        std::vector<std::thread> workers;
+        try
+        {
+            //no reallocation once threads run, a throwing push_back would destroy a joinable thread
+            workers.reserve(threads - 1);
+            for (int i = 1; i < threads; i++)
+            {
+                workers.emplace_back([&, i]() {
+                    if (!work(i))
+                        ok = false;
+                });
+            }
+        }
+        catch (const std::exception&)
+        {
+        }
+
+        if (!work(0))
+            ok = false;
+
+        for (auto& worker : workers)
+            worker.join();
+
+        return ok;
+    }
+
+    /**
+     * Runs work on the given number of threads, each with own apply context of the chain.
+     */
+    bool runWorkers(QubyxProfileChain& chain, int threads, int grid,
+        const std::function<bool(QubyxProfileChain::ApplyContext*)>& work)
+    {
+        threads = threadCount(threads, grid);
+
+        //the chain may be shared by other handles, so even one thread uses its own context
+        std::vector<std::unique_ptr<QubyxProfileChain::ApplyContext>> contexts;
+        for (int i = 0; i < threads; i++)
+        {
+            contexts.push_back(chain.newApplyContext());
+            if (!contexts.back())
+                return false;
+        }
+
+        return runThreads(threads, [&](int thread) {
+            return work(contexts[thread].get());
+        });
+    }
+
+    QubyxLutWriter::Format writerFormat(Q3dLut_FileFormat format)
+    {
+        switch (format)
+        {
+        case Q3dLut_3dl:
+            return QubyxLutWriter::Format::Lut3dl;
+        case Q3dLut_Clf:
+            return QubyxLutWriter::Format::Clf;
+        case Q3dLut_Binary:
+            return QubyxLutWriter::Format::Binary;
+        default:
+            return QubyxLutWriter::Format::Cube;
+        }
+    }
+
+    Q3dLut_Status checkWriteArguments(Q3dLut_Chain* chain, int grid, Q3dLut_FileFormat format)
+    {
+        if (chain == nullptr || !chain->chain)
+            return Q3dLut_Error_Other;
+
+        if (grid < 2)
+            return Q3dLut_Error_WrongGridValue;
+
+        if (format < Q3dLut_Cube || format > Q3dLut_Binary)
+            return Q3dLut_Error_Other;
+
+        return Q3dLut_Ok;
+    }
+
+    Q3dLut_Status writeLut(Q3dLut_Chain* chain, int grid, Q3dLut_FileFormat format, const Sink& sink, int threads)
+    {
+        Q3dLut_Status status = checkWriteArguments(chain, grid, format);
+        if (status != Q3dLut_Ok)
+            return status;
+
+        std::unique_ptr<QubyxLutWriter> writer = QubyxLutWriter::create(writerFormat(format));
+
+        std::string text;
+        writer->header(grid, text);
+        if (!sink(text))
+            return Q3dLut_Error_CantWriteOutput;
+
+        std::atomic<int> nextSlab(0);
+        SlabSequencer sequencer;
+        std::atomic<bool> sinkFailed(false);
+        Sink checked = [&](const std::string& data) {
+            if (sink(data))
+                return true;
+            sinkFailed = true;
+            return false;
+        };
+
+        bool ok = runWorkers(*chain->chain, threads, grid, [&](QubyxProfileChain::ApplyContext* context) {
+            return streamSlabs(*chain->chain, context, grid, nextSlab, *writer, sequencer, checked);
+        });
+
+        if (sinkFailed)
+            return Q3dLut_Error_CantWriteOutput;
+        if (!ok)
+            return Q3dLut_Error_Other;
+
+        text.clear();
+        writer->footer(text);
+        if (!text.empty() && !sink(text))
+            return Q3dLut_Error_CantWriteOutput;
+
+        return Q3dLut_Ok;
+    }
+
+    typedef std::function<bool(QubyxProfile& ga, QubyxProfile& display)> ProfileLoader;
+
+    /**
+     * Links (or takes from the cache) the GA -> display transform of profiles with given content keys.
+     * @param load loads both profiles, called only when the transform isn't cached
+     */
+    Q3dLut_Status openChain(const std::vector<std::string>& keys, const ProfileLoader& load, Q3dLut_Chain** chain)
+    {
+        const auto in = QubyxProfileChain::SpaceType::DeviceSpecific;
+        const auto out = QubyxProfileChain::SpaceType::DeviceSpecific;
+        const auto ri = QubyxProfileChain::RI::RealisticColorimetricWithLuminance;
+
+        QubyxChainCache::ChainPtr linked = QubyxChainCache::get(QubyxChainCache::makeKey(keys, ri, in, out),
+            [&]() {
+                QubyxProfile ga, display;
+                if (!load(ga, display))
+                    return QubyxChainCache::ChainPtr();
+
+                QubyxChainCache::ChainPtr res(new QubyxProfileChain(in, out, ri));
+                if (!res->addProfile(&ga) || !res->addProfile(&display))
+                    return QubyxChainCache::ChainPtr();
+                return res;
+            });
+
+        if (!linked)
+            return Q3dLut_Error_Other;
+
+        *chain = new Q3dLut_Chain;
+        (*chain)->chain = linked;
+        return Q3dLut_Ok;
+    }
+
+    /**
+     * Links (or takes from the cache) the transform of one profile, e.g. GA -> XYZ or XYZ -> display part of
+     * the GA -> display transform. Both parts are split exactly as QubyxProfileChain splits the whole transform.
+     * @param cantOpen status returned if the profile can't be loaded
+     */
+    Q3dLut_Status openPart(const char* path, QubyxProfileChain::SpaceType in, QubyxProfileChain::SpaceType out,
+        Q3dLut_Status cantOpen, QubyxChainCache::ChainPtr& chain)
+    {
+        const auto ri = QubyxProfileChain::RI::RealisticColorimetricWithLuminance;
+
+        std::vector<std::string> keys(1);
+        if (path == nullptr || !QubyxProfileCache::load(path, &keys[0]))
+            return cantOpen;
+
+        std::string profilePath(path);
+        chain = QubyxChainCache::get(QubyxChainCache::makeKey(keys, ri, in, out),
+            [&]() {
+                QubyxProfile profile(profilePath);
+                if (!profile.LoadFromFile())
+                    return QubyxChainCache::ChainPtr();
+
+                QubyxChainCache::ChainPtr res(new QubyxProfileChain(in, out, ri));
+                if (!res->addProfile(&profile))
+                    return QubyxChainCache::ChainPtr();
+                return res;
+            });
+
+        return chain ? Q3dLut_Ok : Q3dLut_Error_Other;
+    }
+}
+
 Q3dLut_Status generate3dLut(
     char* ga_profile,
     char* display_profile,
@@ -18,52 +785,563 @@ Q3dLut_Status generate3dLut(
     unsigned int* glut,
     unsigned int* blut
 )
+{
+    return generate3dLutEx(ga_profile, display_profile, grid, rlut, glut, blut, 1);
+}
+
+Q3dLut_Status generate3dLutEx(
+    char* ga_profile,
+    char* display_profile,
+    int grid,
+    unsigned int* rlut,
+    unsigned int* glut,
+    unsigned int* blut,
+    int threads
+)
+{
+    Q3dLut_Output output = { Q3dLut_Planar, Q3dLut_UInt32, { rlut, glut, blut }, 0 };
+    return generate3dLutTo(ga_profile, display_profile, grid, &output, threads);
+}
+
+Q3dLut_Status generate3dLutTo(
+    char* ga_profile,
+    char* display_profile,
+    int grid,
+    const Q3dLut_Output* output,
+    int threads
+)
+{
+    if (grid < 2)
+        return Q3dLut_Error_WrongGridValue;
+
+    if (output == nullptr || !NodeWriter(*output).valid())
+        return Q3dLut_Error_NullPointerForOutput;
+
+    Q3dLut_Chain* chain = nullptr;
+    Q3dLut_Status status = q3dlut_chain_open(ga_profile, display_profile, &chain);
+    if (status != Q3dLut_Ok)
+        return status;
+
+    status = q3dlut_chain_generate_to(chain, grid, output, threads);
+    q3dlut_chain_close(chain);
+
+    return status;
+}
+
+Q3dLut_Status generate3dLutFromMemory(
+    const uint8_t* ga_profile,
+    size_t ga_size,
+    const uint8_t* display_profile,
+    size_t display_size,
+    int grid,
+    const Q3dLut_Output* output,
+    int threads
+)
 {
     if (grid < 2)
         return Q3dLut_Error_WrongGridValue;
 
-    if (rlut == nullptr || glut == nullptr || blut == nullptr)
+    if (output == nullptr || !NodeWriter(*output).valid())
         return Q3dLut_Error_NullPointerForOutput;
 
+    Q3dLut_Chain* chain = nullptr;
+    Q3dLut_Status status = q3dlut_chain_open_memory(ga_profile, ga_size, display_profile, display_size, &chain);
+    if (status != Q3dLut_Ok)
+        return status;
+
+    status = q3dlut_chain_generate_to(chain, grid, output, threads);
+    q3dlut_chain_close(chain);
+
+    return status;
+}
+
+Q3dLut_Status q3dlut_chain_open(char* ga_profile, char* display_profile, Q3dLut_Chain** chain)
+{
+    if (chain == nullptr)
+        return Q3dLut_Error_NullPointerForOutput;
+    *chain = nullptr;
 
-    QubyxProfile ga(ga_profile);
-    if (!ga.LoadFromFile())
+    if (ga_profile == nullptr)
         return Q3dLut_Error_CantOpenGA;
+    if (display_profile == nullptr)
+        return Q3dLut_Error_CantOpenDisplay;
 
-    QubyxProfile display(display_profile);
-    if (!display.LoadFromFile())
+    std::vector<std::string> keys(2);
+    if (!QubyxProfileCache::load(ga_profile, &keys[0]))
+        return Q3dLut_Error_CantOpenGA;
+    if (!QubyxProfileCache::load(display_profile, &keys[1]))
         return Q3dLut_Error_CantOpenDisplay;
 
-    QubyxProfileChain chain(QubyxProfileChain::SpaceType::DeviceSpecific,
-        QubyxProfileChain::SpaceType::DeviceSpecific,
-        QubyxProfileChain::RI::RealisticColorimetricWithLuminance);
+    std::string gaPath(ga_profile), displayPath(display_profile);
+    return openChain(keys, [&](QubyxProfile& ga, QubyxProfile& display) {
+            ga.setFileName(gaPath);
+            display.setFileName(displayPath);
+            return ga.LoadFromFile() && display.LoadFromFile();
+        }, chain);
+}
+
+Q3dLut_Status q3dlut_chain_open_memory(const uint8_t* ga_profile, size_t ga_size,
+    const uint8_t* display_profile, size_t display_size, Q3dLut_Chain** chain)
+{
+    if (chain == nullptr)
+        return Q3dLut_Error_NullPointerForOutput;
+    *chain = nullptr;
+
+    //same content keys as files, so a buffer and a file with the same profile share the linked transform
+    std::vector<std::string> keys(2);
+    if (!QubyxProfileCache::load(ga_profile, ga_size, &keys[0]))
+        return Q3dLut_Error_CantOpenGA;
+    if (!QubyxProfileCache::load(display_profile, display_size, &keys[1]))
+        return Q3dLut_Error_CantOpenDisplay;
+
+    return openChain(keys, [&](QubyxProfile& ga, QubyxProfile& display) {
+            return ga.LoadFromMemory(ga_profile, ga_size) && display.LoadFromMemory(display_profile, display_size);
+        }, chain);
+}
+
+void q3dlut_chain_close(Q3dLut_Chain* chain)
+{
+    delete chain;
+}
+
+Q3dLut_Status q3dlut_chain_generate(Q3dLut_Chain* chain, int grid, unsigned int* rlut, unsigned int* glut, unsigned int* blut, int threads)
+{
+    Q3dLut_Output output = { Q3dLut_Planar, Q3dLut_UInt32, { rlut, glut, blut }, 0 };
+    return q3dlut_chain_generate_to(chain, grid, &output, threads);
+}
+
+Q3dLut_Status q3dlut_chain_generate_to(Q3dLut_Chain* chain, int grid, const Q3dLut_Output* output, int threads)
+{
+    if (chain == nullptr || !chain->chain)
+        return Q3dLut_Error_Other;
+
+    if (grid < 2)
+        return Q3dLut_Error_WrongGridValue;
+
+    if (output == nullptr)
+        return Q3dLut_Error_NullPointerForOutput;
+
+    NodeWriter writer(*output);
+    if (!writer.valid())
+        return Q3dLut_Error_NullPointerForOutput;
+
+    QubyxProfileChain& linked = *chain->chain;
+    std::atomic<int> nextR(0);
 
-    chain.addProfile(&ga);
-    chain.addProfile(&display);
+    bool ok = runWorkers(linked, threads, grid, [&](QubyxProfileChain::ApplyContext* context) {
+        return fillSlabs(linked, context, grid, nextR, writer);
+    });
 
-    unsigned index = 0;
-    for (int R = 0; R < grid; R++) {
-        for (int G = 0; G < grid; G++) {
-            for (int B = 0; B < grid; B++)
+    return ok ? Q3dLut_Ok : Q3dLut_Error_Other;
+}
+
+Q3dLut_Status generate3dLutBatch(
+    char* ga_profile,
+    char** display_profiles,
+    int count,
+    int grid,
+    const Q3dLut_Output* outputs,
+    Q3dLut_Status* statuses,
+    int threads
+)
+{
+    //statuses are set on every return, an error of the whole batch is reported for each display
+    auto fail = [statuses, count](Q3dLut_Status status) {
+        if (statuses)
+            std::fill(statuses, statuses + std::max(count, 0), status);
+        return status;
+    };
+
+    if (grid < 2)
+        return fail(Q3dLut_Error_WrongGridValue);
+
+    if (count < 0 || (count > 0 && (display_profiles == nullptr || outputs == nullptr)))
+        return fail(Q3dLut_Error_NullPointerForOutput);
+
+    std::vector<Q3dLut_Status> results(count, Q3dLut_Ok);
+    std::vector<NodeWriter> writers;
+    for (int i = 0; i < count; i++)
+    {
+        writers.push_back(NodeWriter(outputs[i]));
+        if (!writers.back().valid())
+            results[i] = Q3dLut_Error_NullPointerForOutput;
+    }
+
+    const auto device = QubyxProfileChain::SpaceType::DeviceSpecific;
+    const auto xyz = QubyxProfileChain::SpaceType::XYZ;
+
+    QubyxChainCache::ChainPtr head;
+    Q3dLut_Status status = openPart(ga_profile, device, xyz, Q3dLut_Error_CantOpenGA, head);
+    if (status != Q3dLut_Ok)
+        return fail(status);
+
+    //matrix/TRC GA part is evaluated per axis by every linked transform (see transformGridLine), fused with
+    //matrix/TRC displays. A shared grid would bypass both and give results of the CMM path, which differ by
+    //float rounding. Other GA profiles are evaluated once on the whole grid and only the display parts run per display
+    const bool perAxis = head->hasMatrixTRCInput();
+
+    std::vector<QubyxChainCache::ChainPtr> chains(count);
+    std::atomic<int> nextDisplay(0);
+    runThreads(threadCount(threads, count), [&](int) {
+        for (int i = nextDisplay++; i < count; i = nextDisplay++)
+        {
+            if (results[i] != Q3dLut_Ok)
+                continue;
+
+            if (perAxis)
             {
-                std::vector<double> in(3), out;
+                Q3dLut_Chain* chain = nullptr;
+                results[i] = q3dlut_chain_open(ga_profile, display_profiles[i], &chain);
+                if (chain)
+                    chains[i] = chain->chain;
+                q3dlut_chain_close(chain);
+            }
+            else
+                results[i] = openPart(display_profiles[i], xyz, device, Q3dLut_Error_CantOpenDisplay, chains[i]);
+        }
+        return true;
+    });
 
-                in[0] = R / (grid - 1.0);
-                in[1] = G / (grid - 1.0);
-                in[2] = B / (grid - 1.0);
+    //XYZ of all grid nodes, the same values the whole transform passes between its parts
+    std::vector<float> pcs;
+    if (!perAxis && std::find(results.begin(), results.end(), Q3dLut_Ok) != results.end())
+    {
+        try
+        {
+            pcs.resize(3 * (size_t)grid * grid * grid);
+        }
+        catch (const std::bad_alloc&)
+        {
+            return fail(Q3dLut_Error_Other);
+        }
 
-                chain.transform(in, out);
+        std::atomic<int> nextR(0);
+        if (!runWorkers(*head, threads, grid, [&](QubyxProfileChain::ApplyContext* context) {
+                return fillPcsSlabs(*head, context, grid, nextR, &pcs[0]);
+            }))
+            return fail(Q3dLut_Error_Other);
+    }
 
-                int maxValue = 256 * 256 - 1;
-                rlut[index] = round(out[0] * maxValue);
-                glut[index] = round(out[1] * maxValue);
-                blut[index] = round(out[2] * maxValue);
+    //R planes of all displays, a thread keeps the apply context while it gets planes of the same display
+    std::vector<std::atomic<bool>> failed(count);
+    for (auto& flag : failed)
+        flag = false;
 
-                ++index;
+    const size_t items = (size_t)count * grid;
+    std::atomic<size_t> nextItem(0);
+    runThreads(threadCount(threads, items), [&](int) {
+        std::unique_ptr<QubyxProfileChain::ApplyContext> context;
+        int current = -1;
+        for (size_t item = nextItem++; item < items; item = nextItem++)
+        {
+            const int i = (int)(item / grid), R = (int)(item % grid);
+            if (results[i] != Q3dLut_Ok || failed[i])
+                continue;
+
+            if (i != current)
+            {
+                current = i;
+                context = chains[i]->newApplyContext();
             }
+
+            const bool ok = context && (perAxis ? fillSlab(*chains[i], context.get(), grid, R, writers[i])
+                : fillSlabFromPcs(*chains[i], context.get(), grid, R, &pcs[0], writers[i]));
+            if (!ok)
+                failed[i] = true;
         }
+        return true;
+    });
+
+    status = Q3dLut_Ok;
+    for (int i = 0; i < count; i++)
+    {
+        if (results[i] == Q3dLut_Ok && failed[i])
+            results[i] = Q3dLut_Error_Other;
+        if (statuses)
+            statuses[i] = results[i];
+        if (status == Q3dLut_Ok)
+            status = results[i];
     }
 
+    return status;
+}
+
+Q3dLut_Status generate3dLutAdaptive(
+    char* ga_profile,
+    char* display_profile,
+    int grid,
+    const Q3dLut_Output* output,
+    double tolerance,
+    int threads
+)
+{
+    if (grid < 2)
+        return Q3dLut_Error_WrongGridValue;
+
+    if (output == nullptr || !NodeWriter(*output).valid())
+        return Q3dLut_Error_NullPointerForOutput;
+
+    Q3dLut_Chain* chain = nullptr;
+    Q3dLut_Status status = q3dlut_chain_open(ga_profile, display_profile, &chain);
+    if (status != Q3dLut_Ok)
+        return status;
+
+    status = q3dlut_chain_generate_adaptive(chain, grid, output, tolerance, threads);
+    q3dlut_chain_close(chain);
+
+    return status;
+}
+
+Q3dLut_Status q3dlut_chain_generate_adaptive(Q3dLut_Chain* chain, int grid, const Q3dLut_Output* output,
+    double tolerance, int threads)
+{
+    if (chain == nullptr || !chain->chain)
+        return Q3dLut_Error_Other;
+
+    if (grid < 2)
+        return Q3dLut_Error_WrongGridValue;
+
+    if (output == nullptr)
+        return Q3dLut_Error_NullPointerForOutput;
+
+    NodeWriter writer(*output);
+    if (!writer.valid())
+        return Q3dLut_Error_NullPointerForOutput;
+
+    if (tolerance <= 0)
+        return q3dlut_chain_generate_to(chain, grid, output, threads);
+
+    QubyxProfileChain& linked = *chain->chain;
+
+    //the working grid of 257^3 takes up to about 250 MB
+    std::unique_ptr<QubyxAdaptiveGrid> adaptive;
+    try
+    {
+        adaptive.reset(new QubyxAdaptiveGrid(linked, grid, tolerance, [&writer](size_t index, const double* values, int count) {
+                writer.write(index, values, count);
+            }));
+
+        do
+        {
+            if (!runWorkers(linked, threads, grid, [&](QubyxProfileChain::ApplyContext* context) {
+                    return adaptive->work(context);
+                }))
+                return Q3dLut_Error_Other;
+        } while (adaptive->advance());
+    }
+    catch (const std::bad_alloc&)
+    {
+        return Q3dLut_Error_Other;
+    }
+
+    //refinement would compute most nodes anyway, grid lines are faster
+    if (!adaptive->complete())
+    {
+        adaptive.reset();
+        return q3dlut_chain_generate_to(chain, grid, output, threads);
+    }
+
+    return Q3dLut_Ok;
+}
+
+Q3dLut_Status generate3dLutAsync(char* ga_profile, char* display_profile, int grid, const Q3dLut_Output* output,
+    int threads, Q3dLut_ProgressCallback progress, void* user_data, Q3dLut_Job** job)
+{
+    if (ga_profile == nullptr)
+        return Q3dLut_Error_CantOpenGA;
+    if (display_profile == nullptr)
+        return Q3dLut_Error_CantOpenDisplay;
+
+    std::string gaPath(ga_profile), displayPath(display_profile);
+    return submitJob(grid, output, threads, [gaPath, displayPath](QubyxChainCache::ChainPtr& chain) mutable {
+            Q3dLut_Chain* opened = nullptr;
+            Q3dLut_Status status = q3dlut_chain_open(&gaPath[0], &displayPath[0], &opened);
+            if (opened)
+                chain = opened->chain;
+            q3dlut_chain_close(opened);
+            return status;
+        }, progress, user_data, job);
+}
+
+Q3dLut_Status q3dlut_chain_generate_async(Q3dLut_Chain* chain, int grid, const Q3dLut_Output* output,
+    int threads, Q3dLut_ProgressCallback progress, void* user_data, Q3dLut_Job** job)
+{
+    if (chain == nullptr || !chain->chain)
+        return Q3dLut_Error_Other;
+
+    QubyxChainCache::ChainPtr linked = chain->chain;
+    return submitJob(grid, output, threads, [linked](QubyxChainCache::ChainPtr& res) {
+            res = linked;
+            return Q3dLut_Ok;
+        }, progress, user_data, job);
+}
+
+int q3dlut_job_poll(Q3dLut_Job* job, int* done, int* total)
+{
+    if (job == nullptr || !job->job)
+        return 1;
+
+    return job->job->state(done, total) != QubyxJobPool::Job::State::Running;
+}
+
+Q3dLut_Status q3dlut_job_wait(Q3dLut_Job* job)
+{
+    if (job == nullptr || !job->job)
+        return Q3dLut_Error_Other;
+
+    return static_cast<const LutJob&>(*job->job).status(job->job->wait());
+}
+
+void q3dlut_job_cancel(Q3dLut_Job* job)
+{
+    if (job && job->job)
+        job->job->cancel();
+}
+
+void q3dlut_job_release(Q3dLut_Job* job)
+{
+    if (job == nullptr)
+        return;
+
+    //the output belongs to the caller, so no slab may be written after release
+    if (job->job)
+    {
+        job->job->cancel();
+        job->job->wait();
+    }
+    delete job;
+}
+
+Q3dLut_Status generate3dLutFile(char* ga_profile, char* display_profile, int grid, Q3dLut_FileFormat format, char* path, int threads)
+{
+    if (grid < 2)
+        return Q3dLut_Error_WrongGridValue;
+
+    if (path == nullptr)
+        return Q3dLut_Error_NullPointerForOutput;
+
+    Q3dLut_Chain* chain = nullptr;
+    Q3dLut_Status status = q3dlut_chain_open(ga_profile, display_profile, &chain);
+    if (status != Q3dLut_Ok)
+        return status;
+
+    status = q3dlut_chain_write(chain, grid, format, path, threads);
+    q3dlut_chain_close(chain);
+
+    return status;
+}
+
+Q3dLut_Status q3dlut_chain_write(Q3dLut_Chain* chain, int grid, Q3dLut_FileFormat format, const char* path, int threads)
+{
+    if (path == nullptr)
+        return Q3dLut_Error_NullPointerForOutput;
+
+    //an existing file is not truncated by a call that fails anyway
+    Q3dLut_Status status = checkWriteArguments(chain, grid, format);
+    if (status != Q3dLut_Ok)
+        return status;
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return Q3dLut_Error_CantWriteOutput;
+
+    status = writeLut(chain, grid, format, [file](const std::string& data) {
+        return fwrite(data.data(), 1, data.size(), file) == data.size();
+    }, threads);
+
+    if (fclose(file) != 0 && status == Q3dLut_Ok)
+        status = Q3dLut_Error_CantWriteOutput;
+
+    return status;
+}
+
+Q3dLut_Status q3dlut_chain_write_stream(Q3dLut_Chain* chain, int grid, Q3dLut_FileFormat format,
+    Q3dLut_WriteCallback callback, void* user_data, int threads)
+{
+    if (callback == nullptr)
+        return Q3dLut_Error_NullPointerForOutput;
+
+    return writeLut(chain, grid, format, [callback, user_data](const std::string& data) {
+        return callback(user_data, data.data(), data.size()) != 0;
+    }, threads);
+}
+
+void q3dlut_chain_cache_limits(unsigned int max_chains, unsigned long long max_bytes)
+{
+    QubyxChainCache::setLimits(max_chains, (size_t)max_bytes);
+}
+
+Q3dLut_Status q3dlut_applier_create(int grid, const Q3dLut_Output* lut, Q3dLut_Interpolation interpolation,
+    Q3dLut_Applier** applier)
+{
+    if (applier == nullptr)
+        return Q3dLut_Error_NullPointerForOutput;
+    *applier = nullptr;
+
+    //node offsets of the vector gathers are 32 bit
+    if (grid < 2 || grid > 512)
+        return Q3dLut_Error_WrongGridValue;
+
+    if (interpolation != Q3dLut_Tetrahedral && interpolation != Q3dLut_Trilinear)
+        return Q3dLut_Error_Other;
+
+    if (lut == nullptr)
+        return Q3dLut_Error_Other;
+
+    //a grid of 257 takes about 100 MB of nodes, twice while they are copied
+    std::unique_ptr<Q3dLut_Applier> res(new Q3dLut_Applier);
+    try
+    {
+        std::vector<uint16_t> nodes;
+        if (!readNodes(grid, *lut, nodes))
+            return Q3dLut_Error_Other;
+
+        res->lut.reset(new QubyxLutApply(grid, &nodes[0], (interpolation == Q3dLut_Trilinear)
+            ? QubyxLutApply::Interpolation::Trilinear : QubyxLutApply::Interpolation::Tetrahedral));
+    }
+    catch (const std::bad_alloc&)
+    {
+        return Q3dLut_Error_Other;
+    }
+
+    *applier = res.release();
+
     return Q3dLut_Ok;
 }
 
+void q3dlut_applier_release(Q3dLut_Applier* applier)
+{
+    delete applier;
+}
+
+Q3dLut_Status q3dlut_apply(const Q3dLut_Applier* applier, const Q3dLut_Image* src, const Q3dLut_Image* dst, int threads)
+{
+    if (applier == nullptr || !applier->lut)
+        return Q3dLut_Error_Other;
+
+    QubyxLutApply::Buffer in, out;
+    if (src == nullptr || !imageBuffer(*src, in))
+        return Q3dLut_Error_WrongImage;
+
+    if (dst == nullptr)
+        out = in;
+    else if (!imageBuffer(*dst, out) || dst->width != src->width || dst->height != src->height)
+        return Q3dLut_Error_WrongImage;
+
+    //bands of rows are taken by the threads as they get free
+    const int bandRows = 16;
+    const int bands = (src->height + bandRows - 1) / bandRows;
+    const QubyxLutApply& lut = *applier->lut;
+    std::atomic<int> nextBand(0);
+
+    runThreads(threadCount(threads, bands), [&](int) {
+        for (int band = nextBand++; band < bands; band = nextBand++)
+        {
+            const int first = band * bandRows;
+            lut.convertRows(in, out, src->width, first, std::min(bandRows, src->height - first));
+        }
+        return true;
+    });
+
+    return Q3dLut_Ok;
+}
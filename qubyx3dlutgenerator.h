@@ -6,6 +6,9 @@
 #ifndef QUBYX3DLUTGENERATOR_H
 #define QUBYX3DLUTGENERATOR_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 enum Q3dLut_Status
 {
     Q3dLut_Ok = 0,
@@ -13,10 +16,309 @@ enum Q3dLut_Status
     Q3dLut_Error_CantOpenDisplay,
     Q3dLut_Error_WrongGridValue,
     Q3dLut_Error_NullPointerForOutput,
-    Q3dLut_Error_Other
+    Q3dLut_Error_Other,
+    Q3dLut_Error_CantWriteOutput,
+    Q3dLut_Error_Cancelled,
+    Q3dLut_Error_WrongImage
+};
+
+enum Q3dLut_SampleType
+{
+    Q3dLut_UInt16 = 0,   // 0..65535
+    Q3dLut_UInt32,       // 0..65535, same values as generate3dLut
+    Q3dLut_Float16,      // IEEE half, 0..1
+    Q3dLut_Float32       // 0..1
+};
+
+enum Q3dLut_Layout
+{
+    Q3dLut_Interleaved = 0,  // RGB of a node next to each other in data[0]
+    Q3dLut_Planar            // R, G and B in data[0], data[1] and data[2]
 };
 
+/**
+ * Describes where and how LUT nodes are written. Nodes are ordered as in generate3dLut
+ * (index = R * grid * grid + G * grid + B).
+ */
+typedef struct Q3dLut_Output
+{
+    Q3dLut_Layout layout;
+    Q3dLut_SampleType type;
+    void* data[3];           // interleaved - data[0] only
+    size_t stride;           // bytes between consecutive nodes (of a plane), 0 - packed
+} Q3dLut_Output;
+
 extern "C" __declspec(dllexport)
 Q3dLut_Status generate3dLut(char* ga_profile, char* display_profile, int grid, unsigned int* rlut, unsigned int* glut, unsigned int* blut);
 
+/**
+ * Same as generate3dLut, but splits the grid into R-plane slabs processed by several threads.
+ * Output is identical to generate3dLut.
+ * @param threads number of worker threads, 0 - use all cores
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status generate3dLutEx(char* ga_profile, char* display_profile, int grid, unsigned int* rlut, unsigned int* glut, unsigned int* blut, int threads);
+
+/**
+ * Same as generate3dLutEx, but writes the LUT in the layout and sample type given by output.
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status generate3dLutTo(char* ga_profile, char* display_profile, int grid, const Q3dLut_Output* output, int threads);
+
+/**
+ * Handle of a linked GA -> display transform. Linked transforms are cached process-wide,
+ * so opening the same pair of profiles again doesn't repeat the linking.
+ */
+typedef struct Q3dLut_Chain Q3dLut_Chain;
+
+/**
+ * Opens (links or takes from the cache) the GA -> display transform.
+ * @param chain receives the handle, must be released with q3dlut_chain_close
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status q3dlut_chain_open(char* ga_profile, char* display_profile, Q3dLut_Chain** chain);
+
+/**
+ * Same as q3dlut_chain_open, but takes the profiles from memory. Profiles are identified by content,
+ * so a buffer holding the same profile as a file shares its linked transform.
+ * Buffers are not referenced after the call returns.
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status q3dlut_chain_open_memory(const uint8_t* ga_profile, size_t ga_size,
+    const uint8_t* display_profile, size_t display_size, Q3dLut_Chain** chain);
+
+/**
+ * Releases the handle. The linked transform stays in the cache.
+ */
+extern "C" __declspec(dllexport)
+void q3dlut_chain_close(Q3dLut_Chain* chain);
+
+/**
+ * Same as generate3dLutEx, but uses the opened transform. The handle may be used by several threads.
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status q3dlut_chain_generate(Q3dLut_Chain* chain, int grid, unsigned int* rlut, unsigned int* glut, unsigned int* blut, int threads);
+
+/**
+ * Same as generate3dLutTo, but uses the opened transform.
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status q3dlut_chain_generate_to(Q3dLut_Chain* chain, int grid, const Q3dLut_Output* output, int threads);
+
+/**
+ * Same as generate3dLutTo, but takes the GA and display profiles from memory (e.g. embedded in an image
+ * or received over the network). Buffers are only read during the call and may be released afterwards.
+ * Errors are reported as for profile files: Q3dLut_Error_CantOpenGA / Q3dLut_Error_CantOpenDisplay
+ * if a buffer is null or doesn't hold a valid profile.
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status generate3dLutFromMemory(const uint8_t* ga_profile, size_t ga_size,
+    const uint8_t* display_profile, size_t display_size, int grid, const Q3dLut_Output* output, int threads);
+
+/**
+ * Generates LUTs of one GA profile for many display profiles. The GA profile is parsed and linked once, its part of
+ * the transform (GA -> XYZ including chromatic adaptation and luminance) is evaluated once on the grid and only
+ * the XYZ -> display part runs for every display, displays and grid planes in parallel.
+ * A matrix/TRC GA part costs only grid evaluations per axis in a linked transform (fused with a matrix/TRC display),
+ * so then every display runs its own linked transform instead and the shared grid is not built.
+ * LUTs are the same as generate3dLutTo gives for every pair. Needs 12 bytes per node of working memory unless
+ * the GA is matrix/TRC.
+ * @param display_profiles count display profile paths
+ * @param outputs count output descriptors, LUT of display_profiles[i] is written to outputs[i]
+ * @param statuses if not null receives count statuses of the displays, all set to the returned error when
+ * the whole batch fails (GA, argument and memory errors)
+ * @return GA and argument errors, or the first not Q3dLut_Ok status of the displays
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status generate3dLutBatch(char* ga_profile, char** display_profiles, int count, int grid,
+    const Q3dLut_Output* outputs, Q3dLut_Status* statuses, int threads);
+
+/**
+ * Same as generate3dLutTo, but runs the transform exactly only where the LUT is not smooth enough, for large grids
+ * (129, 257). A coarse grid is computed first and its cells are halved while tetrahedral interpolation from
+ * the cell corners differs from the exact transform by more than tolerance / 2 at the cell midpoints.
+ * Other nodes are interpolated.
+ * If more than a third of the nodes would be exact (low tolerances, or LUT based displays) the LUT is generated
+ * exactly after the coarse pass instead.
+ * Needs 13 bytes per node of address space (the 12 bytes of node values are touched only around exact nodes),
+ * 4 bytes per exact node and 16 bytes per refined cell.
+ * @param tolerance interpolation error allowed at cell midpoints on 0..1 scale (e.g. 8 / 65535). It is an estimate:
+ * nodes inside cells may exceed it near sharp bends of the transform.
+ * 0 or less - exact LUT as generate3dLutTo gives
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status generate3dLutAdaptive(char* ga_profile, char* display_profile, int grid, const Q3dLut_Output* output,
+    double tolerance, int threads);
+
+/**
+ * Same as generate3dLutAdaptive, but uses the opened transform.
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status q3dlut_chain_generate_adaptive(Q3dLut_Chain* chain, int grid, const Q3dLut_Output* output,
+    double tolerance, int threads);
+
+/**
+ * Handle of a LUT generated in the background by the internal pool of worker threads (one per core).
+ */
+typedef struct Q3dLut_Job Q3dLut_Job;
+
+/**
+ * Called from a worker thread after every done R plane of a job. Calls are serialized, done is not decreasing
+ * and reaches total when the LUT is complete. The callback may cancel the job, but must not wait for it or release it.
+ */
+typedef void (*Q3dLut_ProgressCallback)(void* user_data, int done, int total);
+
+/**
+ * Starts generation of the LUT in the background and returns at once. The profiles are linked by a worker,
+ * so load errors (Q3dLut_Error_CantOpenGA/CantOpenDisplay) are returned by q3dlut_job_wait.
+ * The output must stay valid until the job is finished or released.
+ * @param threads maximal number of workers on the job, 0 - all of them
+ * @param progress optional progress callback
+ * @param job receives the handle, must be released with q3dlut_job_release
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status generate3dLutAsync(char* ga_profile, char* display_profile, int grid, const Q3dLut_Output* output,
+    int threads, Q3dLut_ProgressCallback progress, void* user_data, Q3dLut_Job** job);
+
+/**
+ * Same as generate3dLutAsync, but uses the opened transform (the handle may be closed after the call).
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status q3dlut_chain_generate_async(Q3dLut_Chain* chain, int grid, const Q3dLut_Output* output,
+    int threads, Q3dLut_ProgressCallback progress, void* user_data, Q3dLut_Job** job);
+
+/**
+ * Checks the job without blocking.
+ * @param done, total if not null receive the number of done R planes and of all planes
+ * @return nonzero if the job is finished (done, failed or cancelled)
+ */
+extern "C" __declspec(dllexport)
+int q3dlut_job_poll(Q3dLut_Job* job, int* done, int* total);
+
+/**
+ * Blocks until the job is finished.
+ * @return Q3dLut_Ok if the LUT is complete, Q3dLut_Error_Cancelled or the error of the job
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status q3dlut_job_wait(Q3dLut_Job* job);
+
+/**
+ * Stops the job without blocking: no new R planes are started, planes being generated are finished
+ * (so the job stops within one plane) and the job releases its transform and working buffers.
+ */
+extern "C" __declspec(dllexport)
+void q3dlut_job_cancel(Q3dLut_Job* job);
+
+/**
+ * Cancels the job if it is still running, waits until it stops writing the output and releases the handle.
+ */
+extern "C" __declspec(dllexport)
+void q3dlut_job_release(Q3dLut_Job* job);
+
+enum Q3dLut_FileFormat
+{
+    Q3dLut_Cube = 0,     // Adobe/Resolve .cube
+    Q3dLut_3dl,          // Autodesk .3dl, 12 bit output
+    Q3dLut_Clf,          // Common LUT Format (CLF v3) LUT3D
+    Q3dLut_Binary        // "Q3DL", uint32 version (1) and grid, then uint16 RGB nodes, little endian, blue fastest
+};
+
+/**
+ * Receives the next piece of a streamed LUT file.
+ * @return nonzero on success, 0 stops the generation with Q3dLut_Error_CantWriteOutput
+ */
+typedef int (*Q3dLut_WriteCallback)(void* user_data, const void* data, size_t size);
+
+/**
+ * Generates the LUT straight into a file. Planes of the grid are formatted by the worker threads
+ * and written in order as soon as they are ready, so the whole table is never held in memory.
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status generate3dLutFile(char* ga_profile, char* display_profile, int grid, Q3dLut_FileFormat format, char* path, int threads);
+
+/**
+ * Same as generate3dLutFile, but uses the opened transform.
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status q3dlut_chain_write(Q3dLut_Chain* chain, int grid, Q3dLut_FileFormat format, const char* path, int threads);
+
+/**
+ * Same as q3dlut_chain_write, but passes the file contents to the callback (e.g. to write into a pipe or socket).
+ * The callback is called from one thread at a time, in file order.
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status q3dlut_chain_write_stream(Q3dLut_Chain* chain, int grid, Q3dLut_FileFormat format,
+    Q3dLut_WriteCallback callback, void* user_data, int threads);
+
+/**
+ * Limits the cache of linked transforms.
+ * @param max_chains maximal number of cached transforms, 0 - disable caching
+ * @param max_bytes approximate memory budget, 0 - no limit
+ */
+extern "C" __declspec(dllexport)
+void q3dlut_chain_cache_limits(unsigned int max_chains, unsigned long long max_bytes);
+
+enum Q3dLut_Interpolation
+{
+    Q3dLut_Tetrahedral = 0,
+    Q3dLut_Trilinear
+};
+
+enum Q3dLut_PixelType
+{
+    Q3dLut_Pixel8 = 0,   // 0..255 in uint8_t
+    Q3dLut_Pixel10,      // 0..1023 in uint16_t (low bits), larger values are clipped
+    Q3dLut_Pixel16       // 0..65535 in uint16_t
+};
+
+/**
+ * Describes an RGB image. Other samples of a pixel (e.g. alpha or padding) are left as they are.
+ */
+typedef struct Q3dLut_Image
+{
+    Q3dLut_Layout layout;
+    Q3dLut_PixelType type;
+    void* data[3];           // interleaved - data[0] only
+    int width;
+    int height;
+    size_t pixelStride;      // bytes between consecutive pixels (of a plane), 0 - packed
+    size_t rowStride;        // bytes between consecutive rows (of a plane), 0 - width * pixelStride
+} Q3dLut_Image;
+
+/**
+ * Handle of a LUT prepared for applying to images.
+ */
+typedef struct Q3dLut_Applier Q3dLut_Applier;
+
+/**
+ * Prepares a generated LUT (e.g. by generate3dLutTo) for applying to images. Nodes are copied, so the LUT
+ * may be released after the call. Interpolation is fixed point with 16 bit nodes, AVX2 or SSE4.1 is used when
+ * the CPU has it, with results identical to the plain code.
+ * @param grid grid of the LUT, 2..512
+ * @param lut nodes of the LUT in any layout and sample type, float values are clipped to 0..1
+ * @param applier receives the handle, must be released with q3dlut_applier_release
+ * @return Q3dLut_Error_WrongGridValue for a grid out of range, Q3dLut_Error_NullPointerForOutput if applier is null,
+ * Q3dLut_Error_Other if lut is null or invalid or the nodes don't fit in memory
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status q3dlut_applier_create(int grid, const Q3dLut_Output* lut, Q3dLut_Interpolation interpolation,
+    Q3dLut_Applier** applier);
+
+/**
+ * Releases the handle.
+ */
+extern "C" __declspec(dllexport)
+void q3dlut_applier_release(Q3dLut_Applier* applier);
+
+/**
+ * Applies the LUT to the image, rows are split among the threads. The handle may be used by several threads.
+ * @param dst destination of the same size as src, null - convert src in place. Pixel types of src and dst
+ * may differ, e.g. 10 bit frames may be converted to 8 bit ones.
+ * @param threads number of worker threads, 0 - use all cores
+ * @return Q3dLut_Error_Other if applier is null, Q3dLut_Error_WrongImage if src is null, src or dst is invalid
+ * (unknown type or layout, missing data, stride smaller than a pixel, no pixels) or dst differs from src in size
+ */
+extern "C" __declspec(dllexport)
+Q3dLut_Status q3dlut_apply(const Q3dLut_Applier* applier, const Q3dLut_Image* src, const Q3dLut_Image* dst, int threads);
+
 #endif // QUBYX3DLUTGENERATOR_H
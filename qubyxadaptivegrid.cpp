@@ -0,0 +1,379 @@
+/*
+ * Author: QUBYX Software Technologies LTD HK
+ * Copyright: QUBYX Software Technologies LTD HK
+ */
+
+#include "qubyxadaptivegrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const unsigned char nodeFree = 0;
+    const unsigned char nodeQueued = 1;
+    const unsigned char nodeExact = 2;
+
+    /**
+     * Tetrahedral interpolation in a cell, the tetrahedron is chosen by the order of fractions.
+     * @param corner values of the cell corners, index = 4 * R + 2 * G + B (0 or 1 each)
+     */
+    inline void tetrahedral(const float* const* corner, double x, double y, double z, double* out)
+    {
+        const float* c0 = corner[0];
+        const float* c1 = corner[7];
+        const float *a, *m;
+        double fa, fm, fl;
+        if (x >= y && y >= z)
+        {
+            a = corner[4]; m = corner[6]; fa = x; fm = y; fl = z;
+        }
+        else if (x >= z && z >= y)
+        {
+            a = corner[4]; m = corner[5]; fa = x; fm = z; fl = y;
+        }
+        else if (z >= x && x >= y)
+        {
+            a = corner[1]; m = corner[5]; fa = z; fm = x; fl = y;
+        }
+        else if (y >= x && x >= z)
+        {
+            a = corner[2]; m = corner[6]; fa = y; fm = x; fl = z;
+        }
+        else if (y >= z && z >= x)
+        {
+            a = corner[2]; m = corner[3]; fa = y; fm = z; fl = x;
+        }
+        else
+        {
+            a = corner[1]; m = corner[3]; fa = z; fm = y; fl = x;
+        }
+
+        for (int c = 0; c < 3; c++)
+            out[c] = c0[c] + fa * (a[c] - c0[c]) + fm * (m[c] - a[c]) + fl * (c1[c] - m[c]);
+    }
+}
+
+const size_t QubyxAdaptiveGrid::chunkSize;
+const size_t QubyxAdaptiveGrid::maxExactPart;
+
+QubyxAdaptiveGrid::QubyxAdaptiveGrid(QubyxProfileChain& chain, int grid, double tolerance, const Writer& writer)
+    : chain_(chain),
+    grid_(grid),
+    tolerance_(tolerance),
+    writer_(writer),
+    coarseStep_(1),
+    exactCount_(0),
+    phase_(Phase::Evaluate),
+    next_(0)
+{
+    //coarse step is the biggest power of two that divides the grid
+    while (2 * coarseStep_ <= maxCoarseStep && (grid_ - 1) % (2 * coarseStep_) == 0)
+        coarseStep_ *= 2;
+
+    //without coarse cells every node would be exact, node indices are kept in 32 bits
+    const size_t nodes = (size_t)grid * grid * grid;
+    if (coarseStep_ < 2 || nodes > UINT32_MAX)
+    {
+        phase_ = Phase::Abandoned;
+        return;
+    }
+
+    values_.reset(new float[3 * nodes]);
+    state_.assign(nodes, nodeFree);
+
+    for (int r = 0; r + coarseStep_ < grid_; r += coarseStep_)
+    {
+        for (int g = 0; g + coarseStep_ < grid_; g += coarseStep_)
+        {
+            for (int b = 0; b + coarseStep_ < grid_; b += coarseStep_)
+            {
+                Cell cell = { r, g, b, coarseStep_ };
+                active_.push_back(cell);
+                queueMidpoints(cell);
+            }
+        }
+    }
+}
+
+bool QubyxAdaptiveGrid::work(QubyxProfileChain::ApplyContext* context)
+{
+    switch (phase_)
+    {
+    case Phase::Evaluate:
+        for (size_t first = chunkSize * next_++; first < pending_.size(); first = chunkSize * next_++)
+        {
+            if (!evaluate(first, std::min(chunkSize, pending_.size() - first), context))
+                return false;
+        }
+        break;
+
+    case Phase::Test:
+        for (size_t first = chunkSize * next_++; first < active_.size(); first = chunkSize * next_++)
+        {
+            const size_t last = std::min(first + chunkSize, active_.size());
+            for (size_t i = first; i < last; i++)
+                split_[i] = needsSplit(active_[i]);
+        }
+        break;
+
+    case Phase::Fill:
+        for (size_t r = next_++; r < (size_t)grid_; r = next_++)
+            fill((int)r);
+        break;
+
+    case Phase::Complete:
+    case Phase::Abandoned:
+        break;
+    }
+
+    return true;
+}
+
+bool QubyxAdaptiveGrid::advance()
+{
+    next_ = 0;
+
+    switch (phase_)
+    {
+    case Phase::Evaluate:
+        exactCount_ += pending_.size();
+        pending_.clear();
+        if (active_.empty())
+            startFill();
+        else
+        {
+            split_.assign(active_.size(), 0);
+            phase_ = Phase::Test;
+        }
+        break;
+
+    case Phase::Test:
+    {
+        std::vector<Cell> children;
+        size_t refined = 0;     //nodes of split cells, all of them may turn exact
+        for (size_t i = 0; i < active_.size(); i++)
+        {
+            const Cell& cell = active_[i];
+            if (!split_[i])
+            {
+                done_.push_back(cell);
+                continue;
+            }
+
+            //cells of 2 nodes are exact after their midpoints are, fill only writes them
+            const int half = cell.size / 2;
+            if (half < 2)
+            {
+                done_.push_back(cell);
+                continue;
+            }
+
+            refined += (size_t)cell.size * cell.size * cell.size;
+            for (int j = 0; j < 8; j++)
+            {
+                Cell child = { cell.r + (j >> 2) * half, cell.g + ((j >> 1) & 1) * half, cell.b + (j & 1) * half, half };
+                children.push_back(child);
+                queueMidpoints(child);
+            }
+        }
+
+        active_.swap(children);
+        if (maxExactPart * (exactCount_ + refined) > state_.size())
+            phase_ = Phase::Abandoned;
+        else if (pending_.empty())
+            startFill();
+        else
+            phase_ = Phase::Evaluate;
+        break;
+    }
+
+    case Phase::Fill:
+    case Phase::Complete:
+        phase_ = Phase::Complete;
+        break;
+
+    case Phase::Abandoned:
+        break;
+    }
+
+    return phase_ != Phase::Complete && phase_ != Phase::Abandoned;
+}
+
+void QubyxAdaptiveGrid::queue(int r, int g, int b)
+{
+    const size_t i = index(r, g, b);
+    if (state_[i] == nodeFree)
+    {
+        state_[i] = nodeQueued;
+        pending_.push_back((uint32_t)i);
+    }
+}
+
+void QubyxAdaptiveGrid::queueMidpoints(const Cell& cell)
+{
+    const int half = cell.size / 2;
+    for (int i = 0; i <= 2; i++)
+        for (int j = 0; j <= 2; j++)
+            for (int k = 0; k <= 2; k++)
+                queue(cell.r + i * half, cell.g + j * half, cell.b + k * half);
+}
+
+void QubyxAdaptiveGrid::corners(const Cell& cell, const float* corner[8]) const
+{
+    for (int j = 0; j < 8; j++)
+        corner[j] = node(index(cell.r + (j >> 2) * cell.size, cell.g + ((j >> 1) & 1) * cell.size, cell.b + (j & 1) * cell.size));
+}
+
+void QubyxAdaptiveGrid::interpolate(const Cell& cell, int r, int g, int b, double* out) const
+{
+    const float* corner[8];
+    corners(cell, corner);
+    tetrahedral(corner, (double)(r - cell.r) / cell.size, (double)(g - cell.g) / cell.size,
+        (double)(b - cell.b) / cell.size, out);
+}
+
+bool QubyxAdaptiveGrid::evaluate(size_t first, size_t count, QubyxProfileChain::ApplyContext* context)
+{
+    std::vector<int> nodes(3 * count);
+    std::vector<double> out(3 * count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const size_t node = pending_[first + i];
+        nodes[3 * i + 0] = (int)(node / grid_ / grid_);
+        nodes[3 * i + 1] = (int)(node / grid_ % grid_);
+        nodes[3 * i + 2] = (int)(node % grid_);
+    }
+
+    if (!chain_.transformGridNodes(grid_, &nodes[0], count, &out[0], context))
+        return false;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const size_t node = pending_[first + i];
+        for (int c = 0; c < 3; c++)
+            values_[3 * node + c] = (float)out[3 * i + c];
+        state_[node] = nodeExact;
+    }
+
+    return true;
+}
+
+bool QubyxAdaptiveGrid::needsSplit(const Cell& cell) const
+{
+    const int half = cell.size / 2;
+    for (int i = 0; i <= 2; i++)
+    {
+        for (int j = 0; j <= 2; j++)
+        {
+            for (int k = 0; k <= 2; k++)
+            {
+                if (i != 1 && j != 1 && k != 1)
+                    continue;   //corner
+
+                const int r = cell.r + i * half, g = cell.g + j * half, b = cell.b + k * half;
+                double estimate[3];
+                interpolate(cell, r, g, b, estimate);
+
+                //error inside the cell is usually higher than at midpoints, most near the dark corner
+                const float* exact = node(index(r, g, b));
+                for (int c = 0; c < 3; c++)
+                    if (std::fabs(exact[c] - estimate[c]) > tolerance_ / midpointMargin)
+                        return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void QubyxAdaptiveGrid::startFill()
+{
+    //planes are filled one by one, so nodes of a plane are read and written close to each other
+    auto slab = [this](const Cell& cell) { return cell.r / coarseStep_; };
+    std::sort(done_.begin(), done_.end(), [&slab](const Cell& a, const Cell& b) {
+        if (slab(a) != slab(b))
+            return slab(a) < slab(b);
+        return (a.g != b.g) ? a.g < b.g : a.b < b.b;
+    });
+
+    slabs_.assign(1, 0);
+    for (size_t i = 1; i <= done_.size(); i++)
+        if (i == done_.size() || slab(done_[i]) != slab(done_[i - 1]))
+            slabs_.push_back(i);
+
+    phase_ = Phase::Fill;
+}
+
+void QubyxAdaptiveGrid::fill(int r)
+{
+    //a cell owns its nodes except the far faces, which belong to the next cells (or to it at the grid end),
+    //so every node is written by one done cell
+    auto last = [this](int first, int size) {
+        return (first + size == grid_ - 1) ? size : size - 1;
+    };
+
+    double fraction[maxCoarseStep + 1];
+    double row[3 * (maxCoarseStep + 1)];
+
+    const size_t slab = std::min<size_t>(r / coarseStep_, slabs_.size() - 2);
+    for (size_t i = slabs_[slab]; i < slabs_[slab + 1]; i++)
+    {
+        const Cell& cell = done_[i];
+        const int cr = r - cell.r;
+        if (cr < 0 || cr > last(cell.r, cell.size))
+            continue;
+
+        const float* corner[8];
+        corners(cell, corner);
+        for (int j = 0; j <= cell.size; j++)
+            fraction[j] = (double)j / cell.size;
+
+        //along B the tetrahedron changes only at b = r and b = g, steps between are differences of two corners:
+        //B below both R and G, between them (R above or G above) and above both
+        double step[4][3];
+        for (int c = 0; c < 3; c++)
+        {
+            step[0][c] = ((double)corner[7][c] - corner[6][c]) / cell.size;
+            step[1][c] = ((double)corner[5][c] - corner[4][c]) / cell.size;
+            step[2][c] = ((double)corner[3][c] - corner[2][c]) / cell.size;
+            step[3][c] = ((double)corner[1][c] - corner[0][c]) / cell.size;
+        }
+
+        const int lastG = last(cell.g, cell.size), lastB = last(cell.b, cell.size);
+        for (int g = 0; g <= lastG; g++)
+        {
+            const int low = std::min(cr, g), high = std::max(cr, g);
+            const double* middle = step[(cr >= g) ? 1 : 2];
+
+            double value[3];
+            tetrahedral(corner, fraction[cr], fraction[g], 0, value);
+
+            const size_t first = index(r, cell.g + g, cell.b);
+            for (int b = 0; b <= lastB; b++)
+            {
+                if (b > 0)
+                {
+                    const double* d = (b <= low) ? step[0] : ((b <= high) ? middle : step[3]);
+                    for (int c = 0; c < 3; c++)
+                        value[c] += d[c];
+                }
+
+                double* out = &row[3 * b];
+                if (state_[first + b] == nodeExact)
+                {
+                    const float* exact = node(first + b);
+                    for (int c = 0; c < 3; c++)
+                        out[c] = exact[c];
+                }
+                else
+                {
+                    for (int c = 0; c < 3; c++)
+                        out[c] = value[c];
+                }
+            }
+
+            writer_(first, row, lastB + 1);
+        }
+    }
+}
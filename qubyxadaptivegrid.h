@@ -0,0 +1,127 @@
+/*
+ * Author: QUBYX Software Technologies LTD HK
+ * Copyright: QUBYX Software Technologies LTD HK
+ */
+
+#ifndef QUBYXADAPTIVEGRID_H
+#define QUBYXADAPTIVEGRID_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include "qubyxprofilechain.h"
+
+/**
+ * Samples a 3 channel device chain on a regular grid (node index = R * grid * grid + G * grid + B),
+ * running the exact transform only where the LUT is not smooth enough.
+ *
+ * A coarse grid is evaluated first. Each cell is then checked at its midpoints (edge, face and center nodes):
+ * if tetrahedral interpolation from the cell corners differs from the exact transform by more than the tolerance,
+ * the cell is split in 8 and its children are checked the same way, otherwise the rest of the cell is interpolated.
+ * Interpolated nodes go to the writer only, exact ones are kept for the checks.
+ *
+ * Refinement pays off only while few nodes are exact: computing scattered nodes and interpolating the rest costs more
+ * per node than transforming whole grid lines. So the grid gives up (see complete()) as soon as split cells hold more
+ * than 1 / maxExactPart of the nodes, and the caller should generate the LUT exactly instead.
+ *
+ * Work is done in phases: work() may be called from several threads at once (each with own apply context),
+ * advance() is called from one thread after all work() calls of the phase returned:
+ * @code
+ * do {
+ *     //run work(context) on all threads
+ * } while (grid.advance());
+ * @endcode
+ */
+class QubyxAdaptiveGrid
+{
+public:
+    /**
+     * Receives count nodes (3 output values each) starting at node index. Called by work() of the last phase,
+     * from several threads at once for different nodes. Every node is written once.
+     */
+    typedef std::function<void(size_t index, const double* values, int count)> Writer;
+
+    /**
+     * @param tolerance allowed interpolation error of output values (0..1 scale) at cell midpoints. It is an estimate,
+     * nodes inside cells may exceed it
+     * @param writer receives all nodes of a complete grid
+     */
+    QubyxAdaptiveGrid(QubyxProfileChain& chain, int grid, double tolerance, const Writer& writer);
+
+    /**
+     * @brief work does a part of the current phase, returns when nothing is left
+     * @return false if transform failed
+     */
+    bool work(QubyxProfileChain::ApplyContext* context);
+
+    /**
+     * @brief advance moves to the next phase
+     * @return false when the grid is complete or refinement was given up
+     */
+    bool advance();
+
+    /** true if all nodes were written, false if refinement was given up (too many exact nodes) */
+    bool complete() const { return phase_ == Phase::Complete; }
+
+    /** number of nodes computed by the chain */
+    size_t exactNodes() const { return exactCount_; }
+
+private:
+    enum class Phase
+    {
+        Evaluate,   //exact transform of pending nodes
+        Test,       //interpolation error of active cells
+        Fill,       //interpolation of the rest of done cells and writing, by R planes
+        Complete,
+        Abandoned   //too many exact nodes, nothing was written
+    };
+
+    struct Cell
+    {
+        int r, g, b;    //first corner
+        int size;
+    };
+
+    QubyxProfileChain& chain_;
+    const int grid_;
+    const double tolerance_;
+    const Writer writer_;
+    int coarseStep_;
+
+    std::unique_ptr<float[]> values_;      //of exact nodes, others are not initialized
+    std::vector<unsigned char> state_;    //nodeFree, nodeQueued or nodeExact
+    size_t exactCount_;
+
+    Phase phase_;
+    std::atomic<size_t> next_;            //next chunk of the current phase
+    std::vector<uint32_t> pending_;
+    std::vector<Cell> active_, done_;
+    std::vector<size_t> slabs_;           //first done cell of every coarse R slab and the end, for Fill
+    std::vector<unsigned char> split_;    //per active cell
+
+    static const int maxCoarseStep = 8;
+    static const int midpointMargin = 2;   //midpoint errors are checked against tolerance / midpointMargin
+    static const size_t chunkSize = 256;
+    static const size_t maxExactPart = 3;  //refinement is given up when over 1 / maxExactPart of nodes may turn exact
+
+    size_t index(int r, int g, int b) const { return ((size_t)r * grid_ + g) * grid_ + b; }
+
+    void queue(int r, int g, int b);
+    void queueMidpoints(const Cell& cell);
+    /** 3 output values of an exact node */
+    const float* node(size_t index) const { return &values_[3 * index]; }
+
+    void corners(const Cell& cell, const float* corner[8]) const;
+    void interpolate(const Cell& cell, int r, int g, int b, double* out) const;
+
+    bool evaluate(size_t first, size_t count, QubyxProfileChain::ApplyContext* context);
+    bool needsSplit(const Cell& cell) const;
+    void startFill();
+    /** writes nodes of an R plane */
+    void fill(int r);
+};
+
+#endif // QUBYXADAPTIVEGRID_H
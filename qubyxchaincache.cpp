@@ -0,0 +1,137 @@
+/*
+ * Author: QUBYX Software Technologies LTD HK
+ * Copyright: QUBYX Software Technologies LTD HK
+ */
+
+#include "qubyxchaincache.h"
+
+#include <list>
+#include <map>
+#include <mutex>
+
+namespace
+{
+    struct Entry
+    {
+        std::string key;
+        QubyxChainCache::ChainPtr chain;
+        size_t bytes;
+    };
+
+    struct CacheData
+    {
+        CacheData() : maxChains_(16), maxBytes_(256 * 1024 * 1024), bytes_(0) {}
+
+        std::mutex lock_;
+        std::list<Entry> chains_;    //most recently used first
+        std::map<std::string, std::list<Entry>::iterator> byKey_;
+        size_t maxChains_, maxBytes_;
+        size_t bytes_;
+
+        QubyxChainCache::ChainPtr find(const std::string& key)
+        {
+            auto it = byKey_.find(key);
+            if (it == byKey_.end())
+                return QubyxChainCache::ChainPtr();
+
+            chains_.splice(chains_.begin(), chains_, it->second);
+            return it->second->chain;
+        }
+
+        void trim()
+        {
+            //the most recent chain is kept even if it alone is over the budget
+            while (chains_.size() > maxChains_
+                || (maxBytes_ && bytes_ > maxBytes_ && chains_.size() > 1))
+            {
+                bytes_ -= chains_.back().bytes;
+                byKey_.erase(chains_.back().key);
+                chains_.pop_back();
+            }
+        }
+    };
+
+    CacheData& cache()
+    {
+        static CacheData data;
+        return data;
+    }
+}
+
+std::string QubyxChainCache::makeKey(const std::vector<std::string>& profileKeys, QubyxProfileChain::RI renderingIntent,
+    QubyxProfileChain::SpaceType in, QubyxProfileChain::SpaceType out)
+{
+    std::string key;
+    key += (char)renderingIntent;
+    key += (char)in;
+    key += (char)out;
+
+    for (const auto& profileKey : profileKeys)
+    {
+        unsigned size = (unsigned)profileKey.size();
+        key.append((const char*)&size, sizeof(size));
+        key += profileKey;
+    }
+
+    return key;
+}
+
+QubyxChainCache::ChainPtr QubyxChainCache::get(const std::string& key, const Builder& build)
+{
+    CacheData& data = cache();
+
+    {
+        std::lock_guard<std::mutex> guard(data.lock_);
+
+        ChainPtr chain = data.find(key);
+        if (chain)
+            return chain;
+    }
+
+    //linking is the expensive part, other chains are served meanwhile
+    ChainPtr chain = build();
+    if (!chain || !chain->isChainComplete())
+        return ChainPtr();
+
+    std::lock_guard<std::mutex> guard(data.lock_);
+
+    //another thread may have linked the same chain meanwhile
+    ChainPtr cached = data.find(key);
+    if (cached)
+        return cached;
+
+    if (data.maxChains_)
+    {
+        Entry entry;
+        entry.key = key;
+        entry.chain = chain;
+        entry.bytes = chain->approximateSize();
+
+        data.chains_.push_front(entry);
+        data.byKey_[key] = data.chains_.begin();
+        data.bytes_ += entry.bytes;
+        data.trim();
+    }
+
+    return chain;
+}
+
+void QubyxChainCache::setLimits(size_t maxChains, size_t maxBytes)
+{
+    CacheData& data = cache();
+    std::lock_guard<std::mutex> guard(data.lock_);
+
+    data.maxChains_ = maxChains;
+    data.maxBytes_ = maxBytes;
+    data.trim();
+}
+
+void QubyxChainCache::clear()
+{
+    CacheData& data = cache();
+    std::lock_guard<std::mutex> guard(data.lock_);
+
+    data.chains_.clear();
+    data.byKey_.clear();
+    data.bytes_ = 0;
+}
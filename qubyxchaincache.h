@@ -0,0 +1,60 @@
+/*
+ * Author: QUBYX Software Technologies LTD HK
+ * Copyright: QUBYX Software Technologies LTD HK
+ */
+
+#ifndef QUBYXCHAINCACHE_H
+#define QUBYXCHAINCACHE_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "qubyxprofilechain.h"
+
+/**
+ * Process-wide cache of complete (linked and begun) profile chains. Thread safe.
+ *
+ * A chain is identified by the content keys of its profiles (see QubyxProfileCache::load),
+ * rendering intent and in/out space types. Cached chains are shared: users must transform
+ * through their own apply contexts (QubyxProfileChain::newApplyContext) and must not modify
+ * the chain. The least recently used chains are dropped when more than maxChains are held or
+ * their approximate size (QubyxProfileChain::approximateSize) exceeds maxBytes.
+ */
+class QubyxChainCache
+{
+public:
+    typedef std::shared_ptr<QubyxProfileChain> ChainPtr;
+    typedef std::function<ChainPtr()> Builder;
+
+    /**
+     * @brief makeKey builds the cache key of a chain
+     * @param profileKeys content keys of the chain profiles in chain order
+     */
+    static std::string makeKey(const std::vector<std::string>& profileKeys, QubyxProfileChain::RI renderingIntent,
+        QubyxProfileChain::SpaceType in, QubyxProfileChain::SpaceType out);
+
+    /**
+     * @brief get returns the cached chain or builds it
+     * @param key chain key (see makeKey)
+     * @param build called outside of the cache lock on a miss, returns filled chain or empty pointer
+     * @return complete chain or empty pointer if build failed or the chain can't be completed
+     */
+    static ChainPtr get(const std::string& key, const Builder& build);
+
+    /**
+     * @brief setLimits limits the cache, 0 for maxChains disables caching, 0 for maxBytes - no size limit
+     */
+    static void setLimits(size_t maxChains, size_t maxBytes);
+
+    /**
+     * @brief clear drops all cached chains (chains still referenced stay alive)
+     */
+    static void clear();
+
+private:
+    QubyxChainCache();
+};
+
+#endif // QUBYXCHAINCACHE_H
@@ -0,0 +1,222 @@
+/*
+ * Author: QUBYX Software Technologies LTD HK
+ * Copyright: QUBYX Software Technologies LTD HK
+ */
+
+#include "qubyxjobpool.h"
+
+#include <algorithm>
+#include <thread>
+
+QubyxJobPool::Job::Job(int slabs, int maxWorkers)
+    : slabs_(std::max(slabs, 1)),
+    maxWorkers_(std::max(maxWorkers, 0)),
+    stage_(Stage::Queued),
+    next_(0),
+    done_(0),
+    workers_(0),
+    failed_(false),
+    cancelled_(false),
+    finished_(false)
+{
+
+}
+
+QubyxJobPool::Job::State QubyxJobPool::Job::state(int* done, int* total) const
+{
+    QubyxJobPool& owner = pool();
+    std::lock_guard<std::mutex> guard(owner.lock_);
+
+    if (done)
+        *done = done_;
+    if (total)
+        *total = slabs_;
+
+    if (!finished_)
+        return State::Running;
+    if (failed_)
+        return State::Failed;
+    return (done_ == slabs_) ? State::Done : State::Cancelled;
+}
+
+QubyxJobPool::Job::State QubyxJobPool::Job::wait() const
+{
+    {
+        QubyxJobPool& owner = pool();
+        std::unique_lock<std::mutex> lock(owner.lock_);
+        finishedChanged_.wait(lock, [this]() { return finished_; });
+    }
+
+    return state();
+}
+
+void QubyxJobPool::Job::cancel()
+{
+    QubyxJobPool& owner = pool();
+    std::lock_guard<std::mutex> guard(owner.lock_);
+
+    if (finished_)
+        return;
+
+    cancelled_ = true;
+    owner.dequeue(*this);
+    owner.finishIfDone(*this);
+}
+
+void QubyxJobPool::submit(const JobPtr& job)
+{
+    QubyxJobPool& owner = pool();
+    {
+        std::lock_guard<std::mutex> guard(owner.lock_);
+        owner.queue_.push_back(job);
+    }
+    owner.jobsChanged_.notify_all();
+}
+
+QubyxJobPool::QubyxJobPool()
+{
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned i = 0; i < threads; i++)
+        std::thread(&QubyxJobPool::workerLoop, this).detach();
+}
+
+QubyxJobPool& QubyxJobPool::pool()
+{
+    //never destroyed: workers wait for jobs until the process ends, joining them
+    //from static destructors would deadlock on DLL unload
+    static QubyxJobPool* instance = new QubyxJobPool;
+    return *instance;
+}
+
+void QubyxJobPool::workerLoop()
+{
+    JobPtr current;
+    QubyxChainCache::ChainPtr chain;
+    std::unique_ptr<QubyxProfileChain::ApplyContext> context;
+
+    std::unique_lock<std::mutex> lock(lock_);
+    for (;;)
+    {
+        int slab = -1;
+        JobPtr job;
+        jobsChanged_.wait(lock, [&]() { return (job = take(slab)) != nullptr; });
+
+        if (job != current)
+        {
+            context.reset();
+            current = job;
+        }
+        chain = job->chain_;
+
+        lock.unlock();
+
+        bool ok = true;
+        if (slab < 0)
+            chain = job->prepare();
+        else
+        {
+            if (!context)
+                context = chain->newApplyContext();
+            ok = context && job->run(slab, *chain, context.get());
+        }
+
+        lock.lock();
+
+        if (slab < 0)
+        {
+            if (chain)
+            {
+                job->chain_ = chain;
+                job->stage_ = Job::Stage::Ready;
+            }
+            else
+                job->failed_ = true;
+
+            //slabs of the job can be taken now
+            jobsChanged_.notify_all();
+        }
+        else if (ok)
+            job->done_++;
+        else
+            job->failed_ = true;
+
+        if (job->failed_)
+            dequeue(*job);
+
+        //nothing more to take: the chain and the apply context are released right away
+        if (job->next_ >= job->slabs_ || job->cancelled_ || job->failed_)
+        {
+            context.reset();
+            chain.reset();
+            current.reset();
+        }
+
+        //the worker stays counted on the job until progress returns,
+        //so the job can't finish (and be released by its owner) during the callback
+        if (slab >= 0 && ok && !job->failed_ && !job->cancelled_)
+        {
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> guard(job->progressLock_);
+                int done;
+                {
+                    std::lock_guard<std::mutex> poolGuard(lock_);
+                    done = job->done_;
+                }
+                job->progress(done, job->slabs_);
+            }
+            lock.lock();
+        }
+
+        job->workers_--;
+        finishIfDone(*job);
+    }
+}
+
+QubyxJobPool::JobPtr QubyxJobPool::take(int& slab)
+{
+    for (const JobPtr& job : queue_)
+    {
+        if (job->stage_ == Job::Stage::Preparing)
+            continue;
+        if (job->maxWorkers_ && job->workers_ >= job->maxWorkers_)
+            continue;
+
+        job->workers_++;
+        if (job->stage_ == Job::Stage::Queued)
+        {
+            job->stage_ = Job::Stage::Preparing;
+            slab = -1;
+            return job;
+        }
+
+        slab = job->next_++;
+        JobPtr res = job;
+        if (job->next_ >= job->slabs_)
+            dequeue(*job);
+        return res;
+    }
+
+    return JobPtr();
+}
+
+void QubyxJobPool::finishIfDone(Job& job)
+{
+    if (job.finished_ || job.workers_)
+        return;
+
+    if (job.failed_ || job.cancelled_ || job.done_ == job.slabs_)
+    {
+        dequeue(job);
+        job.chain_.reset();
+        job.finished_ = true;
+        job.finishedChanged_.notify_all();
+    }
+}
+
+void QubyxJobPool::dequeue(const Job& job)
+{
+    auto it = std::find_if(queue_.begin(), queue_.end(), [&job](const JobPtr& queued) { return queued.get() == &job; });
+    if (it != queue_.end())
+        queue_.erase(it);
+}
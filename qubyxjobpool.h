@@ -0,0 +1,136 @@
+/*
+ * Author: QUBYX Software Technologies LTD HK
+ * Copyright: QUBYX Software Technologies LTD HK
+ */
+
+#ifndef QUBYXJOBPOOL_H
+#define QUBYXJOBPOOL_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "qubyxchaincache.h"
+
+/**
+ * Process-wide pool of worker threads (one per core) running jobs in the background. Thread safe.
+ *
+ * A job is a number of slabs (e.g. R planes of a LUT) transformed through one chain. The chain is linked by
+ * the first worker that takes the job (Job::prepare), then slabs are taken by any free workers, the oldest
+ * job first. Every worker keeps its own apply context of the chain while it works on the job and releases
+ * it as soon as the job has no slabs left for it.
+ *
+ * A cancelled job gets no new slabs: it finishes when the slabs already being transformed are done.
+ */
+class QubyxJobPool
+{
+public:
+    class Job
+    {
+    public:
+        enum class State
+        {
+            Running,    //queued or being worked on
+            Done,
+            Failed,
+            Cancelled
+        };
+
+        /**
+         * @param slabs number of slabs, at least 1
+         * @param maxWorkers maximal number of workers transforming slabs of the job at once, 0 - no limit
+         */
+        Job(int slabs, int maxWorkers);
+        virtual ~Job() {}
+
+        /**
+         * @brief state tells the state of the job
+         * @param done if not null receives the number of done slabs
+         * @param total if not null receives the number of slabs
+         */
+        State state(int* done = nullptr, int* total = nullptr) const;
+
+        /**
+         * @brief wait blocks until the job is finished, must not be called from the job itself (e.g. progress)
+         */
+        State wait() const;
+
+        /**
+         * @brief cancel stops the job, slabs being transformed are finished. Does nothing for finished jobs.
+         */
+        void cancel();
+
+    protected:
+        /**
+         * @brief prepare links the chain, called once by a worker before any slab
+         * @return complete chain or empty pointer to fail the job
+         */
+        virtual QubyxChainCache::ChainPtr prepare() = 0;
+
+        /**
+         * @brief run transforms one slab, called by several workers at once
+         */
+        virtual bool run(int slab, QubyxProfileChain& chain, QubyxProfileChain::ApplyContext* context) = 0;
+
+        /**
+         * @brief progress is called by a worker after every done slab, calls are serialized and done is not decreasing.
+         * The job finishes (wait returns) only after the last call returned.
+         */
+        virtual void progress(int done, int total) { (void)done; (void)total; }
+
+    private:
+        enum class Stage
+        {
+            Queued,     //no worker took the job yet
+            Preparing,
+            Ready
+        };
+
+        const int slabs_;
+        const int maxWorkers_;
+
+        //guarded by the pool lock
+        Stage stage_;
+        QubyxChainCache::ChainPtr chain_;
+        int next_;          //next slab to take
+        int done_;
+        int workers_;       //workers running prepare or slabs of the job
+        bool failed_;
+        bool cancelled_;
+        bool finished_;
+        mutable std::condition_variable finishedChanged_;
+
+        std::mutex progressLock_;
+
+        friend class QubyxJobPool;
+    };
+
+    typedef std::shared_ptr<Job> JobPtr;
+
+    /**
+     * @brief submit queues the job, starts the pool on first use
+     */
+    static void submit(const JobPtr& job);
+
+private:
+    QubyxJobPool();
+
+    std::mutex lock_;
+    std::condition_variable jobsChanged_;
+    std::vector<JobPtr> queue_;     //jobs with slabs or prepare left, oldest first
+
+    static QubyxJobPool& pool();
+
+    void workerLoop();
+    /**
+     * @brief take finds work for a worker, must be called under lock_
+     * @return job or empty pointer if none has work, slab is -1 for prepare
+     */
+    JobPtr take(int& slab);
+    /** finishes the job if no worker is on it and nothing is left, must be called under lock_ */
+    void finishIfDone(Job& job);
+    void dequeue(const Job& job);
+};
+
+#endif // QUBYXJOBPOOL_H
@@ -0,0 +1,500 @@
+/*
+ * Author: QUBYX Software Technologies LTD HK
+ * Copyright: QUBYX Software Technologies LTD HK
+ */
+
+#include "qubyxlutapply.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "ICCProfLib/IccUtil.h"
+
+#ifdef ICC_USE_SSE41
+#include <smmintrin.h>
+#endif
+#ifdef ICC_USE_AVX2
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    const uint32_t one = 1 << 15;       //weight of a whole cell
+    const uint32_t half = 1 << 14;
+
+    /**
+     * x / 65535 rounded down, exact for x < 2^31.
+     */
+    inline uint32_t div65535(uint32_t x)
+    {
+        return (x + (x >> 16) + 1) >> 16;
+    }
+
+    inline int32_t lerp(int32_t a, int32_t b, int32_t fraction)
+    {
+        return a + (((b - a) * fraction + (int32_t)half) >> 15);
+    }
+
+    /**
+     * First sample of channel c of the row, pixels follow each pixelStride bytes.
+     */
+    inline char* channel(const QubyxLutApply::Buffer& buffer, int c, int row)
+    {
+        if (buffer.planar)
+            return (char*)buffer.plane[c] + row * buffer.rowStride;
+        return (char*)buffer.plane[0] + row * buffer.rowStride + c * QubyxLutApply::sampleSize(buffer.type);
+    }
+
+#ifdef ICC_USE_SSE41
+    ICC_TARGET_SSE41 inline __m128i div65535SSE41(__m128i x)
+    {
+        return _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(x, _mm_srli_epi32(x, 16)), _mm_set1_epi32(1)), 16);
+    }
+
+    ICC_TARGET_SSE41 inline __m128i loadSSE41(const uint16_t* p)
+    {
+        return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)p));
+    }
+
+    ICC_TARGET_SSE41 inline void storeSSE41(uint16_t* p, __m128i v)
+    {
+        _mm_storel_epi64((__m128i*)p, _mm_packus_epi32(v, v));
+    }
+
+    /** same as QubyxLutApply::position for 4 values, returns the index */
+    ICC_TARGET_SSE41 inline __m128i positionSSE41(__m128i value, __m128i last, __m128i lastCell, __m128i& fraction)
+    {
+        const __m128i q = _mm_mullo_epi32(value, last);
+        __m128i index = div65535SSE41(q);
+        const __m128i rest = _mm_sub_epi32(q, _mm_mullo_epi32(index, _mm_set1_epi32(65535)));
+        fraction = div65535SSE41(_mm_add_epi32(_mm_slli_epi32(rest, 15), _mm_set1_epi32(one - 1)));
+
+        const __m128i edge = _mm_cmpgt_epi32(index, lastCell);
+        index = _mm_min_epi32(index, lastCell);
+        fraction = _mm_or_si128(fraction, _mm_and_si128(edge, _mm_set1_epi32(one)));
+        return index;
+    }
+
+    /** RGB of the nodes starting at the given samples */
+    ICC_TARGET_SSE41 inline void gatherSSE41(const uint16_t* nodes, __m128i at, __m128i rgb[3])
+    {
+        int32_t i[4];
+        _mm_storeu_si128((__m128i*)i, at);
+        for (int c = 0; c < 3; c++)
+            rgb[c] = _mm_setr_epi32(nodes[i[0] + c], nodes[i[1] + c], nodes[i[2] + c], nodes[i[3] + c]);
+    }
+
+    ICC_TARGET_SSE41 inline __m128i lerpSSE41(__m128i a, __m128i b, __m128i fraction)
+    {
+        const __m128i d = _mm_mullo_epi32(_mm_sub_epi32(b, a), fraction);
+        return _mm_add_epi32(a, _mm_srai_epi32(_mm_add_epi32(d, _mm_set1_epi32(half)), 15));
+    }
+#endif
+
+#ifdef ICC_USE_AVX2
+    ICC_TARGET_AVX2 inline __m256i div65535AVX2(__m256i x)
+    {
+        return _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(x, _mm256_srli_epi32(x, 16)), _mm256_set1_epi32(1)), 16);
+    }
+
+    ICC_TARGET_AVX2 inline __m256i loadAVX2(const uint16_t* p)
+    {
+        return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p));
+    }
+
+    ICC_TARGET_AVX2 inline void storeAVX2(uint16_t* p, __m256i v)
+    {
+        _mm_storeu_si128((__m128i*)p, _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+    }
+
+    /** same as QubyxLutApply::position for 8 values, returns the index */
+    ICC_TARGET_AVX2 inline __m256i positionAVX2(__m256i value, __m256i last, __m256i lastCell, __m256i& fraction)
+    {
+        const __m256i q = _mm256_mullo_epi32(value, last);
+        __m256i index = div65535AVX2(q);
+        const __m256i rest = _mm256_sub_epi32(q, _mm256_mullo_epi32(index, _mm256_set1_epi32(65535)));
+        fraction = div65535AVX2(_mm256_add_epi32(_mm256_slli_epi32(rest, 15), _mm256_set1_epi32(one - 1)));
+
+        const __m256i edge = _mm256_cmpgt_epi32(index, lastCell);
+        index = _mm256_min_epi32(index, lastCell);
+        fraction = _mm256_or_si256(fraction, _mm256_and_si256(edge, _mm256_set1_epi32(one)));
+        return index;
+    }
+
+    /** RGB of the nodes starting at the given samples, R and G come in one 32 bit gather */
+    ICC_TARGET_AVX2 inline void gatherAVX2(const uint16_t* nodes, __m256i at, __m256i rgb[3])
+    {
+        const __m256i mask = _mm256_set1_epi32(0xffff);
+        const __m256i rg = _mm256_i32gather_epi32((const int*)nodes, at, 2);
+        const __m256i b = _mm256_i32gather_epi32((const int*)nodes, _mm256_add_epi32(at, _mm256_set1_epi32(2)), 2);
+        rgb[0] = _mm256_and_si256(rg, mask);
+        rgb[1] = _mm256_srli_epi32(rg, 16);
+        rgb[2] = _mm256_and_si256(b, mask);
+    }
+
+    ICC_TARGET_AVX2 inline __m256i lerpAVX2(__m256i a, __m256i b, __m256i fraction)
+    {
+        const __m256i d = _mm256_mullo_epi32(_mm256_sub_epi32(b, a), fraction);
+        return _mm256_add_epi32(a, _mm256_srai_epi32(_mm256_add_epi32(d, _mm256_set1_epi32(half)), 15));
+    }
+#endif
+}
+
+const int QubyxLutApply::chunkSize;
+
+QubyxLutApply::QubyxLutApply(int grid, const uint16_t* nodes, Interpolation interpolation)
+    : grid_(grid),
+    nodes_(nodes, nodes + 3 * (size_t)grid * grid * grid)
+{
+    nodes_.push_back(0);
+
+    stride_[0] = 3 * grid_ * grid_;
+    stride_[1] = 3 * grid_;
+    stride_[2] = 3;
+
+    const bool tetrahedral = (interpolation == Interpolation::Tetrahedral);
+    kernel_ = tetrahedral ? &QubyxLutApply::tetrahedral : &QubyxLutApply::trilinear;
+#ifdef ICC_USE_SSE41
+    if (icCpuHasSSE41())
+        kernel_ = tetrahedral ? &QubyxLutApply::tetrahedralSSE41 : &QubyxLutApply::trilinearSSE41;
+#endif
+#ifdef ICC_USE_AVX2
+    if (icCpuHasAVX2())
+        kernel_ = tetrahedral ? &QubyxLutApply::tetrahedralAVX2 : &QubyxLutApply::trilinearAVX2;
+#endif
+}
+
+void QubyxLutApply::convertRows(const Buffer& src, const Buffer& dst, int width, int firstRow, int rows) const
+{
+    uint16_t in[3][chunkSize], out[3][chunkSize];
+    uint16_t* const inPtr[3] = { in[0], in[1], in[2] };
+    uint16_t* const outPtr[3] = { out[0], out[1], out[2] };
+
+    //a chunk is read completely before it is written, so src and dst may be the same pixels
+    for (int row = firstRow; row < firstRow + rows; row++)
+    {
+        for (int first = 0; first < width; first += chunkSize)
+        {
+            const int count = std::min(chunkSize, width - first);
+            unpack(src, row, first, count, inPtr);
+            (this->*kernel_)(inPtr, outPtr, count);
+            pack(outPtr, dst, row, first, count);
+        }
+    }
+}
+
+void QubyxLutApply::unpack(const Buffer& src, int row, int first, int count, uint16_t* const in[3]) const
+{
+    for (int c = 0; c < 3; c++)
+    {
+        const char* p = channel(src, c, row) + first * src.pixelStride;
+        uint16_t* values = in[c];
+
+        switch (src.type)
+        {
+        case SampleType::UInt8:
+            for (int i = 0; i < count; i++, p += src.pixelStride)
+                values[i] = (uint16_t)(*(const uint8_t*)p * 257);
+            break;
+        case SampleType::UInt10:
+            for (int i = 0; i < count; i++, p += src.pixelStride)
+            {
+                uint16_t v;
+                memcpy(&v, p, sizeof(v));
+                v = std::min<uint16_t>(v, 1023);
+                values[i] = (uint16_t)((v << 6) | (v >> 4));
+            }
+            break;
+        case SampleType::UInt16:
+            for (int i = 0; i < count; i++, p += src.pixelStride)
+                memcpy(&values[i], p, sizeof(uint16_t));
+            break;
+        }
+    }
+}
+
+void QubyxLutApply::pack(const uint16_t* const out[3], const Buffer& dst, int row, int first, int count) const
+{
+    for (int c = 0; c < 3; c++)
+    {
+        char* p = channel(dst, c, row) + first * dst.pixelStride;
+        const uint16_t* values = out[c];
+
+        switch (dst.type)
+        {
+        case SampleType::UInt8:
+            for (int i = 0; i < count; i++, p += dst.pixelStride)
+                *(uint8_t*)p = (uint8_t)div65535(values[i] * 255u + 32767);
+            break;
+        case SampleType::UInt10:
+            for (int i = 0; i < count; i++, p += dst.pixelStride)
+            {
+                const uint16_t v = (uint16_t)div65535(values[i] * 1023u + 32767);
+                memcpy(p, &v, sizeof(v));
+            }
+            break;
+        case SampleType::UInt16:
+            for (int i = 0; i < count; i++, p += dst.pixelStride)
+                memcpy(p, &values[i], sizeof(uint16_t));
+            break;
+        }
+    }
+}
+
+void QubyxLutApply::position(uint32_t value, uint32_t& index, uint32_t& fraction) const
+{
+    const uint32_t q = value * (grid_ - 1);
+    index = div65535(q);
+    fraction = div65535((q - index * 65535) * one + one - 1);
+
+    //the last node is the far corner of the last cell
+    if (index > (uint32_t)grid_ - 2)
+    {
+        index = grid_ - 2;
+        fraction = one;
+    }
+}
+
+void QubyxLutApply::tetrahedral(const uint16_t* const in[3], uint16_t* const out[3], int count) const
+{
+    const uint16_t* nodes = &nodes_[0];
+    const int total = stride_[0] + stride_[1] + stride_[2];
+
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t ir, ig, ib, fr, fg, fb;
+        position(in[0][i], ir, fr);
+        position(in[1][i], ig, fg);
+        position(in[2][i], ib, fb);
+
+        //the tetrahedron goes from the base node along the axis of the biggest fraction,
+        //then along the second one to the far corner
+        const uint32_t f1 = std::max(std::max(fr, fg), fb);
+        const uint32_t f3 = std::min(std::min(fr, fg), fb);
+        const uint32_t f2 = fr + fg + fb - f1 - f3;
+        const int maxStride = (fr >= fg && fr >= fb) ? stride_[0] : (fg >= fb) ? stride_[1] : stride_[2];
+        const int minStride = (fb <= fg && fb <= fr) ? stride_[2] : (fg <= fr) ? stride_[1] : stride_[0];
+
+        const uint16_t* c0 = nodes + ir * stride_[0] + ig * stride_[1] + ib * stride_[2];
+        const uint16_t* c1 = c0 + maxStride;
+        const uint16_t* c2 = c0 + total - minStride;
+        const uint16_t* c3 = c0 + total;
+
+        for (int c = 0; c < 3; c++)
+            out[c][i] = (uint16_t)((c0[c] * (one - f1) + c1[c] * (f1 - f2) + c2[c] * (f2 - f3) + c3[c] * f3 + half) >> 15);
+    }
+}
+
+void QubyxLutApply::trilinear(const uint16_t* const in[3], uint16_t* const out[3], int count) const
+{
+    const uint16_t* nodes = &nodes_[0];
+    const int sR = stride_[0], sG = stride_[1], sB = stride_[2];
+
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t ir, ig, ib, fr, fg, fb;
+        position(in[0][i], ir, fr);
+        position(in[1][i], ig, fg);
+        position(in[2][i], ib, fb);
+
+        const uint16_t* c = nodes + ir * sR + ig * sG + ib * sB;
+        for (int k = 0; k < 3; k++)
+        {
+            const int32_t x00 = lerp(c[k], c[sB + k], fb);
+            const int32_t x01 = lerp(c[sG + k], c[sG + sB + k], fb);
+            const int32_t x10 = lerp(c[sR + k], c[sR + sB + k], fb);
+            const int32_t x11 = lerp(c[sR + sG + k], c[sR + sG + sB + k], fb);
+            out[k][i] = (uint16_t)lerp(lerp(x00, x01, fg), lerp(x10, x11, fg), fr);
+        }
+    }
+}
+
+#ifdef ICC_USE_SSE41
+ICC_TARGET_SSE41 void QubyxLutApply::tetrahedralSSE41(const uint16_t* const in[3], uint16_t* const out[3], int count) const
+{
+    const uint16_t* nodes = &nodes_[0];
+    const __m128i last = _mm_set1_epi32(grid_ - 1);
+    const __m128i lastCell = _mm_set1_epi32(grid_ - 2);
+    const __m128i sR = _mm_set1_epi32(stride_[0]), sG = _mm_set1_epi32(stride_[1]), sB = _mm_set1_epi32(stride_[2]);
+    const __m128i total = _mm_set1_epi32(stride_[0] + stride_[1] + stride_[2]);
+    const __m128i whole = _mm_set1_epi32(one), rounding = _mm_set1_epi32(half);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i fr, fg, fb;
+        const __m128i ir = positionSSE41(loadSSE41(in[0] + i), last, lastCell, fr);
+        const __m128i ig = positionSSE41(loadSSE41(in[1] + i), last, lastCell, fg);
+        const __m128i ib = positionSSE41(loadSSE41(in[2] + i), last, lastCell, fb);
+
+        const __m128i f1 = _mm_max_epi32(_mm_max_epi32(fr, fg), fb);
+        const __m128i f3 = _mm_min_epi32(_mm_min_epi32(fr, fg), fb);
+        const __m128i f2 = _mm_sub_epi32(_mm_add_epi32(_mm_add_epi32(fr, fg), fb), _mm_add_epi32(f1, f3));
+
+        const __m128i notRMax = _mm_or_si128(_mm_cmpgt_epi32(fg, fr), _mm_cmpgt_epi32(fb, fr));
+        const __m128i maxStride = _mm_blendv_epi8(sR, _mm_blendv_epi8(sG, sB, _mm_cmpgt_epi32(fb, fg)), notRMax);
+        const __m128i notBMin = _mm_or_si128(_mm_cmpgt_epi32(fb, fg), _mm_cmpgt_epi32(fb, fr));
+        const __m128i minStride = _mm_blendv_epi8(sB, _mm_blendv_epi8(sG, sR, _mm_cmpgt_epi32(fg, fr)), notBMin);
+
+        const __m128i base = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(ir, sR), _mm_mullo_epi32(ig, sG)), _mm_mullo_epi32(ib, sB));
+        __m128i c0[3], c1[3], c2[3], c3[3];
+        gatherSSE41(nodes, base, c0);
+        gatherSSE41(nodes, _mm_add_epi32(base, maxStride), c1);
+        gatherSSE41(nodes, _mm_sub_epi32(_mm_add_epi32(base, total), minStride), c2);
+        gatherSSE41(nodes, _mm_add_epi32(base, total), c3);
+
+        const __m128i w0 = _mm_sub_epi32(whole, f1), w1 = _mm_sub_epi32(f1, f2), w2 = _mm_sub_epi32(f2, f3);
+        for (int c = 0; c < 3; c++)
+        {
+            __m128i sum = _mm_add_epi32(_mm_mullo_epi32(c0[c], w0), _mm_mullo_epi32(c1[c], w1));
+            sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_mullo_epi32(c2[c], w2), _mm_mullo_epi32(c3[c], f3)));
+            storeSSE41(out[c] + i, _mm_srli_epi32(_mm_add_epi32(sum, rounding), 15));
+        }
+    }
+
+    const uint16_t* const restIn[3] = { in[0] + i, in[1] + i, in[2] + i };
+    uint16_t* const restOut[3] = { out[0] + i, out[1] + i, out[2] + i };
+    tetrahedral(restIn, restOut, count - i);
+}
+
+ICC_TARGET_SSE41 void QubyxLutApply::trilinearSSE41(const uint16_t* const in[3], uint16_t* const out[3], int count) const
+{
+    const uint16_t* nodes = &nodes_[0];
+    const __m128i last = _mm_set1_epi32(grid_ - 1);
+    const __m128i lastCell = _mm_set1_epi32(grid_ - 2);
+    const __m128i sR = _mm_set1_epi32(stride_[0]), sG = _mm_set1_epi32(stride_[1]), sB = _mm_set1_epi32(stride_[2]);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i fr, fg, fb;
+        const __m128i ir = positionSSE41(loadSSE41(in[0] + i), last, lastCell, fr);
+        const __m128i ig = positionSSE41(loadSSE41(in[1] + i), last, lastCell, fg);
+        const __m128i ib = positionSSE41(loadSSE41(in[2] + i), last, lastCell, fb);
+
+        //corners by their R, G and B offsets (bits 2, 1 and 0)
+        const __m128i base = _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(ir, sR), _mm_mullo_epi32(ig, sG)), _mm_mullo_epi32(ib, sB));
+        __m128i corner[8][3];
+        for (int k = 0; k < 8; k++)
+        {
+            __m128i at = base;
+            if (k & 4)
+                at = _mm_add_epi32(at, sR);
+            if (k & 2)
+                at = _mm_add_epi32(at, sG);
+            if (k & 1)
+                at = _mm_add_epi32(at, sB);
+            gatherSSE41(nodes, at, corner[k]);
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            const __m128i x00 = lerpSSE41(corner[0][c], corner[1][c], fb);
+            const __m128i x01 = lerpSSE41(corner[2][c], corner[3][c], fb);
+            const __m128i x10 = lerpSSE41(corner[4][c], corner[5][c], fb);
+            const __m128i x11 = lerpSSE41(corner[6][c], corner[7][c], fb);
+            storeSSE41(out[c] + i, lerpSSE41(lerpSSE41(x00, x01, fg), lerpSSE41(x10, x11, fg), fr));
+        }
+    }
+
+    const uint16_t* const restIn[3] = { in[0] + i, in[1] + i, in[2] + i };
+    uint16_t* const restOut[3] = { out[0] + i, out[1] + i, out[2] + i };
+    trilinear(restIn, restOut, count - i);
+}
+#endif
+
+#ifdef ICC_USE_AVX2
+ICC_TARGET_AVX2 void QubyxLutApply::tetrahedralAVX2(const uint16_t* const in[3], uint16_t* const out[3], int count) const
+{
+    const uint16_t* nodes = &nodes_[0];
+    const __m256i last = _mm256_set1_epi32(grid_ - 1);
+    const __m256i lastCell = _mm256_set1_epi32(grid_ - 2);
+    const __m256i sR = _mm256_set1_epi32(stride_[0]), sG = _mm256_set1_epi32(stride_[1]), sB = _mm256_set1_epi32(stride_[2]);
+    const __m256i total = _mm256_set1_epi32(stride_[0] + stride_[1] + stride_[2]);
+    const __m256i whole = _mm256_set1_epi32(one), rounding = _mm256_set1_epi32(half);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i fr, fg, fb;
+        const __m256i ir = positionAVX2(loadAVX2(in[0] + i), last, lastCell, fr);
+        const __m256i ig = positionAVX2(loadAVX2(in[1] + i), last, lastCell, fg);
+        const __m256i ib = positionAVX2(loadAVX2(in[2] + i), last, lastCell, fb);
+
+        const __m256i f1 = _mm256_max_epi32(_mm256_max_epi32(fr, fg), fb);
+        const __m256i f3 = _mm256_min_epi32(_mm256_min_epi32(fr, fg), fb);
+        const __m256i f2 = _mm256_sub_epi32(_mm256_add_epi32(_mm256_add_epi32(fr, fg), fb), _mm256_add_epi32(f1, f3));
+
+        const __m256i notRMax = _mm256_or_si256(_mm256_cmpgt_epi32(fg, fr), _mm256_cmpgt_epi32(fb, fr));
+        const __m256i maxStride = _mm256_blendv_epi8(sR, _mm256_blendv_epi8(sG, sB, _mm256_cmpgt_epi32(fb, fg)), notRMax);
+        const __m256i notBMin = _mm256_or_si256(_mm256_cmpgt_epi32(fb, fg), _mm256_cmpgt_epi32(fb, fr));
+        const __m256i minStride = _mm256_blendv_epi8(sB, _mm256_blendv_epi8(sG, sR, _mm256_cmpgt_epi32(fg, fr)), notBMin);
+
+        const __m256i base = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(ir, sR), _mm256_mullo_epi32(ig, sG)),
+            _mm256_mullo_epi32(ib, sB));
+        __m256i c0[3], c1[3], c2[3], c3[3];
+        gatherAVX2(nodes, base, c0);
+        gatherAVX2(nodes, _mm256_add_epi32(base, maxStride), c1);
+        gatherAVX2(nodes, _mm256_sub_epi32(_mm256_add_epi32(base, total), minStride), c2);
+        gatherAVX2(nodes, _mm256_add_epi32(base, total), c3);
+
+        const __m256i w0 = _mm256_sub_epi32(whole, f1), w1 = _mm256_sub_epi32(f1, f2), w2 = _mm256_sub_epi32(f2, f3);
+        for (int c = 0; c < 3; c++)
+        {
+            __m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(c0[c], w0), _mm256_mullo_epi32(c1[c], w1));
+            sum = _mm256_add_epi32(sum, _mm256_add_epi32(_mm256_mullo_epi32(c2[c], w2), _mm256_mullo_epi32(c3[c], f3)));
+            storeAVX2(out[c] + i, _mm256_srli_epi32(_mm256_add_epi32(sum, rounding), 15));
+        }
+    }
+
+    const uint16_t* const restIn[3] = { in[0] + i, in[1] + i, in[2] + i };
+    uint16_t* const restOut[3] = { out[0] + i, out[1] + i, out[2] + i };
+    tetrahedral(restIn, restOut, count - i);
+}
+
+ICC_TARGET_AVX2 void QubyxLutApply::trilinearAVX2(const uint16_t* const in[3], uint16_t* const out[3], int count) const
+{
+    const uint16_t* nodes = &nodes_[0];
+    const __m256i last = _mm256_set1_epi32(grid_ - 1);
+    const __m256i lastCell = _mm256_set1_epi32(grid_ - 2);
+    const __m256i sR = _mm256_set1_epi32(stride_[0]), sG = _mm256_set1_epi32(stride_[1]), sB = _mm256_set1_epi32(stride_[2]);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i fr, fg, fb;
+        const __m256i ir = positionAVX2(loadAVX2(in[0] + i), last, lastCell, fr);
+        const __m256i ig = positionAVX2(loadAVX2(in[1] + i), last, lastCell, fg);
+        const __m256i ib = positionAVX2(loadAVX2(in[2] + i), last, lastCell, fb);
+
+        //corners by their R, G and B offsets (bits 2, 1 and 0)
+        const __m256i base = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(ir, sR), _mm256_mullo_epi32(ig, sG)),
+            _mm256_mullo_epi32(ib, sB));
+        __m256i corner[8][3];
+        for (int k = 0; k < 8; k++)
+        {
+            __m256i at = base;
+            if (k & 4)
+                at = _mm256_add_epi32(at, sR);
+            if (k & 2)
+                at = _mm256_add_epi32(at, sG);
+            if (k & 1)
+                at = _mm256_add_epi32(at, sB);
+            gatherAVX2(nodes, at, corner[k]);
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            const __m256i x00 = lerpAVX2(corner[0][c], corner[1][c], fb);
+            const __m256i x01 = lerpAVX2(corner[2][c], corner[3][c], fb);
+            const __m256i x10 = lerpAVX2(corner[4][c], corner[5][c], fb);
+            const __m256i x11 = lerpAVX2(corner[6][c], corner[7][c], fb);
+            storeAVX2(out[c] + i, lerpAVX2(lerpAVX2(x00, x01, fg), lerpAVX2(x10, x11, fg), fr));
+        }
+    }
+
+    const uint16_t* const restIn[3] = { in[0] + i, in[1] + i, in[2] + i };
+    uint16_t* const restOut[3] = { out[0] + i, out[1] + i, out[2] + i };
+    trilinear(restIn, restOut, count - i);
+}
+#endif
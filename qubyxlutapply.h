@@ -0,0 +1,98 @@
+/*
+ * Author: QUBYX Software Technologies LTD HK
+ * Copyright: QUBYX Software Technologies LTD HK
+ */
+
+#ifndef QUBYXLUTAPPLY_H
+#define QUBYXLUTAPPLY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "ICCProfLib/IccProfLibConf.h"
+
+/**
+ * Applies a 3D LUT to rows of RGB images. Nodes are ordered as generate3dLut gives them
+ * (index = R * grid * grid + G * grid + B) and kept as 16 bit values.
+ *
+ * Interpolation is fixed point: input positions have 15 fractional bits and results are rounded
+ * to 16 bits before they are scaled to the output sample type. The AVX2 and SSE4.1 kernels
+ * (picked at run time) give exactly the same results as the scalar one.
+ *
+ * Thread safe after construction: rows of an image may be converted by several threads at once.
+ */
+class QubyxLutApply
+{
+public:
+    enum class Interpolation
+    {
+        Tetrahedral,
+        Trilinear
+    };
+
+    enum class SampleType
+    {
+        UInt8,      //0..255 in uint8_t
+        UInt10,     //0..1023 in uint16_t, larger values are clipped
+        UInt16      //0..65535 in uint16_t
+    };
+
+    /**
+     * Describes rows of an image. Samples of a pixel other than RGB (e.g. alpha) are left as they are.
+     */
+    struct Buffer
+    {
+        SampleType type;
+        bool planar;            //R, G and B in plane[0], plane[1] and plane[2], otherwise RGB next to each other in plane[0]
+        void* plane[3];
+        size_t pixelStride;     //bytes between pixels of a plane
+        size_t rowStride;       //bytes between rows of a plane
+    };
+
+    /**
+     * @param grid nodes per axis, 2..512
+     * @param nodes grid^3 RGB nodes, 0..65535
+     */
+    QubyxLutApply(int grid, const uint16_t* nodes, Interpolation interpolation);
+
+    /**
+     * @brief convertRows converts rows of the image, src and dst may describe the same buffer (in place)
+     * @param firstRow first row of the range
+     * @param rows number of rows to convert
+     */
+    void convertRows(const Buffer& src, const Buffer& dst, int width, int firstRow, int rows) const;
+
+    /** number of bytes of one sample of the type */
+    static size_t sampleSize(SampleType type) { return (type == SampleType::UInt8) ? 1 : 2; }
+
+private:
+    typedef void (QubyxLutApply::*Kernel)(const uint16_t* const in[3], uint16_t* const out[3], int count) const;
+
+    static const int chunkSize = 256;   //pixels converted at once
+
+    const int grid_;
+    std::vector<uint16_t> nodes_;       //RGB of grid^3 nodes and one sample of padding for 32 bit gathers
+    int stride_[3];                     //distance between neighbour nodes along R, G and B (in samples)
+    Kernel kernel_;
+
+    void unpack(const Buffer& src, int row, int first, int count, uint16_t* const in[3]) const;
+    void pack(const uint16_t* const out[3], const Buffer& dst, int row, int first, int count) const;
+
+    /** node index along an axis and 15 bit fraction of a 16 bit input value */
+    void position(uint32_t value, uint32_t& index, uint32_t& fraction) const;
+
+    void tetrahedral(const uint16_t* const in[3], uint16_t* const out[3], int count) const;
+    void trilinear(const uint16_t* const in[3], uint16_t* const out[3], int count) const;
+
+#ifdef ICC_USE_SSE41
+    ICC_TARGET_SSE41 void tetrahedralSSE41(const uint16_t* const in[3], uint16_t* const out[3], int count) const;
+    ICC_TARGET_SSE41 void trilinearSSE41(const uint16_t* const in[3], uint16_t* const out[3], int count) const;
+#endif
+#ifdef ICC_USE_AVX2
+    ICC_TARGET_AVX2 void tetrahedralAVX2(const uint16_t* const in[3], uint16_t* const out[3], int count) const;
+    ICC_TARGET_AVX2 void trilinearAVX2(const uint16_t* const in[3], uint16_t* const out[3], int count) const;
+#endif
+};
+
+#endif // QUBYXLUTAPPLY_H
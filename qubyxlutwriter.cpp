@@ -0,0 +1,199 @@
+/*
+ * Author: QUBYX Software Technologies LTD HK
+ * Copyright: QUBYX Software Technologies LTD HK
+ */
+
+#include "qubyxlutwriter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    double clampUnit(double value)
+    {
+        return std::min(std::max(value, 0.0), 1.0);
+    }
+
+    class CubeWriter : public QubyxLutWriter
+    {
+    public:
+        bool redFastest() const override { return true; }
+
+        void header(int grid, std::string& out) const override
+        {
+            out += "# Generated by Qubyx3DLUTGenerator\nLUT_3D_SIZE ";
+            appendUInt(out, grid);
+            out += "\nDOMAIN_MIN 0.0 0.0 0.0\nDOMAIN_MAX 1.0 1.0 1.0\n";
+        }
+
+        void nodes(const double* rgb, size_t count, std::string& out) const override
+        {
+            for (size_t i = 0; i < count; i++, rgb += 3)
+            {
+                appendFixed(out, rgb[0]);
+                out += ' ';
+                appendFixed(out, rgb[1]);
+                out += ' ';
+                appendFixed(out, rgb[2]);
+                out += '\n';
+            }
+        }
+    };
+
+    class Lut3dlWriter : public QubyxLutWriter
+    {
+    public:
+        void header(int grid, std::string& out) const override
+        {
+            //input mesh in 10 bit
+            for (int i = 0; i < grid; i++)
+            {
+                if (i)
+                    out += ' ';
+                appendUInt(out, (unsigned)std::lround(i * 1023.0 / (grid - 1)));
+            }
+            out += '\n';
+        }
+
+        void nodes(const double* rgb, size_t count, std::string& out) const override
+        {
+            for (size_t i = 0; i < count; i++, rgb += 3)
+            {
+                appendUInt(out, (unsigned)std::lround(clampUnit(rgb[0]) * maxValue));
+                out += ' ';
+                appendUInt(out, (unsigned)std::lround(clampUnit(rgb[1]) * maxValue));
+                out += ' ';
+                appendUInt(out, (unsigned)std::lround(clampUnit(rgb[2]) * maxValue));
+                out += '\n';
+            }
+        }
+
+    private:
+        static const int maxValue = 4095;
+    };
+
+    class ClfWriter : public QubyxLutWriter
+    {
+    public:
+        void header(int grid, std::string& out) const override
+        {
+            out += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<ProcessList id=\"Qubyx3DLUTGenerator\" compCLFversion=\"3.0\">\n"
+                "    <LUT3D id=\"lut3d\" inBitDepth=\"32f\" outBitDepth=\"32f\" interpolation=\"tetrahedral\">\n"
+                "        <Array dim=\"";
+            for (int i = 0; i < 3; i++)
+            {
+                appendUInt(out, grid);
+                out += ' ';
+            }
+            out += "3\">\n";
+        }
+
+        void nodes(const double* rgb, size_t count, std::string& out) const override
+        {
+            for (size_t i = 0; i < count; i++, rgb += 3)
+            {
+                out += "            ";
+                appendFixed(out, rgb[0]);
+                out += ' ';
+                appendFixed(out, rgb[1]);
+                out += ' ';
+                appendFixed(out, rgb[2]);
+                out += '\n';
+            }
+        }
+
+        void footer(std::string& out) const override
+        {
+            out += "        </Array>\n"
+                "    </LUT3D>\n"
+                "</ProcessList>\n";
+        }
+    };
+
+    class BinaryWriter : public QubyxLutWriter
+    {
+    public:
+        void header(int grid, std::string& out) const override
+        {
+            out += "Q3DL";
+            appendUInt32(out, version);
+            appendUInt32(out, grid);
+        }
+
+        void nodes(const double* rgb, size_t count, std::string& out) const override
+        {
+            for (size_t i = 0; i < 3 * count; i++)
+            {
+                unsigned value = (unsigned)std::lround(clampUnit(rgb[i]) * maxValue);
+                out += (char)(value & 0xff);
+                out += (char)(value >> 8);
+            }
+        }
+
+    private:
+        static const unsigned version = 1;
+        static const int maxValue = 256 * 256 - 1;
+
+        static void appendUInt32(std::string& out, unsigned value)
+        {
+            for (int i = 0; i < 4; i++)
+                out += (char)((value >> (8 * i)) & 0xff);
+        }
+    };
+}
+
+std::unique_ptr<QubyxLutWriter> QubyxLutWriter::create(QubyxLutWriter::Format format)
+{
+    switch (format)
+    {
+    case Format::Cube:
+        return std::unique_ptr<QubyxLutWriter>(new CubeWriter);
+    case Format::Lut3dl:
+        return std::unique_ptr<QubyxLutWriter>(new Lut3dlWriter);
+    case Format::Clf:
+        return std::unique_ptr<QubyxLutWriter>(new ClfWriter);
+    case Format::Binary:
+        return std::unique_ptr<QubyxLutWriter>(new BinaryWriter);
+    }
+
+    return std::unique_ptr<QubyxLutWriter>();
+}
+
+void QubyxLutWriter::appendUInt(std::string& out, unsigned value)
+{
+    char digits[10];
+    int n = 0;
+    do
+    {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    while (n)
+        out += digits[--n];
+}
+
+void QubyxLutWriter::appendFixed(std::string& out, double value)
+{
+    if (!std::isfinite(value))
+        value = 0;
+    value = std::min(std::max(value, -1e9), 1e9);
+
+    long long fixed = std::llround(value * 1000000.0);
+    if (fixed < 0)
+    {
+        out += '-';
+        fixed = -fixed;
+    }
+
+    appendUInt(out, (unsigned)(fixed / 1000000));
+    out += '.';
+
+    char digits[6];
+    unsigned fraction = (unsigned)(fixed % 1000000);
+    for (int i = 5; i >= 0; i--, fraction /= 10)
+        digits[i] = (char)('0' + fraction % 10);
+    out.append(digits, 6);
+}
@@ -0,0 +1,55 @@
+/*
+ * Author: QUBYX Software Technologies LTD HK
+ * Copyright: QUBYX Software Technologies LTD HK
+ */
+
+#ifndef QUBYXLUTWRITER_H
+#define QUBYXLUTWRITER_H
+
+#include <memory>
+#include <string>
+
+/**
+ * Formats 3D LUT files slab by slab, so a LUT can be streamed to a file or a pipe while it is generated.
+ * A slab is one plane of grid*grid nodes along the slowest changing axis of the file
+ * (R planes for blue fastest files, B planes for red fastest files), nodes in file order.
+ * Output values are normalized to 0..1.
+ */
+class QubyxLutWriter
+{
+public:
+    enum class Format
+    {
+        Cube,       //Adobe/Resolve .cube, red fastest
+        Lut3dl,     //Autodesk .3dl, 10 bit input mesh and 12 bit output, blue fastest
+        Clf,        //Academy/ASC Common LUT Format (CLF v3) LUT3D, blue fastest
+        Binary      //"Q3DL" magic, uint32 version and grid, then uint16 RGB nodes, little endian, blue fastest
+    };
+
+    static std::unique_ptr<QubyxLutWriter> create(Format format);
+
+    virtual ~QubyxLutWriter() {}
+
+    /**
+     * @brief redFastest tells the node order of the file
+     * @return true if red changes fastest (slabs are B planes), false if blue does (slabs are R planes)
+     */
+    virtual bool redFastest() const { return false; }
+
+    virtual void header(int grid, std::string& out) const = 0;
+
+    /**
+     * @brief nodes appends formatted nodes to out, thread safe
+     * @param rgb count nodes, 3 values each
+     */
+    virtual void nodes(const double* rgb, size_t count, std::string& out) const = 0;
+
+    virtual void footer(std::string& out) const { (void)out; }
+
+protected:
+    static void appendUInt(std::string& out, unsigned value);
+    /** fixed point text with 6 decimals, much faster than printf */
+    static void appendFixed(std::string& out, double value);
+};
+
+#endif // QUBYXLUTWRITER_H
@@ -0,0 +1,244 @@
+/*
+ * Author: QUBYX Software Technologies LTD HK
+ * Copyright: QUBYX Software Technologies LTD HK
+ */
+
+#include "qubyxprofilecache.h"
+
+#include "ICCProfLib/IccIO.h"
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <mutex>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    struct FileStamp
+    {
+        long long mtime;    //in the finest unit the platform gives, a rewrite within a second must change it
+        long long size;
+        std::string key;
+    };
+
+    typedef std::pair<std::string, QubyxProfileCache::ProfilePtr> Entry;
+
+    struct CacheData
+    {
+        CacheData() : maxProfiles_(32) {}
+
+        std::mutex lock_;
+        std::list<Entry> profiles_;    //most recently used first
+        std::map<std::string, std::list<Entry>::iterator> byKey_;
+        std::map<std::string, FileStamp> byPath_;
+        size_t maxProfiles_;
+
+        QubyxProfileCache::ProfilePtr find(const std::string& key)
+        {
+            auto it = byKey_.find(key);
+            if (it == byKey_.end())
+                return QubyxProfileCache::ProfilePtr();
+
+            profiles_.splice(profiles_.begin(), profiles_, it->second);
+            return it->second->second;
+        }
+
+        void trim()
+        {
+            while (profiles_.size() > maxProfiles_)
+            {
+                byKey_.erase(profiles_.back().first);
+                profiles_.pop_back();
+            }
+
+            for (auto it = byPath_.begin(); it != byPath_.end();)
+            {
+                if (byKey_.find(it->second.key) == byKey_.end())
+                    it = byPath_.erase(it);
+                else
+                    ++it;
+            }
+        }
+    };
+
+    CacheData& cache()
+    {
+        static CacheData data;
+        return data;
+    }
+
+    bool fileStamp(const std::string& path, FileStamp& stamp)
+    {
+#if defined(_WIN32)
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes))
+            return false;
+
+        //100 ns ticks
+        stamp.mtime = ((long long)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+        stamp.size = ((long long)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+#else
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            return false;
+
+        //nanoseconds
+#if defined(__APPLE__)
+        stamp.mtime = (long long)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        stamp.mtime = (long long)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+        stamp.size = st.st_size;
+#endif
+        return true;
+    }
+
+    std::string contentKey(CIccMemIO* mem)
+    {
+        //the profile ID ignores flags and rendering intent, the key keeps the whole header
+        icProfileID id;
+        CalcProfileID(mem, &id);
+
+        std::string key((const char*)id.ID8, sizeof(id.ID8));
+        key.append((const char*)mem->GetData(), std::min<size_t>(mem->GetLength(), sizeof(icHeader)));
+        return key;
+    }
+
+    //looks the profile up by content key, parses and caches it on a miss;
+    //path and stamp are null for profiles from memory, those are never looked up by path
+    QubyxProfileCache::ProfilePtr loadContent(CIccMemIO* mem, const std::string& key,
+        const std::string* path, const FileStamp* stamp)
+    {
+        CacheData& data = cache();
+
+        {
+            std::lock_guard<std::mutex> guard(data.lock_);
+
+            QubyxProfileCache::ProfilePtr profile = data.find(key);
+            if (profile)
+            {
+                if (path)
+                    data.byPath_[*path] = *stamp;
+                return profile;
+            }
+        }
+
+        std::shared_ptr<CIccProfile> parsed = std::make_shared<CIccProfile>();
+        mem->Seek(0, icSeekSet);
+        if (!parsed->Read(mem))
+            return QubyxProfileCache::ProfilePtr();
+
+        std::lock_guard<std::mutex> guard(data.lock_);
+
+        //another thread may have parsed the same profile meanwhile
+        QubyxProfileCache::ProfilePtr profile = data.find(key);
+        if (profile)
+        {
+            if (path)
+                data.byPath_[*path] = *stamp;
+            return profile;
+        }
+
+        profile = parsed;
+        if (data.maxProfiles_)
+        {
+            data.profiles_.push_front(Entry(key, profile));
+            data.byKey_[key] = data.profiles_.begin();
+            if (path)
+                data.byPath_[*path] = *stamp;
+            data.trim();
+        }
+
+        return profile;
+    }
+}
+
+QubyxProfileCache::ProfilePtr QubyxProfileCache::load(const std::string& path, std::string* key)
+{
+    CacheData& data = cache();
+
+    FileStamp stamp;
+    if (!fileStamp(path, stamp))
+        return ProfilePtr();
+
+    {
+        std::lock_guard<std::mutex> guard(data.lock_);
+
+        auto it = data.byPath_.find(path);
+        if (it != data.byPath_.end() && it->second.mtime == stamp.mtime && it->second.size == stamp.size)
+        {
+            ProfilePtr profile = data.find(it->second.key);
+            if (profile)
+            {
+                if (key)
+                    *key = it->second.key;
+                return profile;
+            }
+        }
+    }
+
+    CIccMappedIO mem;
+    if (!mem.Open(path.c_str()))
+        return ProfilePtr();
+
+    //the file may have been rewritten since the check above, cache the stamp of what is mapped
+    stamp.mtime = mem.GetModifiedTime();
+    stamp.size = mem.GetLength();
+    stamp.key = contentKey(&mem);
+    if (key)
+        *key = stamp.key;
+
+    return loadContent(&mem, stamp.key, &path, &stamp);
+}
+
+QubyxProfileCache::ProfilePtr QubyxProfileCache::load(const unsigned char* buf, size_t size, std::string* key)
+{
+    //ICC sizes are 32 bit, a longer buffer would be read as a wrapped, shorter profile
+    if (buf == nullptr || size < sizeof(icHeader) || size > 0xFFFFFFFFu)
+        return ProfilePtr();
+
+    //the buffer is only read, CIccMemIO just doesn't take const memory
+    CIccMemIO mem;
+    if (!mem.Attach(const_cast<icUInt8Number*>(buf), (icUInt32Number)size, false))
+        return ProfilePtr();
+
+    std::string content = contentKey(&mem);
+    if (key)
+        *key = content;
+
+    return loadContent(&mem, content, nullptr, nullptr);
+}
+
+void QubyxProfileCache::setMaxProfiles(size_t count)
+{
+    CacheData& data = cache();
+    std::lock_guard<std::mutex> guard(data.lock_);
+
+    data.maxProfiles_ = count;
+    data.trim();
+}
+
+size_t QubyxProfileCache::maxProfiles()
+{
+    CacheData& data = cache();
+    std::lock_guard<std::mutex> guard(data.lock_);
+
+    return data.maxProfiles_;
+}
+
+void QubyxProfileCache::clear()
+{
+    CacheData& data = cache();
+    std::lock_guard<std::mutex> guard(data.lock_);
+
+    data.profiles_.clear();
+    data.byKey_.clear();
+    data.byPath_.clear();
+}
@@ -0,0 +1,61 @@
+/*
+ * Author: QUBYX Software Technologies LTD HK
+ * Copyright: QUBYX Software Technologies LTD HK
+ */
+
+#ifndef QUBYXPROFILECACHE_H
+#define QUBYXPROFILECACHE_H
+
+#include <memory>
+#include <string>
+
+#include "ICCProfLib/IccProfile.h"
+
+/**
+ * Process-wide cache of parsed ICC profiles. Thread safe.
+ *
+ * A profile file is looked up by path first (valid while its modification time and size are
+ * unchanged). On a path miss the file is read once and looked up by its MD5 profile ID
+ * (CalcProfileID), so the same profile stored under different paths is parsed only once.
+ * Profiles in memory buffers are looked up by the same key, so a buffer holding the content of
+ * a file already loaded shares its parsed profile. Cached profiles are immutable and shared; the least recently used ones are dropped when
+ * more than maxProfiles() are held.
+ */
+class QubyxProfileCache
+{
+public:
+    typedef std::shared_ptr<const CIccProfile> ProfilePtr;
+
+    /**
+     * @brief load returns the parsed profile stored at path
+     * @param path profile file
+     * @param key if not null receives the content key of the profile (profile ID and header),
+     *        equal keys mean equal profiles regardless of path
+     * @return shared profile or empty pointer if the file can't be read or parsed
+     */
+    static ProfilePtr load(const std::string& path, std::string* key = nullptr);
+
+    /**
+     * @brief load returns the parsed profile held in memory, the buffer is read in place and not kept
+     * @param buf, size profile data
+     * @param key if not null receives the content key of the profile
+     * @return shared profile or empty pointer if the data can't be parsed
+     */
+    static ProfilePtr load(const unsigned char* buf, size_t size, std::string* key = nullptr);
+
+    /**
+     * @brief setMaxProfiles limits the number of cached profiles, 0 disables caching
+     */
+    static void setMaxProfiles(size_t count);
+    static size_t maxProfiles();
+
+    /**
+     * @brief clear drops all cached profiles (profiles still referenced stay alive)
+     */
+    static void clear();
+
+private:
+    QubyxProfileCache();
+};
+
+#endif // QUBYXPROFILECACHE_H
@@ -18,7 +18,9 @@ QubyxProfileChain::QubyxProfileChain()
     hasLastChad_(false),
     hasLastLuminance_(false),
     lastLuminance_(0),
-    lastOutput_(SpaceType::DeviceSpecific)
+    lastOutput_(SpaceType::DeviceSpecific),
+    approximateSize_(0),
+    grid_(0)
 {
 
 }
@@ -31,7 +33,9 @@ QubyxProfileChain::QubyxProfileChain(QubyxProfileChain::SpaceType in, QubyxProfi
     hasLastChad_(false),
     hasLastLuminance_(false),
     lastLuminance_(0),
-    lastOutput_(SpaceType::DeviceSpecific)
+    lastOutput_(SpaceType::DeviceSpecific),
+    approximateSize_(0),
+    grid_(0)
 {
 
 }
@@ -56,6 +60,10 @@ void QubyxProfileChain::clearChain()
     lastChad_.clear();
     hasLastLuminance_ = false;
     lastLuminance_ = 0;
+    approximateSize_ = 0;
+    grid_ = 0;
+    gridTable_.clear();
+    fused_.reset();
 }
 
 bool QubyxProfileChain::addProfile(QubyxProfile* profile)
@@ -98,9 +106,21 @@ bool QubyxProfileChain::addProfile(const QubyxProfile& profile, QubyxProfileChai
     }
 
 
-    bool res = (cmms_[index].cmm_->AddXform(profile.profile_, iccProfLibRI(renderingIntent), icInterpTetrahedral) == icCmmStatOk);
+    //lazy loaded profiles are copied by AddXform with loaded tags only
+    profile.prefetchTags(iccProfLibRI(renderingIntent));
+
+    CIccCreateXformHintManager hints;
+    hints.AddHint(new CIccCreateInvCurveXformHint(inverseCurveSize));
+
+    bool res = (cmms_[index].cmm_->AddXform(profile.profile_, iccProfLibRI(renderingIntent), icInterpTetrahedral,
+                                            icXformLutColor, true, &hints) == icCmmStatOk);
 
     if (res) {
+        //CIccCmm keeps its own copy of the profile, output direction may also sample inverse curves
+        approximateSize_ += profile.profile_.m_Header.size;
+        approximateSize_ += sampledInverseCurves(cmms_[index].cmm_->GetLastXform())
+                            * inverseCurveSize * sizeof(icFloatNumber);
+
         if (renderingIntent == RI::RealisticColorimetric || renderingIntent == RI::RealisticColorimetricWithLuminance)
         {
             if (first && cmms_[index].in_ == SpaceType::XYZ)
@@ -140,6 +160,41 @@ bool QubyxProfileChain::addProfile(const QubyxProfile& profile, QubyxProfileChai
 
 }
 
+unsigned QubyxProfileChain::sampledInverseCurves(const CIccXform* xform)
+{
+    if (!xform || xform->IsInput())
+        return 0;
+
+    static const icSignature rgbCurves[] = { icSigRedTRCTag, icSigGreenTRCTag, icSigBlueTRCTag };
+    static const icSignature grayCurve[] = { icSigGrayTRCTag };
+
+    const icSignature* curves;
+    unsigned count;
+    if (xform->GetXformType() == icXformTypeMatrixTRC)
+    {
+        curves = rgbCurves;
+        count = 3;
+    }
+    else if (xform->GetXformType() == icXformTypeMonochrome)
+    {
+        curves = grayCurve;
+        count = 1;
+    }
+    else
+        return 0;
+
+    //parametric curves are inverted in closed form by the xforms when they can be
+    unsigned sampled = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        const CIccTag* tag = xform->GetProfile()->FindTag(curves[i]);
+        if (!tag || tag->GetType() != icSigParametricCurveType
+            || !CIccInvParametricCurve::IsInvertible(static_cast<const CIccTagParametricCurve*>(tag)))
+            ++sampled;
+    }
+    return sampled;
+}
+
 bool QubyxProfileChain::addProfiles(const std::vector<QubyxProfile*>& profiles)
 {
     bool r = true;
@@ -166,6 +221,9 @@ bool QubyxProfileChain::isChainComplete()
         for (unsigned i = 0;i < cmms_.size() && started_;++i)
             started_ = (cmms_[i].cmm_->Begin() == icCmmStatOk)
             && (cmms_[i].cmm_->GetApply() != nullptr);
+
+        if (started_)
+            compileMatrixTRC();
     }
 
     return started_;
@@ -193,8 +251,42 @@ std::shared_ptr<QubyxProfileChain> QubyxProfileChain::singleProfileChain(
     return res;
 }
 
+std::unique_ptr<QubyxProfileChain::ApplyContext> QubyxProfileChain::newApplyContext()
+{
+    std::lock_guard<std::mutex> guard(contextLock_);
+
+    if (!isChainComplete())
+        return std::unique_ptr<ApplyContext>();
+
+    std::unique_ptr<ApplyContext> context(new ApplyContext);
+    for (unsigned i = 0;i < cmms_.size();++i)
+    {
+        icStatusCMM status = icCmmStatOk;
+        CIccApplyCmm* apply = cmms_[i].cmm_->GetNewApplyCmm(status);
+        if (!apply || status != icCmmStatOk)
+        {
+            delete apply;
+            return std::unique_ptr<ApplyContext>();
+        }
+        context->applies_.push_back(apply);
+    }
+
+    return context;
+}
+
+size_t QubyxProfileChain::approximateSize() const
+{
+    return approximateSize_;
+}
+
 template<typename T>
 bool QubyxProfileChain::transform(const std::vector<T>& in, std::vector<T>& out)
+{
+    return transform(in, out, nullptr);
+}
+
+template<typename T>
+bool QubyxProfileChain::transform(const std::vector<T>& in, std::vector<T>& out, ApplyContext* context)
 {
     using std::copy;
     using std::begin;
@@ -202,6 +294,17 @@ bool QubyxProfileChain::transform(const std::vector<T>& in, std::vector<T>& out)
 
     if (!isChainComplete()) return false;
 
+    if (fused_)
+    {
+        if (in.size() < 3)
+            return false;
+        const double lin[3] = { fused_->linear(0, in[0]), fused_->linear(1, in[1]), fused_->linear(2, in[2]) };
+        icFloatNumber rgb[3];
+        fused_->apply(lin, rgb);
+        out.assign(rgb, rgb + 3);
+        return true;
+    }
+
     bool res = true;
     icFloatNumber sPixel[16], rPixel[16];
     int inCount, outCount;
@@ -231,7 +334,10 @@ bool QubyxProfileChain::transform(const std::vector<T>& in, std::vector<T>& out)
         if (cmms_[i].in_ == QubyxProfileChain::SpaceType::XYZ)
             icXyzToPcs(sPixel);
 
-        res = res && (cmms_[i].cmm_->Apply(rPixel, sPixel) == icCmmStatOk);
+        if (context)
+            res = res && (context->applies_[i]->Apply(rPixel, sPixel) == icCmmStatOk);
+        else
+            res = res && (cmms_[i].cmm_->Apply(rPixel, sPixel) == icCmmStatOk);
 
         if (cmms_[i].out_ == QubyxProfileChain::SpaceType::Lab)
             icLabFromPcs(rPixel);
@@ -255,6 +361,503 @@ bool QubyxProfileChain::transform(const std::vector<T>& in, std::vector<T>& out)
     return res;
 }
 
+template<typename T>
+bool QubyxProfileChain::transform(const T* in, T* out, size_t nPixels, size_t inStride, size_t outStride, ApplyContext* context)
+{
+    if (!isChainComplete()) return false;
+
+    for (size_t i = 0;i < cmms_.size();++i)
+    {
+        const int inCount = colorsCountByType(cmms_[i].cmm_->GetFirstXformSource());
+        const int outCount = colorsCountByType(cmms_[i].cmm_->GetLastXformDest());
+        if (inCount > 16 || outCount > 16
+            || cmms_[i].cmm_->GetSourceSamples() < inCount || cmms_[i].cmm_->GetDestSamples() < outCount)
+            return false;
+    }
+
+    const int inN = colorsCountByType(cmms_.front().cmm_->GetFirstXformSource());
+    const int inS = cmms_.front().cmm_->GetSourceSamples();
+    const int outN = colorsCountByType(cmms_.back().cmm_->GetLastXformDest());
+    const int outS = cmms_.back().cmm_->GetDestSamples();
+
+    if (!inStride)
+        inStride = inN;
+    if (!outStride)
+        outStride = outN;
+
+    if (fused_)
+    {
+        icFloatNumber values[3 * transformBlockSize];
+        double lin[3 * transformBlockSize];
+        for (size_t first = 0;first < nPixels;first += transformBlockSize)
+        {
+            const unsigned n = (unsigned)std::min<size_t>(transformBlockSize, nPixels - first);
+
+            const T* src = in + first * inStride;
+            for (unsigned k = 0;k < n;++k)
+                for (int j = 0;j < 3;++j)
+                    values[3 * k + j] = (icFloatNumber)src[k * inStride + j];
+
+            fused_->linearN(values, n);
+            std::copy(values, values + 3 * n, lin);
+            fused_->applyN(lin, values, n);
+
+            T* dst = out + first * outStride;
+            for (unsigned k = 0;k < n;++k)
+                for (int j = 0;j < 3;++j)
+                    dst[k * outStride + j] = values[3 * k + j];
+        }
+        return true;
+    }
+
+    std::vector<icFloatNumber> sBuf(transformBlockSize * 16), rBuf(transformBlockSize * 16);
+
+    bool res = true;
+    for (size_t first = 0;first < nPixels && res;first += transformBlockSize)
+    {
+        const unsigned n = (unsigned)std::min<size_t>(transformBlockSize, nPixels - first);
+
+        const T* src = in + first * inStride;
+        icFloatNumber* sPixel = &sBuf[0];
+        for (unsigned k = 0;k < n;++k, sPixel += inS)
+            for (int j = 0;j < inN;++j)
+                sPixel[j] = src[k * inStride + j];
+
+        res = applyStages(0, cmms_.size(), &sBuf[0], &rBuf[0], n, context);
+
+        T* dst = out + first * outStride;
+        const icFloatNumber* rPixel = &rBuf[0];
+        for (unsigned k = 0;k < n;++k, rPixel += outS)
+            for (int j = 0;j < outN;++j)
+                dst[k * outStride + j] = rPixel[j];
+    }
+
+    return res;
+}
+
+template<typename T>
+bool QubyxProfileChain::transformGridLine(int grid, const int* node, int axis, T* out, ApplyContext* context)
+{
+    if (axis < 0 || axis > 2 || grid < 2)
+        return false;
+
+    std::vector<int> nodes(3 * grid);
+    for (int k = 0;k < grid;++k)
+        for (int j = 0;j < 3;++j)
+            nodes[3 * k + j] = (j == axis) ? k : node[j];
+
+    return transformGridNodes(grid, &nodes[0], grid, out, context);
+}
+
+template<typename T>
+bool QubyxProfileChain::transformGridNodes(int grid, const int* nodes, size_t nNodes, T* out, ApplyContext* context)
+{
+    if (!isChainComplete() || grid < 2) return false;
+
+    if (colorsCountByType(cmms_.front().cmm_->GetFirstXformSource()) != 3)
+        return false;
+
+    const std::vector<double>* table = gridTable(grid, context);
+    if (!table)
+    {
+        std::vector<T> in(3 * nNodes);
+        for (size_t k = 0;k < 3 * nNodes;++k)
+            in[k] = (T)(nodes[k] / (grid - 1.0));
+
+        return transform(&in[0], out, nNodes, 3, 0, context);
+    }
+
+    if (fused_)
+    {
+        //linear (after input curves) values of every grid index
+        const double* linear = &(*table)[0];
+        double lin[3 * transformBlockSize];
+        icFloatNumber rgb[3 * transformBlockSize];
+        for (size_t first = 0;first < nNodes;first += transformBlockSize)
+        {
+            const unsigned n = (unsigned)std::min<size_t>(transformBlockSize, nNodes - first);
+            for (unsigned k = 0;k < n;++k, nodes += 3)
+            {
+                lin[3 * k] = linear[nodes[0]];
+                lin[3 * k + 1] = linear[grid + nodes[1]];
+                lin[3 * k + 2] = linear[2 * grid + nodes[2]];
+            }
+
+            fused_->applyN(lin, rgb, n);
+            for (unsigned k = 0;k < 3 * n;++k)
+                out[k] = rgb[k];
+            out += 3 * n;
+        }
+        return true;
+    }
+
+    //first stage output of node = origin + sum of column differences of its coordinates
+    const double* origin = &(*table)[0];
+    const double* columns[3] = { &(*table)[3], &(*table)[3 + 3 * grid], &(*table)[3 + 6 * grid] };
+
+    const size_t stages = cmms_.size();
+    const int inS = cmms_[1].cmm_->GetSourceSamples();
+    const int outN = colorsCountByType(cmms_.back().cmm_->GetLastXformDest());
+    const int outS = cmms_.back().cmm_->GetDestSamples();
+    if (outN > 16 || outS < outN)
+        return false;
+
+    std::vector<icFloatNumber> sBuf(transformBlockSize * 16), rBuf(transformBlockSize * 16);
+
+    bool res = true;
+    for (size_t first = 0;first < nNodes && res;first += transformBlockSize)
+    {
+        const unsigned n = (unsigned)std::min<size_t>(transformBlockSize, nNodes - first);
+
+        icFloatNumber* sPixel = &sBuf[0];
+        for (unsigned k = 0;k < n;++k, sPixel += inS)
+        {
+            const int* node = nodes + 3 * (first + k);
+            const double* r = columns[0] + 3 * node[0];
+            const double* g = columns[1] + 3 * node[1];
+            const double* b = columns[2] + 3 * node[2];
+            for (int c = 0;c < 3;++c)
+                sPixel[c] = (icFloatNumber)(r[c] + g[c] + b[c] - 2 * origin[c]);
+        }
+
+        res = applyStages(1, stages, &sBuf[0], &rBuf[0], n, context);
+
+        T* dst = out + first * outN;
+        const icFloatNumber* rPixel = &rBuf[0];
+        for (unsigned k = 0;k < n;++k, rPixel += outS)
+            for (int j = 0;j < outN;++j)
+                dst[k * outN + j] = rPixel[j];
+    }
+
+    return res;
+}
+
+bool QubyxProfileChain::applyStages(size_t first, size_t last, icFloatNumber* sBuf, icFloatNumber* rBuf, unsigned n, ApplyContext* context)
+{
+    bool res = true;
+    for (size_t i = first;i < last && res;++i)
+    {
+        const CMM& cmm = cmms_[i];
+        const int inN = colorsCountByType(cmm.cmm_->GetFirstXformSource());
+        const int outN = colorsCountByType(cmm.cmm_->GetLastXformDest());
+        const int inS = cmm.cmm_->GetSourceSamples(), outS = cmm.cmm_->GetDestSamples();
+        CIccApplyCmm* apply = context ? context->applies_[i] : cmm.cmm_->GetApply();
+
+        icFloatNumber* sPixel = sBuf;
+        if (i != first)
+        {
+            const icFloatNumber* rPixel = rBuf;
+            const int prevS = cmms_[i - 1].cmm_->GetDestSamples();
+            for (unsigned k = 0;k < n;++k, sPixel += inS, rPixel += prevS)
+                for (int j = 0;j < inN;++j)
+                    sPixel[j] = rPixel[j];
+        }
+
+        const bool divideLum = cmm.hasInputLuminance_ && cmm.in_ == SpaceType::XYZ;
+        const bool labIn = (cmm.in_ == SpaceType::Lab), xyzIn = (cmm.in_ == SpaceType::XYZ);
+        if (divideLum || cmm.hasInputChad_ || labIn || xyzIn)
+        {
+            sPixel = sBuf;
+            for (unsigned k = 0;k < n;++k, sPixel += inS)
+            {
+                if (divideLum)
+                    for (int j = 0;j < inN;++j)
+                        sPixel[j] /= cmm.inputLum_;
+
+                if (cmm.hasInputChad_)
+                    QubyxProfile::applyChromaticAdaptation(cmm.inputChad_, sPixel);
+
+                if (labIn)
+                    icLabToPcs(sPixel);
+                if (xyzIn)
+                    icXyzToPcs(sPixel);
+            }
+        }
+
+        res = (apply->Apply(rBuf, sBuf, n) == icCmmStatOk);
+
+        const bool multiplyLum = cmm.hasOutputLuminance_ && cmm.out_ == SpaceType::XYZ;
+        const bool labOut = (cmm.out_ == SpaceType::Lab), xyzOut = (cmm.out_ == SpaceType::XYZ);
+        if (multiplyLum || cmm.hasOutputChad_ || labOut || xyzOut)
+        {
+            icFloatNumber* rPixel = rBuf;
+            for (unsigned k = 0;k < n;++k, rPixel += outS)
+            {
+                if (labOut)
+                    icLabFromPcs(rPixel);
+                if (xyzOut)
+                    icXyzFromPcs(rPixel);
+
+                if (cmm.hasOutputChad_)
+                    QubyxProfile::applyChromaticAdaptation(cmm.outputChad_, rPixel);
+
+                if (multiplyLum)
+                    for (int j = 0;j < outN;++j)
+                        rPixel[j] *= cmm.outputLum_;
+            }
+        }
+    }
+
+    return res;
+}
+
+bool QubyxProfileChain::hasMatrixTRCInput()
+{
+    if (cmms_.empty() || in_ != SpaceType::DeviceSpecific)
+        return false;
+
+    //device -> curves -> matrix -> XYZ (+ chad, luminance) is affine in the curve outputs,
+    //so the first CMM must hold the matrix/TRC input profile only and end in XYZ
+    const CMM& cmm = cmms_.front();
+    const CIccXform* xform = cmm.cmm_->GetFirstXform();
+    return cmm.cmm_->GetNumXforms() == 1
+        && xform && xform->GetXformType() == icXformTypeMatrixTRC && xform->IsInput()
+        && cmm.out_ == SpaceType::XYZ && cmm.cmm_->GetLastXformDest() == icSigXYZData
+        && !cmm.hasInputChad_ && !cmm.hasInputLuminance_;
+}
+
+bool QubyxProfileChain::separableFirstStage()
+{
+    return cmms_.size() >= 2 && hasMatrixTRCInput();
+}
+
+const std::vector<double>* QubyxProfileChain::gridTable(int grid, ApplyContext* context)
+{
+    if (!fused_ && !separableFirstStage())
+        return nullptr;
+
+    int& cachedGrid = context ? context->grid_ : grid_;
+    std::vector<double>& table = context ? context->gridTable_ : gridTable_;
+    if (cachedGrid == grid)
+        return &table;
+    cachedGrid = 0;
+
+    if (fused_)
+    {
+        table.resize(3 * grid);
+        for (int j = 0;j < 3;++j)
+            for (int k = 0;k < grid;++k)
+                table[j * grid + k] = fused_->linear(j, (icFloatNumber)(k / (grid - 1.0)));
+
+        cachedGrid = grid;
+        return &table;
+    }
+
+    const int inS = cmms_.front().cmm_->GetSourceSamples();
+    const int outS = cmms_.front().cmm_->GetDestSamples();
+    if (inS < 3 || inS > 16 || outS < 3 || outS > 16)
+        return nullptr;
+
+    //black node, then grid nodes along each axis
+    const int nodes = 1 + 3 * grid;
+    table.assign(3 * nodes, 0.0);
+
+    std::vector<icFloatNumber> sBuf(transformBlockSize * 16), rBuf(transformBlockSize * 16);
+    for (int first = 0;first < nodes;first += transformBlockSize)
+    {
+        const unsigned n = (unsigned)std::min<int>(transformBlockSize, nodes - first);
+
+        icFloatNumber* sPixel = &sBuf[0];
+        for (unsigned k = 0;k < n;++k, sPixel += inS)
+        {
+            std::fill(sPixel, sPixel + inS, (icFloatNumber)0);
+            const int index = first + (int)k - 1;
+            if (index >= 0)
+                sPixel[index / grid] = (icFloatNumber)((index % grid) / (grid - 1.0));
+        }
+
+        if (!applyStages(0, 1, &sBuf[0], &rBuf[0], n, context))
+            return nullptr;
+
+        const icFloatNumber* rPixel = &rBuf[0];
+        for (unsigned k = 0;k < n;++k, rPixel += outS)
+            for (int c = 0;c < 3;++c)
+                table[3 * (first + k) + c] = rPixel[c];
+    }
+
+    cachedGrid = grid;
+    return &table;
+}
+
+void QubyxProfileChain::compileMatrixTRC()
+{
+    fused_.reset();
+
+    if (cmms_.size() != 2 || !separableFirstStage())
+        return;
+
+    const CMM& first = cmms_.front();
+    const CMM& last = cmms_.back();
+    const CIccXform* xform = last.cmm_->GetFirstXform();
+    if (last.cmm_->GetNumXforms() != 1
+        || !xform || xform->GetXformType() != icXformTypeMatrixTRC || xform->IsInput()
+        || xform->GetSrcSpace() != icSigXYZData
+        || last.in_ != SpaceType::XYZ || last.out_ != SpaceType::DeviceSpecific || last.hasOutputChad_)
+        return;
+
+    const CIccXformMatrixTRC* input = static_cast<const CIccXformMatrixTRC*>(first.cmm_->GetFirstXform());
+    const CIccXformMatrixTRC* output = static_cast<const CIccXformMatrixTRC*>(xform);
+
+#ifndef SAMPLEICC_NOCLIPLABTOXYZ
+    const bool clipPCS = true;
+#else
+    const bool clipPCS = false;
+#endif
+
+    std::unique_ptr<MatrixTRCKernel> kernel(new MatrixTRCKernel);
+    kernel->steps_ = 0;
+    for (int c = 0;c < 3;++c)
+    {
+        kernel->inCurves_[c] = input->GetApplyCurve(c);
+        kernel->outCurves_[c] = output->GetApplyCurve(c);
+    }
+
+    //every operation below is applied to the step being built, a clip starts a new one
+    double step[12] = { 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0 };
+    auto multiply = [&step](const double* m) {
+        double res[12];
+        for (int r = 0;r < 3;++r)
+        {
+            for (int c = 0;c < 3;++c)
+                res[3 * r + c] = m[3 * r] * step[c] + m[3 * r + 1] * step[3 + c] + m[3 * r + 2] * step[6 + c];
+            res[9 + r] = m[3 * r] * step[9] + m[3 * r + 1] * step[10] + m[3 * r + 2] * step[11];
+        }
+        std::copy(res, res + 12, step);
+    };
+    auto scale = [&step](const double* s, const double* o) {
+        for (int r = 0;r < 3;++r)
+        {
+            for (int c = 0;c < 3;++c)
+                step[3 * r + c] *= s[r];
+            step[9 + r] = step[9 + r] * s[r] + (o ? o[r] : 0);
+        }
+    };
+    auto endStep = [&step, &kernel](bool clip) {
+        std::copy(step, step + 12, kernel->step_[kernel->steps_]);
+        kernel->clip_[kernel->steps_++] = clip;
+        const double identity[12] = { 1, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0 };
+        std::copy(identity, identity + 12, step);
+    };
+
+    const double toPcs[3] = { 32768.0 / 65535.0, 32768.0 / 65535.0, 32768.0 / 65535.0 };
+    const double fromPcs[3] = { 65535.0 / 32768.0, 65535.0 / 32768.0, 65535.0 / 32768.0 };
+    double m[9], s[3], o[3];
+    icFloatNumber pcsScale[3], pcsOffset[3];
+
+    //input xform: matrix, XYZScale, CheckDstAbs
+    std::copy(input->GetMatrix(), input->GetMatrix() + 9, m);
+    multiply(m);
+    scale(toPcs, nullptr);
+    if (input->GetPCSAdjustment(pcsScale, pcsOffset))
+    {
+        std::copy(pcsScale, pcsScale + 3, s);
+        std::copy(pcsOffset, pcsOffset + 3, o);
+        scale(s, o);
+        endStep(clipPCS);
+    }
+
+    //chain between the CMMs (see applyStages)
+    scale(fromPcs, nullptr);
+    if (first.hasOutputChad_)
+        multiply(&first.outputChad_[0]);
+    if (first.hasOutputLuminance_)
+    {
+        const double lum[3] = { first.outputLum_, first.outputLum_, first.outputLum_ };
+        scale(lum, nullptr);
+    }
+    if (last.hasInputLuminance_)
+    {
+        const double lum[3] = { 1 / last.inputLum_, 1 / last.inputLum_, 1 / last.inputLum_ };
+        scale(lum, nullptr);
+    }
+    if (last.hasInputChad_)
+        multiply(&last.inputChad_[0]);
+    scale(toPcs, nullptr);
+
+    //output xform: CheckSrcAbs, XYZDescale, inverse matrix
+    if (output->GetPCSAdjustment(pcsScale, pcsOffset))
+    {
+        std::copy(pcsScale, pcsScale + 3, s);
+        std::copy(pcsOffset, pcsOffset + 3, o);
+        scale(s, o);
+        endStep(clipPCS);
+    }
+    scale(fromPcs, nullptr);
+    std::copy(output->GetMatrix(), output->GetMatrix() + 9, m);
+    multiply(m);
+    endStep(false);
+
+    fused_ = std::move(kernel);
+}
+
+void QubyxProfileChain::MatrixTRCKernel::apply(const double lin[3], icFloatNumber* out) const
+{
+    double v[3] = { lin[0], lin[1], lin[2] };
+    for (int i = 0;i < steps_;++i)
+    {
+        const double* m = step_[i];
+        double r[3];
+        for (int j = 0;j < 3;++j)
+        {
+            r[j] = m[3 * j] * v[0] + m[3 * j + 1] * v[1] + m[3 * j + 2] * v[2] + m[9 + j];
+            if (clip_[i] && r[j] < 0)
+                r[j] = 0;
+        }
+        v[0] = r[0];
+        v[1] = r[1];
+        v[2] = r[2];
+    }
+
+    for (int c = 0;c < 3;++c)
+    {
+        icFloatNumber value = (icFloatNumber)v[c];
+        if (outCurves_[c])
+            value = outCurves_[c]->Apply(std::min(std::max(value, (icFloatNumber)0), (icFloatNumber)1));
+        out[c] = value;
+    }
+}
+
+void QubyxProfileChain::MatrixTRCKernel::linearN(icFloatNumber* values, unsigned n) const
+{
+    for (int c = 0;c < 3;++c)
+        if (inCurves_[c])
+            inCurves_[c]->ApplyN(values + c, n, 3);
+}
+
+void QubyxProfileChain::MatrixTRCKernel::applyN(const double* lin, icFloatNumber* out, unsigned n) const
+{
+    for (unsigned k = 0;k < n;++k, lin += 3)
+    {
+        double v[3] = { lin[0], lin[1], lin[2] };
+        for (int i = 0;i < steps_;++i)
+        {
+            const double* m = step_[i];
+            double r[3];
+            for (int j = 0;j < 3;++j)
+            {
+                r[j] = m[3 * j] * v[0] + m[3 * j + 1] * v[1] + m[3 * j + 2] * v[2] + m[9 + j];
+                if (clip_[i] && r[j] < 0)
+                    r[j] = 0;
+            }
+            v[0] = r[0];
+            v[1] = r[1];
+            v[2] = r[2];
+        }
+
+        for (int c = 0;c < 3;++c)
+        {
+            icFloatNumber value = (icFloatNumber)v[c];
+            if (outCurves_[c])
+                value = std::min(std::max(value, (icFloatNumber)0), (icFloatNumber)1);
+            out[3 * k + c] = value;
+        }
+    }
+
+    for (int c = 0;c < 3;++c)
+        if (outCurves_[c])
+            outCurves_[c]->ApplyN(out + c, n, 3);
+}
+
 icRenderingIntent QubyxProfileChain::iccProfLibRI(QubyxProfileChain::RI renderingIntent)
 {
     switch (renderingIntent)
@@ -350,6 +953,20 @@ int QubyxProfileChain::colorsCountByType(icColorSpaceSignature sig)
 
 template bool QubyxProfileChain::transform<double>(const std::vector<double>& in, std::vector<double>& out);
 template bool QubyxProfileChain::transform<float>(const std::vector<float>& in, std::vector<float>& out);
+template bool QubyxProfileChain::transform<double>(const std::vector<double>& in, std::vector<double>& out, ApplyContext* context);
+template bool QubyxProfileChain::transform<float>(const std::vector<float>& in, std::vector<float>& out, ApplyContext* context);
+template bool QubyxProfileChain::transform<double>(const double* in, double* out, size_t nPixels, size_t inStride, size_t outStride, ApplyContext* context);
+template bool QubyxProfileChain::transform<float>(const float* in, float* out, size_t nPixels, size_t inStride, size_t outStride, ApplyContext* context);
+template bool QubyxProfileChain::transformGridLine<double>(int grid, const int* node, int axis, double* out, ApplyContext* context);
+template bool QubyxProfileChain::transformGridLine<float>(int grid, const int* node, int axis, float* out, ApplyContext* context);
+template bool QubyxProfileChain::transformGridNodes<double>(int grid, const int* nodes, size_t nNodes, double* out, ApplyContext* context);
+template bool QubyxProfileChain::transformGridNodes<float>(int grid, const int* nodes, size_t nNodes, float* out, ApplyContext* context);
+
+QubyxProfileChain::ApplyContext::~ApplyContext()
+{
+    for (auto apply : applies_)
+        delete apply;
+}
 
 QubyxProfileChain::CMM::CMM(SpaceType in, SpaceType out)
     : hasInputChad_(false),
@@ -8,6 +8,7 @@
 
 #include <vector>
 #include <memory>
+#include <mutex>
 
 #include "QubyxProfile.h"
 
@@ -33,6 +34,27 @@ public:
         RealisticColorimetricWithLuminance
     };
 
+    /**
+     * Per-thread apply state of the chain. Holds one CIccApplyCmm for every CMM of the chain,
+     * so several threads can transform through the same chain simultaneously.
+     */
+    class ApplyContext
+    {
+    public:
+        ~ApplyContext();
+
+    private:
+        ApplyContext() : grid_(0) {}
+        ApplyContext(const ApplyContext&);
+        ApplyContext& operator=(const ApplyContext&);
+
+        std::vector<CIccApplyCmm*> applies_;
+        int grid_;
+        std::vector<double> gridTable_;
+
+        friend class QubyxProfileChain;
+    };
+
     QubyxProfileChain();
     QubyxProfileChain(SpaceType in, SpaceType out, RI renderingIntent = RI::AbsoluteColorimetric);
 
@@ -52,6 +74,69 @@ public:
     template<typename T>
     bool transform(const std::vector<T>& in, std::vector<T>& out);
 
+    /**
+     * Same as transform(in, out), but uses apply objects of the context instead of the chain's own ones.
+     * @param context created by newApplyContext() of this chain, must not be shared between threads
+     */
+    template<typename T>
+    bool transform(const std::vector<T>& in, std::vector<T>& out, ApplyContext* context);
+
+    /**
+     * Transforms a buffer of pixels. Every CMM stage of the chain is applied to a whole block of pixels
+     * at once (see CIccApplyCmm::Apply with nPixels).
+     * @param in first pixel of source buffer
+     * @param out first pixel of destination buffer, may be the same as in if strides allow it
+     * @param nPixels number of pixels to transform
+     * @param inStride distance between pixels of in (in elements), 0 - packed by chain input channels
+     * @param outStride distance between pixels of out (in elements), 0 - packed by chain output channels
+     * @param context per-thread apply objects (see newApplyContext), nullptr - use chain's own ones
+     */
+    template<typename T>
+    bool transform(const T* in, T* out, size_t nPixels, size_t inStride = 0, size_t outStride = 0, ApplyContext* context = nullptr);
+
+    /**
+     * Transforms one line of a regular RGB device grid (grid nodes per axis, node values index/(grid-1)).
+     * If the first profile of the chain is a matrix/TRC input profile, its curves are evaluated only grid times
+     * per channel: PCS of a node is built from per-axis columns kept in the context and only the rest of the chain
+     * is applied per node (a fused chain takes the curve values from the context). Otherwise the line is
+     * transformed as a buffer of pixels.
+     * @param grid nodes per axis, at least 2
+     * @param node grid indices of the first node of the line (R, G, B)
+     * @param axis input channel changing along the line, node[axis] is ignored
+     * @param out grid pixels packed by chain output channels
+     * @param context per-thread apply objects (see newApplyContext), nullptr - use chain's own ones
+     */
+    template<typename T>
+    bool transformGridLine(int grid, const int* node, int axis, T* out, ApplyContext* context = nullptr);
+
+    /**
+     * Same as transformGridLine, but for any nodes of the grid (e.g. scattered nodes of an adaptive grid).
+     * Chain input must have 3 channels.
+     * @param nodes nNodes grid index triples
+     * @param out nNodes pixels packed by chain output channels
+     */
+    template<typename T>
+    bool transformGridNodes(int grid, const int* nodes, size_t nNodes, T* out, ApplyContext* context = nullptr);
+
+    /**
+     * Completes the chain (if not yet) and allocates new apply objects for it (see CIccCmm::GetNewApplyCmm).
+     * May be called from several threads, e.g. by users of a shared chain (see QubyxChainCache).
+     * @return context or nullptr if chain is not complete
+     */
+    std::unique_ptr<ApplyContext> newApplyContext();
+
+    /**
+     * @brief hasMatrixTRCInput tells if the chain starts with a matrix/TRC input profile converted to XYZ
+     * without input chromatic adaptation and luminance. Grid nodes of such a chain are built from per-axis
+     * values of that stage (see transformGridLine), so the stage costs only grid evaluations per axis.
+     */
+    bool hasMatrixTRCInput();
+
+    /**
+     * @brief approximateSize estimates memory held by the chain (profile copies and inverse curves)
+     */
+    size_t approximateSize() const;
+
     static std::shared_ptr<QubyxProfileChain> singleProfileChain(QubyxProfile* profile, SpaceType in, SpaceType out, RI renderingIntent = RI::AbsoluteColorimetric);
     static std::shared_ptr<QubyxProfileChain> singleProfileChain(const QubyxProfile& profile, SpaceType in, SpaceType out, RI renderingIntent = RI::AbsoluteColorimetric);
 
@@ -64,6 +149,8 @@ private:
     bool hasLastLuminance_;
     double lastLuminance_;
     SpaceType lastOutput_;
+    size_t approximateSize_;
+    std::mutex contextLock_;
 
     struct CMM
     {
@@ -80,10 +167,57 @@ private:
         void changeOutput(SpaceType out);
     };
     std::vector<CMM> cmms_;
+    int grid_;
+    std::vector<double> gridTable_;   //see gridTable
+
+    bool applyStages(size_t first, size_t last, icFloatNumber* sBuf, icFloatNumber* rBuf, unsigned n, ApplyContext* context);
+    bool separableFirstStage();
+    /**
+     * Per-axis values of grid nodes kept in the context (or the chain): input curve values of every axis for
+     * a fused chain, first stage outputs of the black node and of the nodes along every axis for a separable one.
+     * @return nullptr if the chain is neither fused nor separable
+     */
+    const std::vector<double>* gridTable(int grid, ApplyContext* context);
+
+    /**
+     * Matrix/TRC -> matrix/TRC chain compiled to input curves, affine steps and output curves (see compileMatrixTRC).
+     * Steps are split only where the CMMs clip negative PCS values. Curves are the ones of the CMMs, matrices are
+     * fused in double precision, so results differ from the CMM path by float rounding only (below 1e-6).
+     */
+    struct MatrixTRCKernel
+    {
+        CIccCurve* inCurves_[3];    //nullptr - identity
+        CIccCurve* outCurves_[3];   //nullptr - identity without clipping
+        int steps_;
+        double step_[3][12];        //row major 3x3 matrix followed by 3 offsets
+        bool clip_[3];              //clip negative results of the step
+
+        double linear(int channel, icFloatNumber value) const
+        {
+            return inCurves_[channel] ? inCurves_[channel]->Apply(value) : value;
+        }
+        void apply(const double lin[3], icFloatNumber* out) const;
+
+        /**
+         * Block versions of linear and apply on n packed RGB pixels. Curves run through ApplyN, so tabulated
+         * gamma and parametric curves give values within 2^-23 of the per pixel versions.
+         */
+        void linearN(icFloatNumber* values, unsigned n) const;
+        void applyN(const double* lin, icFloatNumber* out, unsigned n) const;
+    };
+    std::unique_ptr<MatrixTRCKernel> fused_;
+
+    void compileMatrixTRC();
 
     static icRenderingIntent iccProfLibRI(RI renderingIntent);
     static icColorSpaceSignature iccProfLibSpace(SpaceType space);
     static SpaceType spaceType(icColorSpaceSignature space);
     static int colorsCountByType(icColorSpaceSignature sig);
+    //inverse tables the output xform samples, closed form inverses do not count
+    static unsigned sampledInverseCurves(const CIccXform* xform);
+
+    static const unsigned transformBlockSize = 256;
+    //inverse TRC resolution for output matrix/TRC profiles (dark end precision)
+    static const unsigned inverseCurveSize = 65536;
 };
 #endif // QUBYXPROFILECHAINS_H
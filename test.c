@@ -1,11 +1,220 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
 #include <windows.h>
 #include <direct.h>
 
 // Function pointer type for the DLL function
 typedef int (*Generate3dLutFunc)(char*, char*, int, unsigned int*, unsigned int*, unsigned int*);
 
+// Same layouts as in qubyx3dlutgenerator.h (the header is C++ only)
+typedef struct
+{
+    int layout;             // 0 - interleaved, 1 - planar
+    int type;               // Q3dLut_SampleType, 0 - uint16
+    void* data[3];
+    size_t stride;
+} LutOutput;
+
+typedef struct
+{
+    int layout;             // 0 - interleaved, 1 - planar
+    int type;               // 0 - 8 bit, 1 - 10 bit, 2 - 16 bit
+    void* data[3];
+    int width;
+    int height;
+    size_t pixelStride;
+    size_t rowStride;
+} LutImage;
+
+typedef int (*Generate3dLutToFunc)(char*, char*, int, const LutOutput*, int);
+typedef int (*ApplierCreateFunc)(int, const LutOutput*, int, void**);
+typedef void (*ApplierReleaseFunc)(void*);
+typedef int (*ApplyFunc)(const void*, const LutImage*, const LutImage*, int);
+
+// Tetrahedral interpolation of 16 bit RGB nodes in double, rgb in 0..1, result in 0..65535
+static void referenceTetrahedral(const uint16_t* nodes, int grid, const double* rgb, double* out)
+{
+    int index[3], axis[3] = { 0, 1, 2 };
+    double fraction[3];
+    for (int c = 0; c < 3; c++) {
+        double x = rgb[c] * (grid - 1);
+        index[c] = (int)x;
+        if (index[c] > grid - 2)
+            index[c] = grid - 2;
+        fraction[c] = x - index[c];
+    }
+
+    // axes by falling fraction
+    for (int i = 0; i < 3; i++)
+        for (int j = i + 1; j < 3; j++)
+            if (fraction[axis[j]] > fraction[axis[i]]) {
+                int t = axis[i];
+                axis[i] = axis[j];
+                axis[j] = t;
+            }
+
+    for (int c = 0; c < 3; c++) {
+        int node[3] = { index[0], index[1], index[2] };
+        double weight = 1.0, value = 0.0;
+        for (int k = 0; k <= 3; k++) {
+            double next = (k < 3) ? fraction[axis[k]] : 0.0;
+            value += (weight - next) * nodes[3 * ((node[0] * grid + node[1]) * grid + node[2]) + c];
+            weight = next;
+            if (k < 3)
+                node[axis[k]]++;
+        }
+        out[c] = value;
+    }
+}
+
+// Applies the LUT to 8 and 16 bit images and compares them with the double reference, returns 0 on success
+static int testApply(HMODULE dll, char* ga_profile, char* display_profile)
+{
+    Generate3dLutToFunc generate3dLutTo = (Generate3dLutToFunc)GetProcAddress(dll, "generate3dLutTo");
+    ApplierCreateFunc create = (ApplierCreateFunc)GetProcAddress(dll, "q3dlut_applier_create");
+    ApplierReleaseFunc release = (ApplierReleaseFunc)GetProcAddress(dll, "q3dlut_applier_release");
+    ApplyFunc apply = (ApplyFunc)GetProcAddress(dll, "q3dlut_apply");
+    if (!generate3dLutTo || !create || !release || !apply) {
+        printf("ERROR: LUT apply functions not found in DLL\n");
+        return 1;
+    }
+
+    const int grid = 33, width = 301, height = 67;
+    const size_t nodeCount = (size_t)grid * grid * grid;
+    uint16_t* nodes = malloc(3 * nodeCount * sizeof(uint16_t));
+    uint8_t* image8 = malloc(3 * width * height);
+    uint8_t* result8 = malloc(3 * width * height);
+    uint16_t* image16 = malloc(3 * width * height * sizeof(uint16_t));
+    int failed = 0;
+
+    if (!nodes || !image8 || !result8 || !image16) {
+        printf("ERROR: Memory allocation failed\n");
+        free(nodes); free(image8); free(result8); free(image16);
+        return 1;
+    }
+
+    LutOutput lut = { 0, 0, { nodes, NULL, NULL }, 0 };
+    int result = generate3dLutTo(ga_profile, display_profile, grid, &lut, 0);
+    if (result != 0) {
+        // no profiles: a smooth nonlinear LUT still tests the apply engine
+        printf("generate3dLutTo result: %d, applying a synthetic LUT\n", result);
+        for (int r = 0; r < grid; r++)
+            for (int g = 0; g < grid; g++)
+                for (int b = 0; b < grid; b++) {
+                    double x = r / (grid - 1.0), y = g / (grid - 1.0), z = b / (grid - 1.0);
+                    uint16_t* node = nodes + 3 * ((r * grid + g) * grid + b);
+                    node[0] = (uint16_t)floor(65535 * pow(0.8 * x + 0.2 * z, 2.2) + 0.5);
+                    node[1] = (uint16_t)floor(65535 * sqrt(y) + 0.5);
+                    node[2] = (uint16_t)floor(65535 * (0.5 + 0.5 * sin(3 * z + x)) + 0.5);
+                }
+    }
+
+    void* applier = NULL;
+    result = create(grid, &lut, 0, &applier);
+    if (result != 0) {
+        printf("ERROR: q3dlut_applier_create result: %d\n", result);
+        free(nodes); free(image8); free(result8); free(image16);
+        return 1;
+    }
+
+    srand(1);
+    for (int i = 0; i < 3 * width * height; i++) {
+        image8[i] = (uint8_t)(rand() & 0xff);
+        image16[i] = (uint16_t)(((rand() & 0xff) << 8) | (rand() & 0xff));
+    }
+
+    // 16 bit in place, reference from the source values
+    uint16_t* source16 = malloc(3 * width * height * sizeof(uint16_t));
+    memcpy(source16, image16, 3 * width * height * sizeof(uint16_t));
+    LutImage src8 = { 0, 0, { image8, NULL, NULL }, width, height, 0, 0 };
+    LutImage dst8 = { 0, 0, { result8, NULL, NULL }, width, height, 0, 0 };
+    LutImage img16 = { 0, 2, { image16, NULL, NULL }, width, height, 0, 0 };
+
+    if (apply(applier, &src8, &dst8, 0) != 0 || apply(applier, &img16, NULL, 0) != 0) {
+        printf("ERROR: q3dlut_apply failed\n");
+        failed = 1;
+    }
+
+    double maxError8 = 0, maxError16 = 0;
+    for (int i = 0; i < width * height && !failed; i++) {
+        double rgb[3], out[3];
+        for (int c = 0; c < 3; c++)
+            rgb[c] = image8[3 * i + c] / 255.0;
+        referenceTetrahedral(nodes, grid, rgb, out);
+        for (int c = 0; c < 3; c++)
+            maxError8 = fmax(maxError8, fabs(out[c] * 255.0 / 65535.0 - result8[3 * i + c]));
+
+        for (int c = 0; c < 3; c++)
+            rgb[c] = source16[3 * i + c] / 65535.0;
+        referenceTetrahedral(nodes, grid, rgb, out);
+        for (int c = 0; c < 3; c++)
+            maxError16 = fmax(maxError16, fabs(out[c] - image16[3 * i + c]));
+    }
+
+    // fixed point weights have 15 bits, 8 bit results are rounded once more
+    printf("LUT apply max error: 8 bit %.3f, 16 bit %.3f\n", maxError8, maxError16);
+    if (maxError8 > 0.52 || maxError16 > 4.0) {
+        printf("ERROR: LUT apply differs from the reference\n");
+        failed = 1;
+    }
+
+    release(applier);
+    free(nodes); free(image8); free(result8); free(image16); free(source16);
+    return failed;
+}
+
+typedef int (*ChainWriteFunc)(void*, int, int, const char*, int);
+
+// Failing q3dlut_chain_write calls must leave an existing file untouched, returns 0 on success
+static int testWriteKeepsFile(HMODULE dll)
+{
+    ChainWriteFunc chainWrite = (ChainWriteFunc)GetProcAddress(dll, "q3dlut_chain_write");
+    if (!chainWrite) {
+        printf("ERROR: q3dlut_chain_write not found in DLL\n");
+        return 1;
+    }
+
+    const char* path = "test_existing.cube";
+    const char contents[] = "LUT_3D_SIZE 2\n";
+    FILE* file = fopen(path, "wb");
+    if (!file || fwrite(contents, 1, sizeof(contents) - 1, file) != sizeof(contents) - 1) {
+        printf("ERROR: Can't create %s\n", path);
+        if (file)
+            fclose(file);
+        return 1;
+    }
+    fclose(file);
+
+    // null chain, wrong grid and unknown format with a null chain all fail before the file is opened
+    int results[3] = { chainWrite(NULL, 17, 0, path, 0), chainWrite(NULL, 1, 0, path, 0), chainWrite(NULL, 17, 99, path, 0) };
+
+    char read[sizeof(contents) + 1] = { 0 };
+    size_t size = 0;
+    file = fopen(path, "rb");
+    if (file) {
+        size = fread(read, 1, sizeof(read), file);
+        fclose(file);
+    }
+    remove(path);
+
+    int failed = 0;
+    for (int i = 0; i < 3; i++)
+        if (results[i] == 0) {
+            printf("ERROR: q3dlut_chain_write call %d succeeded with wrong arguments\n", i);
+            failed = 1;
+        }
+    if (size != sizeof(contents) - 1 || memcmp(read, contents, size) != 0) {
+        printf("ERROR: Failed q3dlut_chain_write changed the existing file\n");
+        failed = 1;
+    }
+    if (!failed)
+        printf("Failed LUT writes keep the existing file\n");
+    return failed;
+}
+
 int main() {
     printf("Qubyx3DLUTGenerator - Test Program\n");
     printf("==================================\n\n");
@@ -78,6 +287,18 @@ int main() {
     free(rlut);
     free(glut);
     free(blut);
+
+    printf("\nTesting failed LUT file writes...\n");
+    if (testWriteKeepsFile(dll)) {
+        FreeLibrary(dll);
+        return 1;
+    }
+
+    printf("\nTesting LUT apply...\n");
+    if (testApply(dll, "ga_profile.icc", "display_profile.icc")) {
+        FreeLibrary(dll);
+        return 1;
+    }
     FreeLibrary(dll);
     
     printf("\nTest completed successfully!\n");